@@ -45,3 +45,166 @@ function(minet_disable_warnings target_name)
         message(VERBOSE "Cannot disable warnings for INTERFACE target: ${target_name}")
     endif()
 endfunction()
+
+# Embed files under a directory into the target, with their responses built
+# ahead of time, see minet/components/EmbeddedAssets.h
+#   minet_embed_assets(<target> <name> <directory> [PREFIX <path>] [SERVER <name>] [GZIP])
+# Include "<name>.h" to get the assets as <name>, and register them with
+# WebHostBuilder::UseEmbeddedAssets. With GZIP, assets that gzip makes
+# smaller also get a compressed variant. Hidden files are left out.
+# SERVER is the Server header of the responses, "minet" by default, as the
+# server is only chosen at run time. Set it to match other responses.
+function(minet_embed_assets target name directory)
+    cmake_parse_arguments(PARSE_ARGV 3 arg "GZIP" "PREFIX;SERVER" "")
+    string(REGEX REPLACE "/+$" "" prefix "${arg_PREFIX}")
+    set(server "minet")
+    if(arg_SERVER)
+        set(server "${arg_SERVER}")
+    endif()
+
+    set(gzip_program "")
+    if(arg_GZIP)
+        find_program(MINET_GZIP gzip)
+        if(MINET_GZIP)
+            set(gzip_program ${MINET_GZIP})
+        else()
+            message(WARNING "gzip not found, assets of ${name} are not compressed")
+        endif()
+    endif()
+
+    file(GLOB_RECURSE files CONFIGURE_DEPENDS LIST_DIRECTORIES false RELATIVE "${directory}" "${directory}/*")
+    list(SORT files)
+
+    set(work_dir "${CMAKE_CURRENT_BINARY_DIR}/${name}")
+    file(MAKE_DIRECTORY "${work_dir}")
+
+    set(entries "")
+    set(count 0)
+    foreach(file ${files})
+        if(file MATCHES "(^|/)\\.")
+            continue()
+        endif()
+        set(path "${directory}/${file}")
+        set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${path}")
+
+        _minet_content_type("${file}" type)
+        file(SIZE "${path}" size)
+        _minet_file_literal("${path}" body)
+        string(REPLACE "\\" "\\\\" request_path "${prefix}/${file}")
+        string(REPLACE "\"" "\\\"" request_path "${request_path}")
+
+        set(head "HTTP/1.1 200 OK\\r\\nServer: ${server}\\r\\nContent-Type: ${type}\\r\\n")
+        set(vary "")
+        set(gzip_entry "{}, { {}, {} }")
+        if(gzip_program)
+            set(gzip_path "${work_dir}/${count}.gz")
+            execute_process(COMMAND ${gzip_program} -9 -n -c "${path}" OUTPUT_FILE "${gzip_path}"
+                            RESULT_VARIABLE result)
+            file(SIZE "${gzip_path}" gzip_size)
+            if((result EQUAL 0) AND (gzip_size LESS size))
+                _minet_file_literal("${gzip_path}" gzip_body)
+                set(vary "Vary: Accept-Encoding\\r\\n")
+                set(gzip_head "${head}Content-Encoding: gzip\\r\\n${vary}Content-Length: ${gzip_size}\\r\\n")
+                string(CONCAT gzip_entry
+                    "${gzip_body},\n"
+                    "        { \"${gzip_head}Connection: close\\r\\n\\r\\n\",\n"
+                    "          \"${gzip_head}Connection: keep-alive\\r\\n\\r\\n\" }")
+            endif()
+        endif()
+        set(head "${head}${vary}Content-Length: ${size}\\r\\n")
+
+        string(APPEND entries
+            "    {\n"
+            "        \"${request_path}\",\n"
+            "        ${body},\n"
+            "        { \"${head}Connection: close\\r\\n\\r\\n\",\n"
+            "          \"${head}Connection: keep-alive\\r\\n\\r\\n\" },\n"
+            "        ${gzip_entry},\n"
+            "    },\n")
+        math(EXPR count "${count} + 1")
+    endforeach()
+
+    if(count EQUAL 0)
+        message(WARNING "No assets found in ${directory}")
+        set(table "const minet::EmbeddedAssets ${name} = { nullptr, 0 };\n")
+    else()
+        string(CONCAT table
+            "namespace\n{\n\n"
+            "constexpr minet::EmbeddedAsset ASSETS[] = {\n${entries}};\n\n"
+            "} // namespace\n\n"
+            "const minet::EmbeddedAssets ${name} = { ASSETS, ${count} };\n")
+    endif()
+
+    # Only touch the generated files if they change, or all is rebuilt.
+    file(WRITE "${work_dir}/${name}.h.in"
+        "// Generated by minet_embed_assets, do not edit.\n\n"
+        "#pragma once\n\n"
+        "#include <minet/components/EmbeddedAssets.h>\n\n"
+        "extern const minet::EmbeddedAssets ${name};\n")
+    file(WRITE "${work_dir}/${name}.cpp.in"
+        "// Generated by minet_embed_assets, do not edit.\n\n"
+        "#include \"${name}.h\"\n\n"
+        "${table}")
+    configure_file("${work_dir}/${name}.h.in" "${CMAKE_CURRENT_BINARY_DIR}/${name}.h" COPYONLY)
+    configure_file("${work_dir}/${name}.cpp.in" "${CMAKE_CURRENT_BINARY_DIR}/${name}.cpp" COPYONLY)
+
+    target_sources(${target} PRIVATE "${CMAKE_CURRENT_BINARY_DIR}/${name}.cpp")
+    target_include_directories(${target} PRIVATE "${CMAKE_CURRENT_BINARY_DIR}")
+endfunction()
+
+# Get the content type of a file by its extension.
+# Keep it in sync with StaticFileHandler::GetContentType.
+function(_minet_content_type file output)
+    get_filename_component(extension "${file}" LAST_EXT)
+    string(TOLOWER "${extension}" extension)
+    if(extension MATCHES "^\\.html?$")
+        set(type "text/html; charset=utf-8")
+    elseif(extension STREQUAL ".css")
+        set(type "text/css; charset=utf-8")
+    elseif(extension MATCHES "^\\.m?js$")
+        set(type "text/javascript; charset=utf-8")
+    elseif(extension MATCHES "^\\.(json|map)$")
+        set(type "application/json")
+    elseif(extension STREQUAL ".txt")
+        set(type "text/plain; charset=utf-8")
+    elseif(extension STREQUAL ".csv")
+        set(type "text/csv; charset=utf-8")
+    elseif(extension STREQUAL ".xml")
+        set(type "application/xml")
+    elseif(extension STREQUAL ".svg")
+        set(type "image/svg+xml")
+    elseif(extension STREQUAL ".png")
+        set(type "image/png")
+    elseif(extension MATCHES "^\\.jpe?g$")
+        set(type "image/jpeg")
+    elseif(extension STREQUAL ".gif")
+        set(type "image/gif")
+    elseif(extension STREQUAL ".webp")
+        set(type "image/webp")
+    elseif(extension STREQUAL ".ico")
+        set(type "image/x-icon")
+    elseif(extension MATCHES "^\\.woff2?$|^\\.ttf$")
+        string(SUBSTRING "${extension}" 1 -1 font)
+        set(type "font/${font}")
+    elseif(extension STREQUAL ".wasm")
+        set(type "application/wasm")
+    elseif(extension STREQUAL ".pdf")
+        set(type "application/pdf")
+    else()
+        set(type "application/octet-stream")
+    endif()
+    set(${output} "${type}" PARENT_SCOPE)
+endfunction()
+
+# Turn the bytes of a file into a C++ std::string_view, 32 bytes per line.
+function(_minet_file_literal file output)
+    file(READ "${file}" hex HEX)
+    string(LENGTH "${hex}" length)
+    math(EXPR size "${length} / 2")
+    string(REPEAT "[0-9a-f]" 64 line)
+    string(REGEX REPLACE "(${line})" "\\1\n" hex "${hex}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "\\\\x\\1" literal "${hex}")
+    string(REGEX REPLACE "\n$" "" literal "${literal}")
+    string(REPLACE "\n" "\"\n        \"" literal "${literal}")
+    set(${output} "std::string_view(\"${literal}\", ${size})" PARENT_SCOPE)
+endfunction()
@@ -11,6 +11,11 @@ static void ping(const TextRequest& request, TextResponse& response)
     response.Text().append("pong");
 }
 
+static void health(const TextRequest& request, TextResponse& response)
+{
+    response.Text().append("ok");
+}
+
 static void echo(const TextRequest& request, JsonResponse& response)
 {
     logger->Info("Echo request received:\n-----\n{}\n-----", request.Request().ToString());
@@ -37,7 +42,9 @@ int main(int argc, char* argv[])
     logger = builder->GetLogger("Demo");
 
     // Register handlers and run the server.
+    // Health checks return at once, so run them inline.
     builder->Get("/ping", RequestHandler::Bind(ping))
+        ->Get("/health", RequestHandler::Bind(health), true)
         ->Post("/echo", CustomHandler<TextRequest, JsonResponse>::Bind(echo))
         ->Build()
         ->Run();
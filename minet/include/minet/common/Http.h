@@ -23,6 +23,7 @@ constexpr int BAD_REQUEST           = 400;
 constexpr int NOT_FOUND             = 404;
 constexpr int METHOD_NOT_ALLOWED    = 405;
 constexpr int INTERNAL_SERVER_ERROR = 500;
+constexpr int SERVICE_UNAVAILABLE   = 503;
 // clang-format on
 } // namespace status
 
@@ -35,6 +36,10 @@ constexpr char COLON[]              = ": ";
 constexpr char NEW_LINE[]           = "\r\n";
 constexpr char CONTENT_TYPE[]       = "Content-Type";
 constexpr char CONTENT_LENGTH[]     = "Content-Length";
+constexpr char CONNECTION[]         = "Connection";
+constexpr char KEEP_ALIVE[]         = "keep-alive";
+constexpr char CLOSE[]              = "close";
+constexpr char RETRY_AFTER[]        = "Retry-After";
 // clang-format on
 } // namespace entities
 
@@ -64,6 +69,12 @@ const char* HttpMethodToString(HttpMethod method);
  */
 HttpMethod HttpMethodFromString(const std::string& method);
 
+/**
+ * @brief Whether the method is safe, i.e. has no side effect on the server.
+ * @note Safe requests on one connection can be handled concurrently.
+ */
+bool IsSafeMethod(HttpMethod method);
+
 enum class HttpVersion : uint8_t
 {
     HTTP_1_0,
@@ -0,0 +1,50 @@
+/**
+ * @author Tony S.
+ * @details Assets compiled into the program.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <string_view>
+
+MINET_BEGIN
+
+/**
+ * @brief A file compiled into the program, with its responses built ahead
+ * of time, so that serving it needs neither disk I/O nor formatting.
+ * @note Generated by minet_embed_assets in cmake/utils.cmake.
+ */
+struct EmbeddedAsset
+{
+    /**
+     * @brief The request path, e.g. "/assets/app.js".
+     */
+    std::string_view Path;
+
+    std::string_view Body;
+
+    /**
+     * @brief Status line and headers, ending with an empty line.
+     * @note The first one closes the connection, the second keeps it alive.
+     */
+    std::string_view Head[2];
+
+    /**
+     * @brief Compressed variant, empty if gzip does not make it smaller.
+     */
+    std::string_view GzipBody;
+    std::string_view GzipHead[2];
+};
+
+/**
+ * @brief All assets embedded from one directory.
+ */
+struct EmbeddedAssets
+{
+    const EmbeddedAsset* Assets;
+    size_t Count;
+};
+
+MINET_END
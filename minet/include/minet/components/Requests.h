@@ -50,6 +50,14 @@ public:
         return *_request;
     }
 
+    /**
+     * @brief Whether the client has gone away, so that long work can stop.
+     */
+    bool IsAborted() const
+    {
+        return _request->Aborted.IsCancellationRequested();
+    }
+
     virtual bool IsValid() const
     {
         return true;
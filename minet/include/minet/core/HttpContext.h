@@ -9,7 +9,9 @@
 
 #include "minet/utils/Parser.h"
 
+#include <atomic>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 MINET_BEGIN
@@ -29,6 +31,40 @@ struct HttpContext;
 
 using HeaderCollection = std::unordered_map<std::string, std::string>;
 
+/**
+ * @brief Tells a handler that the work it is doing is no longer wanted.
+ * @note Only set by the server, handlers may poll it in long loops.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken() = default;
+
+    // Copies take the state at the time, so that requests stay copyable.
+    CancellationToken(const CancellationToken& other) : _cancelled(other.IsCancellationRequested())
+    {
+    }
+
+    CancellationToken& operator=(const CancellationToken& other)
+    {
+        _cancelled.store(other.IsCancellationRequested(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    bool IsCancellationRequested() const
+    {
+        return _cancelled.load(std::memory_order_relaxed);
+    }
+
+    void Cancel()
+    {
+        _cancelled.store(true, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> _cancelled{ false };
+};
+
 struct HttpRequest
 {
     http::HttpMethod Method;
@@ -73,9 +109,47 @@ struct HttpRequest
     // Before parsing, request only have BodyStream valid.
     Ref<io::Stream> BodyStream;
 
+    /**
+     * @brief Cancelled once the client has gone away, like RequestAborted
+     * in ASP.NET Core.
+     * @note
+     * Only Mayhem server detects it for now, on a hang-up or an error of
+     * the socket, not on the end of input. Requests cancelled before they
+     * start are not handled at all.
+     */
+    CancellationToken Aborted;
+
+    /**
+     * @brief Whether the client wants to keep the connection open.
+     * @note HTTP/1.1 keeps it by default, unless "Connection: close".
+     */
+    bool IsKeepAlive() const;
+
     std::string ToString() const;
 };
 
+/**
+ * @brief An open file to send as the response body, instead of reading it
+ * into Body.
+ * @note
+ * It may be shared, e.g. kept open by a cache, and the file is closed with
+ * the last reference.
+ */
+struct FileBody
+{
+    FileBody(int fd, size_t length) : Fd(fd), Length(length)
+    {
+    }
+
+    ~FileBody();
+
+    FileBody(const FileBody&) = delete;
+    FileBody& operator=(const FileBody&) = delete;
+
+    int Fd;
+    size_t Length;
+};
+
 struct HttpResponse
 {
     /**
@@ -108,6 +182,19 @@ struct HttpResponse
      */
     std::string Body;
 
+    /**
+     * @brief File sent as the body if set, and Body is ignored then.
+     */
+    Ref<FileBody> File;
+
+    /**
+     * @brief The whole response built ahead of time, e.g. an embedded asset.
+     * If set, it is sent as is, and all above are ignored.
+     * @warning It is not copied, so it must outlive the response.
+     */
+    std::string_view RawHead;
+    std::string_view RawBody;
+
     /**
      * @brief Used to write response back to the client.
      */
@@ -120,6 +207,14 @@ struct HttpContext
 {
     HttpRequest Request;
     HttpResponse Response;
+
+    /**
+     * @brief Whether the connection is kept open after the response.
+     * @note
+     * It is decided by the server before dispatching. If set, destroying
+     * the context leaves the streams open for the next request.
+     */
+    bool KeepAlive = false;
 };
 
 /**
@@ -141,6 +236,7 @@ int CreateHttpContext(int fd, Ref<HttpContext>* context);
 
 /**
  * @brief Destroy a HTTP context after handling.
+ * @note The streams are not closed if the context is kept alive.
  * @param context The context to destroy.
  * @return 0 on success, otherwise non-zero.
  */
@@ -154,6 +250,13 @@ class AsyncHttpContextBuilder
 public:
     AsyncHttpContextBuilder(const network::AcceptData& data);
 
+    /**
+     * @brief Build HTTP context on an arbitrary stream.
+     * @param stream The stream to read request from and write response to.
+     * @param host The peer address, will be overwritten by the Host header.
+     */
+    AsyncHttpContextBuilder(const Ref<io::Stream>& stream, const std::string& host);
+
     /**
      * @brief Parse the HTTP context.
      * @note This may only be able to parse part of the request.
@@ -173,7 +276,38 @@ public:
         return _context;
     }
 
+    /**
+     * @brief Whether part of the next request has been received.
+     */
+    bool IsStarted() const
+    {
+        return _parser.IsStarted();
+    }
+
+    /**
+     * @brief Whether the headers of the next request have been received.
+     */
+    bool IsHeaderCompleted() const
+    {
+        return _parser.IsHeaderCompleted();
+    }
+
+    /**
+     * @brief Whether bytes of the next request are received but not parsed.
+     */
+    bool IsBuffered() const;
+
+    /**
+     * @brief Start over for the next request on the same connection.
+     * @note Bytes already buffered by the reader are kept.
+     */
+    void Reset();
+
+private:
+    void _InitContext(const Ref<io::Stream>& stream);
+
 private:
+    std::string _host;
     Ref<HttpContext> _context;
     Ref<io::StreamReader> _reader;
     http::AsyncHttpRequestParser _parser;
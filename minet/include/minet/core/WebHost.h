@@ -11,6 +11,8 @@
 
 #include <mioc/mioc.h>
 
+#include <vector>
+
 MINET_BEGIN
 
 class Logger;
@@ -27,6 +29,11 @@ class WebHost final
 public:
     /**
      * Main loop of the Web server.
+     * SIGINT stops the server at once, and SIGTERM drains it first.
+     * SIGUSR2 starts a new process taking over the listen sockets, and
+     * then drains this one.
+     * With more than one process configured, this process supervises
+     * worker processes instead, each running its own server.
      */
     void Run() const;
 
@@ -45,7 +52,35 @@ private:
         _logger = logger;
     }
 
-    void _OnInterrupted() const;
+    /**
+     * @brief Run the server in this process.
+     * @param restartable Whether SIGUSR2 restarts this process.
+     */
+    void _RunServer(int signalFd, int channel, bool restartable) const;
+
+    /**
+     * @brief Run worker processes sharing one listen socket, and restart
+     * them if they crash.
+     */
+    void _RunMaster(int signalFd, int channel, unsigned processes) const;
+
+    /**
+     * @brief Handle signals until the wake fd is written.
+     */
+    void _WatchSignals(int signalFd, int wakeFd, bool restartable) const;
+
+    /**
+     * @brief Adopt listen sockets of the previous process on hot restart.
+     * @return The channel to the previous process, or -1 if not restarted.
+     */
+    int _TakeOver() const;
+    void _FinishTakeOver(int channel, bool serving) const;
+
+    /**
+     * @brief Hand over listen sockets to a new instance of this program.
+     * @return Whether the new process is serving.
+     */
+    bool _HotRestart(const std::vector<int>& fds) const;
 
 private:
     Ref<Logger> _logger;
@@ -14,6 +14,7 @@
 MINET_BEGIN
 
 class IRequestHandler;
+struct EmbeddedAssets;
 class IRequestDispatcher;
 class Logger;
 class WebHost;
@@ -48,13 +49,39 @@ public:
      */
     Ref<WebHostBuilder> UseAppSettings(const std::string& path = "appsettings.json");
 
-    Ref<WebHostBuilder> Get(const std::string& path, const Ref<IRequestHandler>& handler);
-    Ref<WebHostBuilder> Post(const std::string& path, const Ref<IRequestHandler>& handler);
-    Ref<WebHostBuilder> Put(const std::string& path, const Ref<IRequestHandler>& handler);
-    Ref<WebHostBuilder> Delete(const std::string& path, const Ref<IRequestHandler>& handler);
+    /**
+     * @brief Register a handler for the path.
+     * @param inlineSafe Run the handler right on the thread that parsed the
+     * request, skipping the worker queue. Only for handlers that return at
+     * once and never block, e.g. health checks, as they hold up all other
+     * connections on that thread.
+     */
+    Ref<WebHostBuilder> Get(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe = false);
+    Ref<WebHostBuilder> Post(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe = false);
+    Ref<WebHostBuilder> Put(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe = false);
+    Ref<WebHostBuilder> Delete(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe = false);
 
     Ref<WebHostBuilder> Error(int statusCode, const Ref<IRequestHandler>& handler);
 
+    /**
+     * @brief Serve files under the root directory with GET, for all paths
+     * under the prefix.
+     * @param prefix e.g. "/assets", or "/" for all paths without a handler.
+     * @param root The directory, relative to the working directory.
+     * @param cacheSize Maximum number of files kept open.
+     * @note Content type is told by the extension of the file.
+     */
+    Ref<WebHostBuilder> UseStaticFiles(const std::string& prefix, const std::string& root, size_t cacheSize = 256);
+
+    /**
+     * @brief Serve assets compiled into the program with GET, see
+     * minet_embed_assets in cmake/utils.cmake.
+     * @note
+     * An "index.html" is also served for its directory. The assets are
+     * cheap enough to be inline-safe.
+     */
+    Ref<WebHostBuilder> UseEmbeddedAssets(const EmbeddedAssets& assets);
+
     /**
      * @brief Get the service container.
      * Just return the underlying container, so that there will be fewer
@@ -79,7 +106,7 @@ public:
 
 private:
     Ref<WebHostBuilder> _RegisterHandler(const std::string& path, http::HttpMethod method,
-                                         const Ref<IRequestHandler>& handler);
+                                         const Ref<IRequestHandler>& handler, bool inlineSafe);
     Ref<WebHostBuilder> _RegisterErrorHandler(int statusCode, const Ref<IRequestHandler>& handler);
 
     void _LoadSettings();
@@ -10,6 +10,7 @@
 #include <minet/core/WebHost.h>
 #include <minet/core/WebHostBuilder.h>
 
+#include <minet/components/EmbeddedAssets.h>
 #include <minet/components/Logger.h>
 #include <minet/components/RequestHandler.h>
 #include <minet/components/Requests.h>
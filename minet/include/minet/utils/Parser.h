@@ -50,6 +50,16 @@ public:
      */
     int Feed(char ch);
 
+    /**
+     * @brief Whether any character of the request has been fed.
+     */
+    bool IsStarted() const;
+
+    /**
+     * @brief Whether all headers are parsed, and only the body is left.
+     */
+    bool IsHeaderCompleted() const;
+
 private:
     enum class State
     {
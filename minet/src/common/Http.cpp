@@ -70,6 +70,12 @@ HttpMethod HttpMethodFromString(const std::string& method)
     return HttpMethod::INVALID;
 }
 
+bool IsSafeMethod(HttpMethod method)
+{
+    return (method == HttpMethod::GET) || (method == HttpMethod::HEAD) || (method == HttpMethod::OPTIONS) ||
+           (method == HttpMethod::TRACE);
+}
+
 const char* StatusCodeToDescription(int statusCode)
 {
     using namespace status;
@@ -87,6 +93,8 @@ const char* StatusCodeToDescription(int statusCode)
         return "Method Not Allowed";
     case INTERNAL_SERVER_ERROR:
         return "Internal Server Error";
+    case SERVICE_UNAVAILABLE:
+        return "Service Unavailable";
     default:
         return "Unknown";
     }
@@ -4,23 +4,32 @@
 #include "minet/components/Logger.h"
 #include "minet/core/HttpContext.h"
 
+#include "io/Stream.h"
 #include "threading/Task.h"
 #include "utils/Network.h"
 
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 MINET_BEGIN
 
-BasicServer::BasicServer(const Ref<ServerConfig>& config) : _config(config), _listenFd(0), _isRunning(false)
+BasicServer::BasicServer(const Ref<ServerConfig>& config)
+    : _config(config), _listenFd(0), _wakeFd(-1), _isRunning(false)
 {
 }
 
 BasicServer::~BasicServer()
 {
     _CloseSocket();
+    if (_wakeFd >= 0)
+    {
+        close(_wakeFd);
+    }
 }
 
 Ref<threading::Task> BasicServer::StartAsync()
 {
-    _logger->Info("Starting {} server on port {}", Name(), _config->Port);
+    _logger->Info("Starting {} server on {}", Name(), GetListenAddress(*_config));
 
     if (_isRunning)
     {
@@ -42,6 +51,23 @@ Ref<threading::Task> BasicServer::StartAsync()
         return threading::Task::Completed();
     }
 
+    if (_wakeFd < 0)
+    {
+        _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_wakeFd < 0)
+        {
+            _logger->Error("Failed to create eventfd");
+            _CloseSocket();
+            return threading::Task::Completed();
+        }
+    }
+    else
+    {
+        // Clear the wakeup left by the last Stop.
+        eventfd_t value;
+        eventfd_read(_wakeFd, &value);
+    }
+
     _isRunning = true;
     Ref<threading::Task> task = threading::Task::Create(BIND_FN(_Serve))->StartAsync();
     _logger->Info("Server started");
@@ -57,16 +83,46 @@ void BasicServer::Stop()
         _logger->Warn("Server is not running");
     }
     _isRunning = false;
+
+    // Wake up the accepting thread so that it can see the flag.
+    if (_wakeFd >= 0)
+    {
+        eventfd_write(_wakeFd, 1);
+    }
 }
 
 void BasicServer::_Serve()
 {
+    // Leave the rest to the next round, so that Stop is not delayed too much.
+    static constexpr int MAX_ACCEPTS = 64;
+
     network::AcceptData data;
     Ref<HttpContext> context;
+    // Closed sockets may wait for their zero copy bodies, see SocketStream.
+    int timeout = (_config->Socket.ZeroCopy > 0) ? io::SocketStream::LINGER_INTERVAL : -1;
+
+    _PinReactor(*_config);
     while (_isRunning)
     {
-        while (AcceptSocket(_listenFd, &data) && _isRunning)
+        io::SocketStream::ReapLingering();
+
+        // Sleep until there is a connection, instead of spinning on accept.
+        int r = network::WaitSocket(_listenFd, _wakeFd, timeout);
+        if (r < 0)
+        {
+            _logger->Error("Failed to wait for new connections");
+            _logger->Error("Unable to serve, shutting down server");
+            Stop(); // call stop to shut down gracefully
+        }
+        if (r <= 0)
+        {
+            continue;
+        }
+
+        // Requests are parsed synchronously, so the socket stays blocking.
+        for (int i = 0; (i < MAX_ACCEPTS) && _isRunning && AcceptSocket(_listenFd, &data, SOCK_CLOEXEC); i++)
         {
+            network::TuneSocket(data.SocketFd, _config->Socket);
             int r = CreateHttpContext(data, &context);
             if (r == 0)
             {
@@ -90,11 +146,12 @@ void BasicServer::_Serve()
 void BasicServer::_DecorateContext(const Ref<HttpContext>& context) const
 {
     context->Response.Headers["Server"] = Name();
+    EnableZeroCopy(*_config, context);
 }
 
 void BasicServer::_OpenSocket()
 {
-    _listenFd = network::OpenSocket(_config->Port);
+    _listenFd = OpenListenSocket(*_config);
     if (_listenFd < 0)
     {
         _logger->Error("Failed to open socket: {}", _listenFd);
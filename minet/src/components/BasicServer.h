@@ -34,6 +34,11 @@ public:
         return Identifier();
     }
 
+    std::vector<int> GetListenSockets() const override
+    {
+        return _listenFd ? std::vector<int>{ _listenFd } : std::vector<int>{};
+    }
+
 private:
     void _Serve();
 
@@ -46,6 +51,12 @@ protected:
     Ref<ServerConfig> _config;
 
     int _listenFd;
+
+    /**
+     * @brief Stop wakes up the accepting thread with this eventfd.
+     */
+    int _wakeFd;
+
     bool _isRunning;
 };
 
@@ -0,0 +1,117 @@
+#include "components/EmbeddedAssetHandler.h"
+
+#include "minet/common/Http.h"
+#include "minet/core/HttpContext.h"
+
+#include <cstdlib>
+#include <string_view>
+#include <strings.h>
+
+MINET_BEGIN
+
+/**
+ * @brief Header names are kept as sent, but are case-insensitive.
+ */
+static const std::string* _FindHeader(const HeaderCollection& headers, const char* name)
+{
+    auto it = headers.find(name);
+    if (it != headers.end())
+    {
+        return &it->second;
+    }
+    for (const auto& [key, value] : headers)
+    {
+        if (strcasecmp(key.c_str(), name) == 0)
+        {
+            return &value;
+        }
+    }
+    return nullptr;
+}
+
+static std::string_view _Trim(std::string_view text)
+{
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string_view::npos)
+    {
+        return {};
+    }
+    return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+}
+
+static bool _EqualsIgnoreCase(std::string_view a, std::string_view b)
+{
+    return (a.size() == b.size()) && (strncasecmp(a.data(), b.data(), a.size()) == 0);
+}
+
+/**
+ * @brief Whether the client takes gzip, e.g. "gzip, deflate;q=0.5".
+ * @note
+ * A coding with q=0 is refused. "*" covers gzip unless gzip is listed
+ * on its own.
+ * @ref RFC 9110, 12.5.3
+ */
+static bool _AcceptsGzip(const HttpRequest& request)
+{
+    const std::string* header = _FindHeader(request.Headers, "Accept-Encoding");
+    if (!header)
+    {
+        return false;
+    }
+
+    int gzip = -1; // -1 if not listed, otherwise whether it is accepted
+    int any = -1;
+    std::string_view list = *header;
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view element = list.substr(0, comma);
+        list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+
+        size_t semicolon = element.find(';');
+        std::string_view coding = _Trim(element.substr(0, semicolon));
+        bool accepted = true;
+        while (semicolon != std::string_view::npos)
+        {
+            element = element.substr(semicolon + 1);
+            semicolon = element.find(';');
+            std::string_view param = _Trim(element.substr(0, semicolon));
+            if ((param.size() > 2) && ((param[0] == 'q') || (param[0] == 'Q')) && (param[1] == '='))
+            {
+                accepted = std::strtod(std::string(param.substr(2)).c_str(), nullptr) > 0;
+            }
+        }
+
+        if (_EqualsIgnoreCase(coding, "gzip") || _EqualsIgnoreCase(coding, "x-gzip"))
+        {
+            gzip = accepted ? 1 : 0;
+        }
+        else if (coding == "*")
+        {
+            any = accepted ? 1 : 0;
+        }
+    }
+
+    return (gzip >= 0) ? (gzip == 1) : (any == 1);
+}
+
+int EmbeddedAssetHandler::Handle(const Ref<HttpContext>& context)
+{
+    HttpResponse& response = context->Response;
+    int keepAlive = context->KeepAlive ? 1 : 0;
+    if (!_asset.GzipBody.empty() && _AcceptsGzip(context->Request))
+    {
+        response.RawHead = _asset.GzipHead[keepAlive];
+        response.RawBody = _asset.GzipBody;
+    }
+    else
+    {
+        response.RawHead = _asset.Head[keepAlive];
+        response.RawBody = _asset.Body;
+    }
+    response.StatusCode = http::status::OK;
+
+    return http::status::OK;
+}
+
+MINET_END
@@ -0,0 +1,31 @@
+/**
+ * @author Tony S.
+ * @details Handler serving an embedded asset.
+ */
+
+#pragma once
+
+#include "minet/components/EmbeddedAssets.h"
+#include "minet/core/IRequestHandler.h"
+
+MINET_BEGIN
+
+/**
+ * @brief Serve an asset compiled into the program, with the response built
+ * ahead of time.
+ * @note The gzip variant is sent if there is one and the client accepts it.
+ */
+class EmbeddedAssetHandler final : public IRequestHandler
+{
+public:
+    explicit EmbeddedAssetHandler(const EmbeddedAsset& asset) : _asset(asset)
+    {
+    }
+
+    int Handle(const Ref<HttpContext>& context) override;
+
+private:
+    const EmbeddedAsset& _asset;
+};
+
+MINET_END
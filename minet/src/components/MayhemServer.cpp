@@ -4,28 +4,65 @@
 #include "minet/components/Logger.h"
 #include "minet/core/HttpContext.h"
 
+#include "io/Stream.h"
+#include "io/TlsStream.h"
 #include "threading/Task.h"
 #include "utils/Epoll.h"
+#include "utils/Native.h"
 #include "utils/Network.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+
 MINET_BEGIN
 
-const int MayhemServer::MAX_FD = 1024;
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Deadlines are checked at this resolution, in milliseconds.
+static constexpr unsigned TIMER_TICK = 100;
+static constexpr size_t TIMER_SLOTS = 512;
+
+// How often to check whether saturated workers catch up, in milliseconds.
+static constexpr int ADMISSION_INTERVAL = 10;
 
 MayhemServer::MayhemServer(const Ref<ServerConfig>& config)
-    : _config(config), _threadPool(config->Threads, config->Capacity),
-      _handles(new Ref<AsyncHttpContextBuilder>[MAX_FD]), _listenFd(0), _epollFd(0), _isRunning(false)
+    : _config(config), _threadPool(config->Threads, config->Capacity, config->SpinTime, GetWorkerCpus(*config),
+                                     config->Affinity, config->QueueTarget),
+      _connections(native::RaiseFileLimit()), _timers(TIMER_TICK, TIMER_SLOTS, _Now()), _completedInline(false),
+      _overloadKeepAlive(MakeOverloadResponse(*config, Identifier(), true)),
+      _overloadClose(MakeOverloadResponse(*config, Identifier(), false)), _saturated(false), _accepting(true),
+      _wakeFd(-1), _stopFd(-1), _draining(false), _drainDeadline(0), _listenFd(0), _epollFd(0), _isRunning(false)
 {
+    if (_config->QueueTarget > 0)
+    {
+        _codel = CreateRef<CoDel>(_config->QueueTarget, _config->QueueInterval);
+    }
 }
 
 MayhemServer::~MayhemServer()
 {
-    delete[] _handles;
+    // Closed last, as workers may still report to the reactor on shutdown.
+    if (_wakeFd >= 0)
+    {
+        close(_wakeFd);
+    }
+    if (_stopFd >= 0)
+    {
+        close(_stopFd);
+    }
 }
 
 Ref<threading::Task> MayhemServer::StartAsync()
 {
-    _logger->Info("Starting {} server on port {}", Name(), _config->Port);
+    _logger->Info("Starting {} server on {}", Name(), GetListenAddress(*_config));
 
     if (_isRunning)
     {
@@ -39,6 +76,17 @@ Ref<threading::Task> MayhemServer::StartAsync()
         return threading::Task::Completed();
     }
 
+    if (_config->Tls.IsEnabled() && !_tls)
+    {
+        std::string error;
+        _tls = io::TlsContext::Create(_config->Tls, &error);
+        if (!_tls)
+        {
+            _logger->Error("{}", error);
+            return threading::Task::Completed();
+        }
+    }
+
     _OpenSocket();
     if (!_listenFd)
     {
@@ -55,7 +103,7 @@ Ref<threading::Task> MayhemServer::StartAsync()
     }
 
     // Note that _listenFd cannot use EPOLL_ET mode.
-    if (epoll::Monitor(_epollFd, _listenFd, EPOLLIN) != 0)
+    if ((_config->Acceptors == 0) && (epoll::Monitor(_epollFd, _listenFd, EPOLLIN) != 0))
     {
         _logger->Error("Failed to monitor server socket");
         _CloseSocket();
@@ -63,7 +111,25 @@ Ref<threading::Task> MayhemServer::StartAsync()
         return threading::Task::Completed();
     }
 
+    _stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((_stopFd < 0) || (_wakeFd < 0) || (epoll::Monitor(_epollFd, _wakeFd, EPOLLIN) != 0))
+    {
+        _logger->Error("Failed to create eventfd");
+        _CloseSocket();
+        _CloseEpoll();
+        return threading::Task::Completed();
+    }
+
+    _logger->Debug("Accept up to {} connections", _connections.Limit());
+
     _isRunning = true;
+    _draining = false;
+    _drainDeadline = 0;
+    for (unsigned i = 0; i < _config->Acceptors; i++)
+    {
+        _acceptors.push_back(threading::Task::Create(BIND_FN(_RunAcceptor))->StartAsync());
+    }
     Ref<threading::Task> task = threading::Task::Create(BIND_FN(_Serve))->StartAsync();
     _logger->Info("Server started");
 
@@ -78,19 +144,62 @@ void MayhemServer::Stop()
         _logger->Warn("Server is not running");
     }
     _isRunning = false;
+
+    // Wake up the reactor and acceptors so that they can see the flag.
+    if (_wakeFd >= 0)
+    {
+        eventfd_write(_wakeFd, 1);
+    }
+    if (_stopFd >= 0)
+    {
+        eventfd_write(_stopFd, 1);
+    }
+}
+
+void MayhemServer::Drain()
+{
+    if (_config->DrainTimeout == 0)
+    {
+        Stop();
+        return;
+    }
+
+    _logger->Info("Draining {} server", Name());
+    if (!_isRunning)
+    {
+        _logger->Warn("Server is not running");
+        return;
+    }
+    _draining = true;
+
+    // Acceptors stop on the flag, and the reactor does the rest.
+    eventfd_write(_wakeFd, 1);
+    eventfd_write(_stopFd, 1);
 }
 
 void MayhemServer::_Serve()
 {
     static constexpr int MAX_EVENTS = 64;
 
-    network::AcceptData data;
-    Ref<HttpContext> context;
     epoll_event events[MAX_EVENTS];
 
+    _PinReactor(*_config);
     while (_isRunning)
     {
-        int count = epoll::Wait(_epollFd, events, MAX_EVENTS);
+        // Wake up for the next tick of the timers, Stop will wake us up anyway.
+        int64_t now = _Now();
+        int timeout = _timers.NextTimeout(now);
+        if (_drainDeadline != 0)
+        {
+            int left = static_cast<int>(std::max<int64_t>(_drainDeadline - now, 0));
+            timeout = (timeout < 0) ? left : std::min(timeout, left);
+        }
+        if (_saturated.load(std::memory_order_relaxed))
+        {
+            timeout = (timeout < 0) ? ADMISSION_INTERVAL : std::min(timeout, ADMISSION_INTERVAL);
+        }
+
+        int count = epoll::BusyWait(_epollFd, events, MAX_EVENTS, timeout, _config->SpinTime);
         if (count == -1)
         {
             _logger->Error("Failed to wait for epoll events");
@@ -102,79 +211,764 @@ void MayhemServer::_Serve()
         {
             if (events[i].data.fd == _listenFd)
             {
-                // There may be multiple incoming connections.
-                while (AcceptSocket(_listenFd, &data))
-                {
-                    if (data.SocketFd >= MAX_FD)
-                    {
-                        _logger->Error("Unable to handle more connections");
-                        network::CloseSocket(data.SocketFd);
-                        break;
-                    }
-
-                    if (!_MonitorFd(data.SocketFd))
-                    {
-                        _logger->Error("Failed to monitor new connection");
-                        network::CloseSocket(data.SocketFd);
-                    }
-
-                    _handles[data.SocketFd] = CreateRef<AsyncHttpContextBuilder>(data);
-                }
+                _Accept();
+            }
+            else if (events[i].data.fd == _wakeFd)
+            {
+                _OnWake();
             }
-            else if (events[i].events & EPOLLIN)
+            else
             {
                 int fd = events[i].data.fd;
-
-                auto& handle = _handles[fd];
-                MINET_ASSERT(handle);
-
-                int r = handle->Parse();
-                if (r == 1)
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) && _connections.Get(fd))
                 {
-                    _UnmonitorFd(fd); // prevent from triggering again
-
-                    const Ref<HttpContext>& context = handle->GetContext();
-                    _DecorateContext(context);
-                    if (!_threadPool.Submit([this, context] { _onConnectionCallback(context); }))
-                    {
-                        _logger->Warn("Server overwhelmed, new connection refused");
-                        network::CloseSocket(fd);
-                        _handles[fd].reset();
-                    }
+                    _AbortConnection(_connections.Get(fd));
                 }
-                else if (r < 0)
+                else if ((events[i].events & EPOLLRDHUP) && _connections.Get(fd))
                 {
-                    // error occurred
-                    _logger->Error("Failed to create HTTP context: {}", r);
-                    network::CloseSocket(fd);
-                    _handles[fd].reset();
-                    continue;
+                    // The client may only have shut down its sending side,
+                    // and still wait for the answers. Idle connections find
+                    // it out by reading.
+                    _connections.Get(fd)->Close = true;
+                }
+                if ((events[i].events & EPOLLOUT) && _connections.Get(fd))
+                {
+                    _WriteConnection(_connections.Get(fd));
+                }
+                if ((events[i].events & EPOLLIN) && _connections.Get(fd))
+                {
+                    _ReadConnection(fd);
                 }
-                // else, continue parsing
+            }
+        }
+
+        if (_completedInline)
+        {
+            _completedInline = false;
+            _FlushCompleted();
+        }
+
+        _UpdateAdmission();
+        _ExpireConnections();
+
+        if (_draining && (_drainDeadline == 0))
+        {
+            _StartDrain();
+        }
+        if (_drainDeadline != 0)
+        {
+            if (_connections.Size() == 0)
+            {
+                _logger->Info("All connections drained");
+                break;
+            }
+            if (_Now() >= _drainDeadline)
+            {
+                _logger->Warn("Drain timed out with {} connections left", _connections.Size());
+                break;
             }
         }
     }
+    _isRunning = false;
+
+    for (const auto& acceptor : _acceptors)
+    {
+        acceptor->Await();
+    }
+    _acceptors.clear();
+    for (const auto& data : _accepted)
+    {
+        network::CloseSocket(data.SocketFd);
+    }
+    _accepted.clear();
 
     _logger->Debug("Closing server socket");
     _CloseSocket();
 
+    _logger->Debug("Closing {} connections", _connections.Size());
+    _CloseConnections(false);
+
     _logger->Debug("Closing epoll");
     _CloseEpoll();
 
     _logger->Info("{} server shut down", Name());
 }
 
-void MayhemServer::_HandleConnection(int fd)
+void MayhemServer::_StartDrain()
 {
-    Ref<HttpContext> context;
-    if (int r = CreateHttpContext(fd, &context); r == 0)
+    _drainDeadline = _Now() + _config->DrainTimeout;
+
+    // Acceptors have been woken up by Drain.
+    for (const auto& acceptor : _acceptors)
     {
-        _DecorateContext(context);
-        _onConnectionCallback(context);
+        acceptor->Await();
+    }
+    _acceptors.clear();
+
+    // Pick up the last accepted connections, so that they are handled as
+    // all others. Closing the socket also removes it from epoll.
+    _OnWake();
+    _CloseSocket();
+
+    // Requests may have arrived without being read yet, and closing such
+    // connections would reset them. Kept-alive connections are closed once
+    // their batches are answered.
+    for (int fd = 0; fd < _connections.End(); fd++)
+    {
+        if (_connections.Get(fd) && !_connections.Get(fd)->Busy)
+        {
+            _ReadConnection(fd);
+        }
+    }
+    _CloseConnections(true);
+    _logger->Debug("Draining {} connections", _connections.Size());
+}
+
+void MayhemServer::_Accept()
+{
+    // Leave the rest of the backlog to the next round, so that a storm of
+    // new connections cannot starve existing ones.
+    static constexpr int MAX_ACCEPTS = 64;
+
+    network::AcceptData data;
+    for (int i = 0; i < MAX_ACCEPTS; i++)
+    {
+        // Parsing drains the socket, so it must not block.
+        if (!network::AcceptSocket(_listenFd, &data, SOCK_NONBLOCK | SOCK_CLOEXEC))
+        {
+            break;
+        }
+        _AddConnection(data);
+    }
+}
+
+void MayhemServer::_RunAcceptor()
+{
+    static constexpr int MAX_ACCEPTS = 64;
+
+    int epollFd = epoll::Create();
+    if (epollFd == -1)
+    {
+        _logger->Error("Failed to create epoll for acceptor");
+        return;
+    }
+
+    // Only one of the acceptors is woken up for each new connection.
+    if ((epoll::Monitor(epollFd, _listenFd, EPOLLIN | EPOLLEXCLUSIVE) != 0) ||
+        (epoll::Monitor(epollFd, _stopFd, EPOLLIN) != 0))
+    {
+        _logger->Error("Failed to monitor server socket for acceptor");
+        epoll::Close(epollFd);
+        return;
+    }
+
+    std::vector<network::AcceptData> accepted;
+    epoll_event event;
+    while (_isRunning && !_draining)
+    {
+        // Leave new connections in the backlog while workers are saturated.
+        if (_saturated.load(std::memory_order_relaxed))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ADMISSION_INTERVAL));
+            continue;
+        }
+
+        if (epoll::Wait(epollFd, &event, 1, -1) <= 0)
+        {
+            continue; // interrupted
+        }
+
+        network::AcceptData data;
+        while ((accepted.size() < MAX_ACCEPTS) &&
+               network::AcceptSocket(_listenFd, &data, SOCK_NONBLOCK | SOCK_CLOEXEC))
+        {
+            accepted.push_back(data);
+        }
+        if (accepted.empty())
+        {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_acceptedMutex);
+            _accepted.insert(_accepted.end(), accepted.begin(), accepted.end());
+        }
+        eventfd_write(_wakeFd, 1);
+        accepted.clear();
+    }
+
+    epoll::Close(epollFd);
+}
+
+void MayhemServer::_AddConnection(const network::AcceptData& data)
+{
+    Ref<Connection> connection = CreateRef<Connection>();
+    connection->Fd = data.SocketFd;
+    connection->Generation = _connections.Insert(data.SocketFd, connection);
+    if (connection->Generation == 0)
+    {
+        _logger->Error("Unable to handle more connections");
+        network::CloseSocket(data.SocketFd);
+        return;
+    }
+    if (_tls)
+    {
+        connection->Stream = CreateRef<io::TlsStream>(data.SocketFd, _tls);
     }
     else
     {
-        _logger->Error("Failed to create HTTP context, error code: {}", r);
+        connection->Stream = CreateRef<io::SocketStream>(data.SocketFd);
+    }
+    connection->Builder = CreateRef<AsyncHttpContextBuilder>(
+        connection->Stream,
+        network::AddressToHost(reinterpret_cast<const sockaddr*>(&data.Address), data.AddressLength));
+    network::TuneSocket(data.SocketFd, _config->Socket);
+
+    // The first request must arrive in time as well.
+    connection->RequestStarted = _Now();
+    _UpdateDeadline(connection);
+
+    if (!_MonitorFd(data.SocketFd))
+    {
+        _logger->Error("Failed to monitor new connection");
+        _CloseConnection(data.SocketFd);
+    }
+}
+
+void MayhemServer::_ReadConnection(int fd)
+{
+    const Ref<Connection>& connection = _connections.Get(fd);
+    MINET_ASSERT(connection);
+
+    // Pipelined requests may arrive in one read, so parse until the socket
+    // is drained instead of stopping at the first request.
+    int r;
+    while ((r = connection->Builder->Parse()) == 1)
+    {
+        Ref<HttpContext> context = connection->Builder->GetContext();
+        connection->Builder->Reset();
+        connection->RequestStarted = 0;
+        connection->BodyStarted = 0;
+
+        connection->Requests++;
+        context->KeepAlive = _config->KeepAlive && context->Request.IsKeepAlive() && (_drainDeadline == 0) &&
+                             ((_config->MaxRequests == 0) || (connection->Requests < _config->MaxRequests));
+
+        // Responses are collected in memory, and written in request order.
+        Ref<io::Stream> stream = CreateRef<io::MemoryStream>();
+        context->Request.BodyStream = stream;
+        context->Response.BodyStream = stream;
+        _DecorateContext(context);
+
+        connection->Batch.push_back(context);
+        if (!context->KeepAlive)
+        {
+            // Requests after this one will never be answered.
+            connection->Close = true;
+            break;
+        }
+    }
+
+    if (r < 0)
+    {
+        if (r == io::StreamStatus::EndOfFile)
+        {
+            // Peer closed, which is normal between kept-alive requests.
+            _logger->Debug("Connection closed by peer");
+        }
+        else
+        {
+            // error occurred
+            _logger->Error("Failed to create HTTP context: {}", r);
+        }
+        if (connection->Batch.empty())
+        {
+            _CloseConnection(fd);
+            return;
+        }
+        // Still answer requests received before.
+        connection->Close = true;
+    }
+
+    if (connection->Batch.empty())
+    {
+        // continue parsing
+        _UpdateDeadline(connection);
+        return;
+    }
+
+    // Mute the connection until the whole batch is answered, but still
+    // learn if the client goes away meanwhile.
+    _WatchFd(fd, EPOLLRDHUP | EPOLLET);
+    _SetDeadline(connection, 0);
+    connection->Busy = true;
+
+    // No worker is running on this connection now, so no lock is needed.
+    std::vector<size_t> ready;
+    connection->Pipeline = http::HttpPipeline();
+    for (const auto& context : connection->Batch)
+    {
+        connection->Pipeline.Push(http::IsSafeMethod(context->Request.Method));
+    }
+    for (size_t seq; connection->Pipeline.Poll(&seq);)
+    {
+        ready.push_back(seq);
+    }
+
+    // Copy it, as the slot may be reused while dispatching.
+    Ref<Connection> handle = connection;
+    for (size_t seq : ready)
+    {
+        _Dispatch(handle, seq, true);
+    }
+}
+
+void MayhemServer::_Dispatch(const Ref<Connection>& connection, size_t seq, bool onReactor)
+{
+    // Nobody is waiting for it, so do not bother the workers.
+    if (connection->Batch[seq]->Request.Aborted.IsCancellationRequested())
+    {
+        _CompleteRequest(connection, seq, std::string(), onReactor);
+        return;
+    }
+
+    // Cheap handlers are not worth the queue and the wake-up of a worker.
+    if (_isInlineCallback && _isInlineCallback(connection->Batch[seq]))
+    {
+        _HandleRequest(connection, seq, onReactor);
+        return;
+    }
+
+    // Keep requests of the connection on one worker, where its batch and
+    // contexts are still in cache.
+    bool submitted = _threadPool.Submit(connection->Fd, [this, connection, seq, queued = _Now()] {
+        // Clients of requests queued for too long may have given up, so
+        // answer them at once to catch up with fresh ones.
+        int64_t now = _Now();
+        if (_codel && _codel->ShouldDrop(now - queued, now))
+        {
+            _RejectRequest(connection, seq, false);
+        }
+        else
+        {
+            _HandleRequest(connection, seq, false);
+        }
+    });
+    if (submitted)
+    {
+        return;
+    }
+
+    // All workers are full, so stop taking more work until they catch up.
+    // Park it before raising the flag, see _UpdateAdmission.
+    if (_config->ParkOverloaded)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_parkedMutex);
+            _parked.emplace_back(connection, seq);
+        }
+        _saturated.store(true, std::memory_order_relaxed);
+        if (!onReactor)
+        {
+            eventfd_write(_wakeFd, 1);
+        }
+        return;
+    }
+
+    _saturated.store(true, std::memory_order_relaxed);
+    _logger->Debug("Server overwhelmed, request rejected");
+    _RejectRequest(connection, seq, onReactor);
+}
+
+void MayhemServer::_HandleRequest(const Ref<Connection>& connection, size_t seq, bool onReactor)
+{
+    // The batch is not modified until all its requests are finished.
+    const Ref<HttpContext>& context = connection->Batch[seq];
+
+    // The client may have gone away while it was queued.
+    if (context->Request.Aborted.IsCancellationRequested())
+    {
+        _CompleteRequest(connection, seq, std::string(), onReactor);
+        return;
+    }
+    _onConnectionCallback(context);
+
+    auto stream = std::static_pointer_cast<io::MemoryStream>(context->Response.BodyStream);
+    _CompleteRequest(connection, seq, std::move(stream->Output()), onReactor);
+}
+
+void MayhemServer::_RejectRequest(const Ref<Connection>& connection, size_t seq, bool onReactor)
+{
+    const std::string& response = connection->Batch[seq]->KeepAlive ? _overloadKeepAlive : _overloadClose;
+    _CompleteRequest(connection, seq, response, onReactor);
+}
+
+void MayhemServer::_CompleteRequest(const Ref<Connection>& connection, size_t seq, std::string response,
+                                    bool onReactor)
+{
+    std::vector<size_t> ready;
+    bool notify;
+    {
+        std::lock_guard<std::mutex> lock(connection->Mutex);
+
+        connection->Pipeline.Complete(seq, std::move(response));
+
+        // Responses that are ready are coalesced for one write.
+        std::string output = connection->Pipeline.Take();
+        bool taken = !output.empty();
+        if (connection->Output.empty())
+        {
+            connection->Output.swap(output);
+        }
+        else
+        {
+            connection->Output.append(output);
+        }
+
+        for (size_t next; connection->Pipeline.Poll(&next);)
+        {
+            ready.push_back(next);
+        }
+        notify = taken || connection->Pipeline.IsDone();
+    }
+
+    for (size_t next : ready)
+    {
+        _Dispatch(connection, next, onReactor);
+    }
+
+    if (notify)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_completedMutex);
+            _completed.push_back(connection);
+        }
+        // The reactor may be in the middle of this connection, so it writes
+        // after the current round instead of right here.
+        if (onReactor)
+        {
+            _completedInline = true;
+        }
+        else
+        {
+            eventfd_write(_wakeFd, 1);
+        }
+    }
+}
+
+void MayhemServer::_AbortConnection(const Ref<Connection>& connection)
+{
+    // Idle connections find it out by reading.
+    if (!connection->Busy || connection->Close)
+    {
+        return;
+    }
+
+    _logger->Debug("Client gone, cancel {} requests", connection->Batch.size());
+    connection->Close = true;
+    for (const auto& context : connection->Batch)
+    {
+        context->Request.Aborted.Cancel();
+    }
+}
+
+void MayhemServer::_UpdateAdmission()
+{
+    if (!_saturated.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Acceptor threads check the flag themselves.
+    if (_accepting)
+    {
+        if ((_listenFd != 0) && (_config->Acceptors == 0))
+        {
+            epoll::Unmonitor(_epollFd, _listenFd);
+        }
+        _accepting = false;
+        _logger->Warn("Workers saturated, stop accepting new connections");
+    }
+
+    // Wait until workers are half way through their backlog.
+    if (_threadPool.Pending() * 2 > _threadPool.Capacity())
+    {
+        return;
+    }
+
+    // Requests parked earlier go first, and may saturate workers again.
+    // Clear the flag before taking them, so that a request parked right
+    // after raises it again instead of being left behind.
+    _saturated.store(false, std::memory_order_relaxed);
+    std::vector<std::pair<Ref<Connection>, size_t>> parked;
+    {
+        std::lock_guard<std::mutex> lock(_parkedMutex);
+        parked.swap(_parked);
+    }
+    for (const auto& [connection, seq] : parked)
+    {
+        _Dispatch(connection, seq, true);
+    }
+    if (_completedInline)
+    {
+        _completedInline = false;
+        _FlushCompleted();
+    }
+    if (_saturated.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    if ((_listenFd != 0) && (_config->Acceptors == 0) && (epoll::Monitor(_epollFd, _listenFd, EPOLLIN) != 0))
+    {
+        _logger->Error("Failed to monitor server socket again");
+    }
+    _accepting = true;
+    _logger->Info("Workers caught up, accepting new connections");
+}
+
+void MayhemServer::_OnWake()
+{
+    eventfd_t value;
+    eventfd_read(_wakeFd, &value);
+
+    std::vector<network::AcceptData> accepted;
+    {
+        std::lock_guard<std::mutex> lock(_acceptedMutex);
+        accepted.swap(_accepted);
+    }
+    for (const auto& data : accepted)
+    {
+        _AddConnection(data);
+    }
+
+    _FlushCompleted();
+}
+
+void MayhemServer::_FlushCompleted()
+{
+    std::vector<Ref<Connection>> completed;
+    {
+        std::lock_guard<std::mutex> lock(_completedMutex);
+        completed.swap(_completed);
+    }
+
+    for (const auto& connection : completed)
+    {
+        // Already waiting for EPOLLOUT, new responses will go with the rest.
+        if (!connection->Writing)
+        {
+            _WriteConnection(connection);
+        }
+    }
+}
+
+void MayhemServer::_WriteConnection(const Ref<Connection>& connection)
+{
+    // Workers may report a connection closed since then, whose fd may
+    // even belong to a new connection now.
+    if (!_connections.IsCurrent(connection->Fd, connection->Generation))
+    {
+        return;
+    }
+
+    bool done;
+    {
+        std::lock_guard<std::mutex> lock(connection->Mutex);
+        // Take it as is if nothing is left, large bodies are not copied then.
+        if (connection->Outbox.empty())
+        {
+            connection->Outbox.swap(connection->Output);
+        }
+        else
+        {
+            connection->Outbox.append(connection->Output);
+        }
+        connection->Output.clear();
+        done = connection->Pipeline.IsDone();
+    }
+
+    int fd = connection->Fd;
+    while (connection->Written < connection->Outbox.size())
+    {
+        // TLS takes the rest as is on retry, even if the Outbox has moved.
+        ssize_t written = connection->Stream->Write(connection->Outbox.data() + connection->Written,
+                                                    connection->Outbox.size() - connection->Written);
+        if (written < 0)
+        {
+            if (written != io::StreamStatus::Again)
+            {
+                _logger->Error("Failed to send response");
+                _CloseConnection(fd);
+                return;
+            }
+
+            // A client that stops reading is subject to the idle timeout.
+            _SetDeadline(connection, (_config->IdleTimeout > 0) ? _Now() + _config->IdleTimeout : 0);
+            if (!connection->Writing)
+            {
+                connection->Writing = _WatchFd(fd, EPOLLOUT | EPOLLRDHUP | EPOLLET);
+                if (!connection->Writing)
+                {
+                    _CloseConnection(fd);
+                }
+            }
+            return;
+        }
+        connection->Written += written;
+    }
+
+    connection->Outbox.clear();
+    connection->Written = 0;
+    if (connection->Writing)
+    {
+        connection->Writing = false;
+        _WatchFd(fd, EPOLLRDHUP | EPOLLET);
+    }
+    _SetDeadline(connection, 0);
+
+    if (done && connection->Busy)
+    {
+        if (connection->Close)
+        {
+            _CloseConnection(fd);
+        }
+        else
+        {
+            _KeepAlive(connection);
+        }
+    }
+}
+
+void MayhemServer::_KeepAlive(const Ref<Connection>& connection)
+{
+    connection->Busy = false;
+    connection->Batch.clear();
+
+    // Part of the next request may have arrived with the batch.
+    _UpdateDeadline(connection);
+
+    // Re-arming reports data that arrived during the batch.
+    if (!_WatchFd(connection->Fd, EPOLLIN | EPOLLET))
+    {
+        _logger->Error("Failed to monitor kept-alive connection");
+        _CloseConnection(connection->Fd);
+        return;
+    }
+
+    if (_drainDeadline != 0)
+    {
+        // Answer what has arrived, and close the connection if nothing has.
+        Ref<Connection> handle = connection;
+        _ReadConnection(handle->Fd);
+        if (_connections.IsCurrent(handle->Fd, handle->Generation) && !handle->Busy &&
+            !handle->Builder->IsStarted())
+        {
+            _CloseConnection(handle->Fd);
+        }
+    }
+}
+
+void MayhemServer::_UpdateDeadline(const Ref<Connection>& connection)
+{
+    int64_t now = _Now();
+    int64_t deadline = 0;
+
+    if (connection->Builder->IsHeaderCompleted())
+    {
+        if (connection->BodyStarted == 0)
+        {
+            connection->BodyStarted = now;
+        }
+        if (_config->BodyTimeout > 0)
+        {
+            deadline = connection->BodyStarted + _config->BodyTimeout;
+        }
+    }
+    else if (connection->Builder->IsStarted() || ((connection->RequestStarted != 0) && (_config->HeaderTimeout > 0)))
+    {
+        // A trickling client must not extend the deadline.
+        if (connection->RequestStarted == 0)
+        {
+            connection->RequestStarted = now;
+        }
+        if (_config->HeaderTimeout > 0)
+        {
+            deadline = connection->RequestStarted + _config->HeaderTimeout;
+        }
+    }
+    else if (_config->IdleTimeout > 0)
+    {
+        deadline = now + _config->IdleTimeout;
+    }
+
+    _SetDeadline(connection, deadline);
+}
+
+void MayhemServer::_SetDeadline(const Ref<Connection>& connection, int64_t deadline)
+{
+    if (deadline == connection->Deadline)
+    {
+        return;
+    }
+
+    // The old timer is left in the wheel, and ignored on expiration.
+    connection->Deadline = deadline;
+    if (deadline != 0)
+    {
+        uint64_t key = (static_cast<uint64_t>(connection->Generation) << 32) | static_cast<uint32_t>(connection->Fd);
+        _timers.Schedule(deadline, key);
+    }
+}
+
+void MayhemServer::_ExpireConnections()
+{
+    int64_t now = _Now();
+
+    _expired.clear();
+    _timers.Advance(now, &_expired);
+    for (uint64_t key : _expired)
+    {
+        int fd = static_cast<int>(key & 0xFFFFFFFF);
+        if (!_connections.IsCurrent(fd, static_cast<uint32_t>(key >> 32)))
+        {
+            continue; // already closed
+        }
+
+        const Ref<Connection>& connection = _connections.Get(fd);
+        if ((connection->Deadline != 0) && (connection->Deadline <= now))
+        {
+            _logger->Debug("Connection {} timed out", fd);
+            _CloseConnection(fd);
+        }
+    }
+}
+
+void MayhemServer::_CloseConnection(int fd)
+{
+    // Release the slot before the fd can be reused by a new connection.
+    // Closing the fd also removes it from epoll.
+    Ref<io::Stream> stream = _connections.Get(fd)->Stream;
+    MINET_ASSERT(stream);
+    _connections.Remove(fd);
+    stream->Close();
+}
+
+void MayhemServer::_CloseConnections(bool idle)
+{
+    for (int fd = 0; fd < _connections.End(); fd++)
+    {
+        const Ref<Connection>& connection = _connections.Get(fd);
+        if (!connection)
+        {
+            continue;
+        }
+        // A new connection is not idle until its first request is answered.
+        if (idle && (connection->Busy || connection->Builder->IsStarted() || (connection->Requests == 0)))
+        {
+            continue;
+        }
+        _CloseConnection(fd);
     }
 }
 
@@ -185,7 +979,7 @@ void MayhemServer::_DecorateContext(const Ref<HttpContext>& context) const
 
 void MayhemServer::_OpenSocket()
 {
-    _listenFd = network::OpenSocket(_config->Port);
+    _listenFd = OpenListenSocket(*_config);
     if (_listenFd < 0)
     {
         _logger->Error("Failed to open socket: {}", _listenFd);
@@ -232,7 +1026,6 @@ void MayhemServer::_CloseEpoll()
 
 bool MayhemServer::_MonitorFd(int fd)
 {
-    // network::MakeNonBlockingSocket(fd);
     if (epoll::Monitor(_epollFd, fd, EPOLLIN | EPOLLET) != 0)
     {
         _logger->Error("Failed to add fd to epoll");
@@ -241,11 +1034,11 @@ bool MayhemServer::_MonitorFd(int fd)
     return true;
 }
 
-bool MayhemServer::_UnmonitorFd(int fd)
+bool MayhemServer::_WatchFd(int fd, uint32_t events)
 {
-    if (epoll::Unmonitor(_epollFd, fd) != 0)
+    if (epoll::Modify(_epollFd, fd, events) != 0)
     {
-        _logger->Error("Failed to remove fd from epoll");
+        _logger->Error("Failed to modify fd in epoll");
         return false;
     }
     return true;
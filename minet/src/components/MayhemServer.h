@@ -2,8 +2,18 @@
 
 #include "core/IServer.h"
 
+#include "io/TlsStream.h"
 #include "threading/ThreadPool.h"
+#include "utils/CoDel.h"
+#include "utils/ConnectionTable.h"
 #include "utils/Network.h"
+#include "utils/Pipeline.h"
+#include "utils/TimerWheel.h"
+
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 MINET_BEGIN
 
@@ -34,15 +44,130 @@ public:
 
     void Stop() override;
 
+    void Drain() override;
+
     const char* Name() const override
     {
         return Identifier();
     }
 
+    std::vector<int> GetListenSockets() const override
+    {
+        return _listenFd ? std::vector<int>{ _listenFd } : std::vector<int>{};
+    }
+
 private:
+    struct Connection;
+
     void _Serve();
 
-    void _HandleConnection(int fd);
+    /**
+     * @brief Stop accepting, and close connections not in the middle of
+     * a request.
+     */
+    void _StartDrain();
+
+    /**
+     * @brief Accept a bounded batch of new connections on the event loop.
+     */
+    void _Accept();
+
+    /**
+     * @brief Routine of an acceptor thread, sharing the listen socket with
+     * other acceptors by EPOLLEXCLUSIVE.
+     */
+    void _RunAcceptor();
+
+    void _AddConnection(const network::AcceptData& data);
+
+    /**
+     * @brief Parse all requests available on the connection, and dispatch
+     * them as one pipelined batch.
+     */
+    void _ReadConnection(int fd);
+
+    /**
+     * @brief Queue one request to the workers, or run it right away if its
+     * handler is inline-safe.
+     * @param onReactor Whether it is called on the reactor thread.
+     */
+    void _Dispatch(const Ref<Connection>& connection, size_t seq, bool onReactor);
+
+    /**
+     * @brief Run one request, and hand its response back to the reactor.
+     * @note Workers never touch the socket.
+     */
+    void _HandleRequest(const Ref<Connection>& connection, size_t seq, bool onReactor);
+
+    /**
+     * @brief Answer a request that no worker can take with the prepared 503.
+     */
+    void _RejectRequest(const Ref<Connection>& connection, size_t seq, bool onReactor);
+
+    /**
+     * @brief Hand the response of one request back to the reactor, and
+     * dispatch the requests it held back.
+     */
+    void _CompleteRequest(const Ref<Connection>& connection, size_t seq, std::string response, bool onReactor);
+
+    /**
+     * @brief Cancel requests of a connection whose client has gone away, and
+     * close it once they are finished.
+     * @note
+     * Only on EPOLLHUP or EPOLLERR, as a client that shuts down its sending
+     * side still waits for the answers.
+     */
+    void _AbortConnection(const Ref<Connection>& connection);
+
+    /**
+     * @brief Stop accepting while workers are saturated, so that new
+     * connections wait in the listen backlog, and resume once they catch
+     * up. Parked requests are retried first.
+     */
+    void _UpdateAdmission();
+
+    /**
+     * @brief Pick up new connections from acceptors, and connections with
+     * responses from the workers.
+     */
+    void _OnWake();
+
+    /**
+     * @brief Write responses of completed connections.
+     */
+    void _FlushCompleted();
+
+    /**
+     * @brief Write queued responses until the socket would block.
+     */
+    void _WriteConnection(const Ref<Connection>& connection);
+
+    /**
+     * @brief Get ready for the next batch on a kept-alive connection.
+     */
+    void _KeepAlive(const Ref<Connection>& connection);
+
+    /**
+     * @brief Set the deadline by what the connection is waiting for.
+     * @note Idle, headers or body, each with its own timeout.
+     */
+    void _UpdateDeadline(const Ref<Connection>& connection);
+
+    /**
+     * @param deadline Absolute time in milliseconds, 0 for no deadline.
+     */
+    void _SetDeadline(const Ref<Connection>& connection, int64_t deadline);
+
+    /**
+     * @brief Close all connections past their deadlines.
+     */
+    void _ExpireConnections();
+    void _CloseConnection(int fd);
+
+    /**
+     * @param idle Only close kept-alive connections waiting for a new request.
+     */
+    void _CloseConnections(bool idle);
 
     void _DecorateContext(const Ref<HttpContext>& context) const;
 
@@ -52,28 +177,152 @@ private:
     void _OpenEpoll();
     void _CloseEpoll();
     bool _MonitorFd(int fd);
-    bool _UnmonitorFd(int fd);
+    bool _WatchFd(int fd, uint32_t events);
 
 private:
+    Ref<ServerConfig> _config;
+
+    threading::ThreadPool _threadPool;
+
     /**
-     * @brief The maximum number of file descriptors.
-     * @note This is the maximum concurrent requests the server can handle.
+     * @brief One connection for each file descriptor.
+     * @note It grows up to the limit of open files.
      */
-    static const int MAX_FD;
+    network::ConnectionTable<Connection> _connections;
 
-    Ref<ServerConfig> _config;
+    /**
+     * @brief Deadlines of all connections.
+     */
+    TimerWheel _timers;
+    std::vector<uint64_t> _expired;
 
-    threading::ThreadPool _threadPool;
+    /**
+     * @brief Connections with responses ready, reported by workers.
+     */
+    std::vector<Ref<Connection>> _completed;
+    std::mutex _completedMutex;
+
+    /**
+     * @brief Requests handled on the reactor completed in this round, and
+     * are flushed after it without waking up the reactor.
+     */
+    bool _completedInline;
+
+    /**
+     * @brief Prepared responses to requests shed under overload.
+     */
+    std::string _overloadKeepAlive;
+    std::string _overloadClose;
+
+    /**
+     * @brief Set once a request finds all workers full, and cleared by the
+     * reactor when they catch up. Nothing is accepted meanwhile.
+     */
+    std::atomic<bool> _saturated;
+    bool _accepting;
+
+    /**
+     * @brief Requests no worker could take, waiting to be dispatched again.
+     * @note Only used if parkOverloaded is set.
+     */
+    std::vector<std::pair<Ref<Connection>, size_t>> _parked;
+    std::mutex _parkedMutex;
+
+    /**
+     * @brief Drops requests queued for too long, nullptr if disabled.
+     */
+    Ref<CoDel> _codel;
+
+    /**
+     * @brief Certificate and session cache shared by all connections,
+     * nullptr if TLS is disabled.
+     */
+    Ref<io::TlsContext> _tls;
+
+    /**
+     * @brief Connections accepted by acceptor threads.
+     */
+    std::vector<network::AcceptData> _accepted;
+    std::mutex _acceptedMutex;
+    std::vector<Ref<threading::Task>> _acceptors;
+
+    /**
+     * @brief Workers, acceptors and Stop wake up the reactor with this eventfd.
+     */
+    int _wakeFd;
 
     /**
-     * @brief One file descriptor for each connection.
-     * @note For concurrent request parsing.
+     * @brief Stop wakes up all acceptors with this eventfd, never drained.
      */
-    Ref<AsyncHttpContextBuilder>* _handles;
+    int _stopFd;
+
+    /**
+     * @brief Set by Drain, and the reactor drains until the deadline.
+     */
+    std::atomic<bool> _draining;
+    int64_t _drainDeadline;
 
     int _listenFd;
     int _epollFd;
     bool _isRunning;
 };
 
+/**
+ * @brief State of one client connection.
+ * @note Fields above the mutex belong to the reactor, workers only read
+ * the batch while it is running.
+ */
+struct MayhemServer::Connection
+{
+    int Fd;
+    uint32_t Generation;
+    Ref<AsyncHttpContextBuilder> Builder;
+
+    /**
+     * @brief The socket, or TLS over it, read by the builder and written
+     * only by the reactor.
+     */
+    Ref<io::Stream> Stream;
+
+    /**
+     * @brief When the connection will be closed, in milliseconds.
+     * @note 0 if the connection is being handled by workers.
+     */
+    int64_t Deadline = 0;
+
+    /**
+     * @brief When the current request started to arrive, and its body.
+     */
+    int64_t RequestStarted = 0;
+    int64_t BodyStarted = 0;
+
+    /**
+     * @brief Requests served on this connection.
+     */
+    unsigned Requests = 0;
+
+    /**
+     * @brief Requests of the current batch, indexed by sequence.
+     */
+    std::vector<Ref<HttpContext>> Batch;
+
+    /**
+     * @brief Responses taken from workers, but not written yet.
+     */
+    std::string Outbox;
+    size_t Written = 0;
+
+    bool Busy = false;    // a batch is running
+    bool Writing = false; // waiting for EPOLLOUT
+    bool Close = false;   // close after the current batch
+
+    std::mutex Mutex;
+    http::HttpPipeline Pipeline;
+
+    /**
+     * @brief Responses finished by workers, in request order.
+     */
+    std::string Output;
+};
+
 MINET_END
@@ -21,8 +21,18 @@ int RequestDispatcher::_InvokeHandler(const Ref<IRequestHandler>& handler, const
 void RequestDispatcher::_WriteResponse(const Ref<HttpContext>& context)
 {
     HttpResponse& response = context->Response;
+    if (!response.RawHead.empty())
+    {
+        // Nothing to format, so send it in one go.
+        iovec parts[] = { { const_cast<char*>(response.RawHead.data()), response.RawHead.size() },
+                          { const_cast<char*>(response.RawBody.data()), response.RawBody.size() } };
+        response.BodyStream->WriteVector(parts, response.RawBody.empty() ? 1 : 2);
+        return;
+    }
+
     io::BufferedStreamWriter writer(response.BodyStream);
-    response.ContentLength = static_cast<int>(response.Body.size());
+    size_t length = response.File ? response.File->Length : response.Body.size();
+    response.ContentLength = static_cast<int>(length);
 
     using namespace http;
     using namespace http::entities;
@@ -46,10 +56,15 @@ void RequestDispatcher::_WriteResponse(const Ref<HttpContext>& context)
     {
         writer.Write(CONTENT_LENGTH);
         writer.Write(COLON);
-        writer.Write(std::to_string(response.ContentLength));
+        writer.Write(std::to_string(length));
         writer.Write(NEW_LINE);
     }
 
+    writer.Write(CONNECTION);
+    writer.Write(COLON);
+    writer.Write(context->KeepAlive ? KEEP_ALIVE : CLOSE);
+    writer.Write(NEW_LINE);
+
     for (const auto& [key, value] : response.Headers)
     {
         writer.Write(key);
@@ -62,9 +77,18 @@ void RequestDispatcher::_WriteResponse(const Ref<HttpContext>& context)
     writer.Write(NEW_LINE);
 
     // Body
-    if (response.StatusCode != NO_CONTENT)
+    if (response.StatusCode == NO_CONTENT)
+    {
+        return;
+    }
+    if (response.File)
+    {
+        writer.WriteFile(response.File->Fd, 0, response.File->Length);
+    }
+    else
     {
-        writer.Write(response.Body);
+        // The stream may keep the body until it is sent, see WriteBody.
+        writer.WriteBody(std::move(response.Body));
     }
 }
 
@@ -0,0 +1,555 @@
+#include "components/ShardedServer.h"
+
+#include "minet/common/Assert.h"
+#include "minet/components/Logger.h"
+#include "minet/core/HttpContext.h"
+
+#include "io/Stream.h"
+#include "threading/Task.h"
+#include "threading/ThreadPool.h"
+#include "utils/Epoll.h"
+#include "utils/Network.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+MINET_BEGIN
+
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief One shard of the server, i.e. one listen socket and one event loop.
+ * @note
+ * Everything in a shard is only touched by its own thread, except for the
+ * optional executor, whose workers only see the parsed HTTP context.
+ */
+class ShardedServer::Shard final
+{
+public:
+    Shard(ShardedServer* server, unsigned id);
+    ~Shard();
+
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    /**
+     * @brief Open the listen socket and epoll of this shard.
+     * @param sharedFd Listen socket of another shard to share, 0 to open its own.
+     * @return Whether the shard is ready to serve.
+     */
+    bool Open(int sharedFd);
+
+    Ref<threading::Task> StartAsync();
+
+    int GetListenSocket() const
+    {
+        return _listenFd;
+    }
+
+private:
+    void _Serve();
+
+    void _Accept();
+    void _Read(int fd);
+    void _Dispatch(const Ref<HttpContext>& context);
+
+    /**
+     * @brief Stop accepting, and finish requests in progress.
+     * @return The deadline of the drain.
+     */
+    int64_t _StartDrain();
+
+    bool _MonitorFd(int fd);
+    bool _UnmonitorFd(int fd);
+    void _CloseFd(int fd);
+
+    void _Close();
+
+private:
+    ShardedServer* _server;
+    unsigned _id;
+
+    /**
+     * @brief Optional handler threads local to this shard.
+     */
+    Ref<threading::ThreadPool> _executor;
+
+    /**
+     * @brief Connections accepted by this shard, indexed by fd.
+     * @note It grows on demand, so there is no hard limit on connections.
+     */
+    std::vector<Ref<AsyncHttpContextBuilder>> _handles;
+
+    /**
+     * @brief Connections being parsed, and requests left to the executor.
+     */
+    size_t _parsing;
+    std::atomic<size_t> _handling;
+
+    int _listenFd;
+    int _epollFd;
+};
+
+/*
+ * ===================================================================
+ * ------------------------- Sharded Server --------------------------
+ * ===================================================================
+ */
+
+ShardedServer::ShardedServer(const Ref<ServerConfig>& config) : _config(config), _stopFd(-1), _drainFd(-1), _isRunning(false)
+{
+}
+
+ShardedServer::~ShardedServer()
+{
+    _shards.clear();
+    if (_stopFd >= 0)
+    {
+        close(_stopFd);
+    }
+    if (_drainFd >= 0)
+    {
+        close(_drainFd);
+    }
+}
+
+Ref<threading::Task> ShardedServer::StartAsync()
+{
+    _logger->Info("Starting {} server on {} with {} shards", Name(), GetListenAddress(*_config), _config->Threads);
+
+    if (_isRunning)
+    {
+        _logger->Warn("Server is already running");
+        return threading::Task::Completed();
+    }
+
+    if (!_onConnectionCallback)
+    {
+        _logger->Error("OnConnection callback is not set");
+        return threading::Task::Completed();
+    }
+
+    if (_stopFd < 0)
+    {
+        _stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        _drainFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((_stopFd < 0) || (_drainFd < 0))
+        {
+            _logger->Error("Failed to create eventfd");
+            return threading::Task::Completed();
+        }
+    }
+    else
+    {
+        // Clear the signals left by the last run.
+        eventfd_t value;
+        eventfd_read(_stopFd, &value);
+        eventfd_read(_drainFd, &value);
+    }
+
+    for (unsigned i = 0; i < _config->Threads; i++)
+    {
+        // A Unix domain socket cannot be bound twice, so shards share the first one.
+        int sharedFd = (!_config->UnixSocket.empty() && !_shards.empty()) ? _shards[0]->GetListenSocket() : 0;
+        auto shard = CreateRef<Shard>(this, i);
+        if (!shard->Open(sharedFd))
+        {
+            _logger->Error("Failed to open shard {}", i);
+            _shards.clear();
+            return threading::Task::Completed();
+        }
+        _shards.push_back(shard);
+    }
+
+    _isRunning = true;
+    Ref<threading::Task> task = threading::Task::Create(BIND_FN(_Serve))->StartAsync();
+    _logger->Info("Server started");
+
+    return task;
+}
+
+void ShardedServer::Stop()
+{
+    _logger->Info("Shutting down {} server", Name());
+    if (!_isRunning)
+    {
+        _logger->Warn("Server is not running");
+    }
+    _isRunning = false;
+
+    // Wake up all shards so that they can see the flag.
+    if (_stopFd >= 0)
+    {
+        eventfd_write(_stopFd, 1);
+    }
+}
+
+void ShardedServer::Drain()
+{
+    if (_config->DrainTimeout == 0)
+    {
+        Stop();
+        return;
+    }
+
+    _logger->Info("Draining {} server", Name());
+    if (!_isRunning)
+    {
+        _logger->Warn("Server is not running");
+        return;
+    }
+
+    // Each shard drains on its own, and the server stops when all are done.
+    eventfd_write(_drainFd, 1);
+}
+
+std::vector<int> ShardedServer::GetListenSockets() const
+{
+    std::vector<int> fds;
+    if (_isRunning)
+    {
+        for (const auto& shard : _shards)
+        {
+            if (shard->GetListenSocket() != 0)
+            {
+                fds.push_back(shard->GetListenSocket());
+            }
+        }
+    }
+    return fds;
+}
+
+void ShardedServer::_Serve()
+{
+    std::vector<Ref<threading::Task>> tasks;
+    tasks.reserve(_shards.size());
+    for (auto& shard : _shards)
+    {
+        tasks.push_back(shard->StartAsync());
+    }
+    for (auto& task : tasks)
+    {
+        task->Await();
+    }
+    _isRunning = false;
+
+    _logger->Debug("Closing shards");
+    _shards.clear();
+
+    _logger->Info("{} server shut down", Name());
+}
+
+void ShardedServer::_DecorateContext(const Ref<HttpContext>& context) const
+{
+    context->Response.Headers["Server"] = Name();
+    EnableZeroCopy(*_config, context);
+}
+
+/*
+ * ===================================================================
+ * ------------------------------ Shard ------------------------------
+ * ===================================================================
+ */
+
+ShardedServer::Shard::Shard(ShardedServer* server, unsigned id)
+    : _server(server), _id(id), _parsing(0), _handling(0), _listenFd(0), _epollFd(0)
+{
+    const ServerConfig& config = *_server->_config;
+    if (config.Workers > 0)
+    {
+        // Rotate the CPUs left by the shards, so that executors of different
+        // shards start on different CPUs.
+        std::vector<int> cpus = GetWorkerCpus(config, config.Threads);
+        if (!cpus.empty())
+        {
+            std::rotate(cpus.begin(), cpus.begin() + (_id * config.Workers) % cpus.size(), cpus.end());
+        }
+        _executor = CreateRef<threading::ThreadPool>(config.Workers, config.Capacity, config.SpinTime, cpus);
+    }
+}
+
+ShardedServer::Shard::~Shard()
+{
+    _Close();
+}
+
+bool ShardedServer::Shard::Open(int sharedFd)
+{
+    _listenFd = sharedFd ? fcntl(sharedFd, F_DUPFD_CLOEXEC, 0) : OpenListenSocket(*_server->_config, true);
+    if (_listenFd < 0)
+    {
+        _server->_logger->Error("Shard {} failed to open socket: {}", _id, _listenFd);
+        _listenFd = 0;
+        return false;
+    }
+
+    _epollFd = epoll::Create();
+    if (_epollFd == -1)
+    {
+        _server->_logger->Error("Shard {} failed to create epoll", _id);
+        _epollFd = 0;
+        _Close();
+        return false;
+    }
+
+    // Note that _listenFd cannot use EPOLL_ET mode. A shared socket wakes
+    // up only one of the shards for each new connection.
+    uint32_t events = _server->_config->UnixSocket.empty() ? EPOLLIN : (EPOLLIN | EPOLLEXCLUSIVE);
+    if (epoll::Monitor(_epollFd, _listenFd, events) != 0)
+    {
+        _server->_logger->Error("Shard {} failed to monitor server socket", _id);
+        _Close();
+        return false;
+    }
+
+    if ((epoll::Monitor(_epollFd, _server->_stopFd, EPOLLIN) != 0) ||
+        (epoll::Monitor(_epollFd, _server->_drainFd, EPOLLIN) != 0))
+    {
+        _server->_logger->Error("Shard {} failed to monitor eventfd", _id);
+        _Close();
+        return false;
+    }
+
+    return true;
+}
+
+Ref<threading::Task> ShardedServer::Shard::StartAsync()
+{
+    return threading::Task::Create(BIND_FN(_Serve))->StartAsync();
+}
+
+void ShardedServer::Shard::_Serve()
+{
+    static constexpr int MAX_EVENTS = 64;
+
+    // Requests on the executor cannot report back, so check them from
+    // time to time while draining.
+    static constexpr int DRAIN_INTERVAL = 10;
+
+    epoll_event events[MAX_EVENTS];
+    int64_t deadline = 0;
+
+    // Closed sockets may wait for their zero copy bodies, see SocketStream.
+    int timeout = (_server->_config->Socket.ZeroCopy > 0) ? io::SocketStream::LINGER_INTERVAL : -1;
+
+    _server->_PinReactor(*_server->_config, _id);
+    _server->_logger->Debug("Shard {} started", _id);
+    while (_server->_isRunning)
+    {
+        io::SocketStream::ReapLingering();
+        int count = epoll::BusyWait(_epollFd, events, MAX_EVENTS, (deadline == 0) ? timeout : DRAIN_INTERVAL,
+                                    _server->_config->SpinTime);
+        if (count == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            _server->_logger->Error("Shard {} failed to wait for epoll events", _id);
+            _server->_logger->Error("Unable to serve, shutting down server");
+            _server->Stop();
+            break;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == _listenFd)
+            {
+                _Accept();
+            }
+            else if (fd == _server->_stopFd)
+            {
+                continue; // stopping
+            }
+            else if (fd == _server->_drainFd)
+            {
+                if (deadline == 0)
+                {
+                    deadline = _StartDrain();
+                }
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                _Read(fd);
+            }
+        }
+
+        if ((deadline != 0) && (((_parsing == 0) && (_handling == 0)) || (_Now() >= deadline)))
+        {
+            _server->_logger->Debug("Shard {} drained with {} requests left", _id, _parsing + _handling);
+            break;
+        }
+    }
+
+    // Stop local handler threads before the shard is torn down.
+    _executor.reset();
+    _Close();
+    _server->_logger->Debug("Shard {} stopped", _id);
+}
+
+int64_t ShardedServer::Shard::_StartDrain()
+{
+    // Stop watching the drain signal, which is never cleared.
+    epoll::Unmonitor(_epollFd, _server->_drainFd);
+
+    // Closing the socket does not remove it from epoll if it is shared
+    // with other shards, as the file is still open.
+    epoll::Unmonitor(_epollFd, _listenFd);
+    if (network::CloseSocket(_listenFd) != 0)
+    {
+        _server->_logger->Error("Failed to close socket");
+    }
+    _listenFd = 0;
+
+    return _Now() + _server->_config->DrainTimeout;
+}
+
+void ShardedServer::Shard::_Accept()
+{
+    network::AcceptData data;
+
+    // There may be multiple incoming connections. They must not leak into
+    // a process spawned for hot restart, or they would never be closed.
+    while (network::AcceptSocket(_listenFd, &data, SOCK_CLOEXEC))
+    {
+        int fd = data.SocketFd;
+        network::TuneSocket(fd, _server->_config->Socket);
+        if (static_cast<size_t>(fd) >= _handles.size())
+        {
+            _handles.resize(std::max(static_cast<size_t>(fd) + 1, _handles.size() * 2));
+        }
+
+        if (!_MonitorFd(fd))
+        {
+            _server->_logger->Error("Failed to monitor new connection");
+            network::CloseSocket(fd);
+            continue;
+        }
+
+        _handles[fd] = CreateRef<AsyncHttpContextBuilder>(data);
+        _parsing++;
+    }
+}
+
+void ShardedServer::Shard::_Read(int fd)
+{
+    auto& handle = _handles[fd];
+    if (!handle)
+    {
+        return;
+    }
+
+    int r = handle->Parse();
+    if (r == 1)
+    {
+        _UnmonitorFd(fd); // prevent from triggering again
+
+        Ref<HttpContext> context = handle->GetContext();
+        handle.reset(); // the context keeps the socket from now on
+        _parsing--;
+
+        _server->_DecorateContext(context);
+        _Dispatch(context);
+    }
+    else if (r < 0)
+    {
+        // error occurred
+        _server->_logger->Error("Failed to create HTTP context: {}", r);
+        _CloseFd(fd);
+    }
+    // else, continue parsing
+}
+
+void ShardedServer::Shard::_Dispatch(const Ref<HttpContext>& context)
+{
+    // Cheap handlers are not worth the queue and the wake-up of a worker.
+    bool inlineSafe = _server->_isInlineCallback && _server->_isInlineCallback(context);
+    if (_executor && !inlineSafe)
+    {
+        _handling++;
+        if (_executor->Submit([this, context] {
+                _server->_onConnectionCallback(context);
+                _handling--;
+            }))
+        {
+            return;
+        }
+        _handling--;
+        // The local executor is full, handle it right away so that
+        // the shard slows down accepting instead of dropping requests.
+        _server->_logger->Debug("Shard {} executor is full, handle request inline", _id);
+    }
+    _server->_onConnectionCallback(context);
+}
+
+bool ShardedServer::Shard::_MonitorFd(int fd)
+{
+    if (epoll::Monitor(_epollFd, fd, EPOLLIN | EPOLLET) != 0)
+    {
+        _server->_logger->Error("Failed to add fd to epoll");
+        return false;
+    }
+    return true;
+}
+
+bool ShardedServer::Shard::_UnmonitorFd(int fd)
+{
+    if (epoll::Unmonitor(_epollFd, fd) != 0)
+    {
+        _server->_logger->Error("Failed to remove fd from epoll");
+        return false;
+    }
+    return true;
+}
+
+void ShardedServer::Shard::_CloseFd(int fd)
+{
+    // Closing the fd also removes it from epoll.
+    network::CloseSocket(fd);
+    if (_handles[fd])
+    {
+        _handles[fd].reset();
+        _parsing--;
+    }
+}
+
+void ShardedServer::Shard::_Close()
+{
+    for (size_t fd = 0; fd < _handles.size(); fd++)
+    {
+        if (_handles[fd])
+        {
+            _CloseFd(static_cast<int>(fd));
+        }
+    }
+    _handles.clear();
+
+    if (_listenFd != 0)
+    {
+        if (network::CloseSocket(_listenFd) != 0)
+        {
+            _server->_logger->Error("Failed to close socket");
+        }
+        _listenFd = 0;
+    }
+
+    if (_epollFd != 0)
+    {
+        if (epoll::Close(_epollFd) != 0)
+        {
+            _server->_logger->Error("Failed to close epoll");
+        }
+        _epollFd = 0;
+    }
+}
+
+MINET_END
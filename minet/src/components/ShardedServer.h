@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/IServer.h"
+
+#include "utils/Network.h"
+
+#include <atomic>
+#include <vector>
+
+MINET_BEGIN
+
+/**
+ * @brief Sharded server runs one epoll loop per shard.
+ * @note
+ * Each shard has its own listen socket bound with SO_REUSEPORT, so the
+ * kernel spreads incoming connections among shards. A connection then
+ * stays on the shard that accepted it, which accepts, parses and handles
+ * it without sharing anything with other shards.
+ * @note
+ * A Unix domain socket cannot be bound more than once, so shards share
+ * one socket then, and only one of them is woken up for a connection.
+ * @ref man 7 socket
+ */
+class ShardedServer final : public IServer
+{
+    class Shard;
+
+public:
+    explicit ShardedServer(const Ref<ServerConfig>& config);
+    ~ShardedServer() override;
+
+    ShardedServer(const ShardedServer&) = delete;
+    ShardedServer& operator=(const ShardedServer&) = delete;
+    ShardedServer(ShardedServer&&) noexcept = delete;
+    ShardedServer& operator=(ShardedServer&&) noexcept = delete;
+
+    static const char* Identifier()
+    {
+        return "Sharded";
+    }
+
+    Ref<threading::Task> StartAsync() override;
+
+    void Stop() override;
+
+    void Drain() override;
+
+    const char* Name() const override
+    {
+        return Identifier();
+    }
+
+    std::vector<int> GetListenSockets() const override;
+
+private:
+    void _Serve();
+
+    void _DecorateContext(const Ref<HttpContext>& context) const;
+
+private:
+    Ref<ServerConfig> _config;
+
+    std::vector<Ref<Shard>> _shards;
+
+    /**
+     * @brief Stop wakes up all shards with this eventfd, never drained.
+     */
+    int _stopFd;
+
+    /**
+     * @brief Drain wakes up all shards with this eventfd, never drained either.
+     */
+    int _drainFd;
+
+    std::atomic<bool> _isRunning;
+};
+
+MINET_END
@@ -0,0 +1,181 @@
+#include "components/StaticFileHandler.h"
+
+#include "minet/common/Http.h"
+#include "minet/core/HttpContext.h"
+#include "minet/utils/Parser.h"
+
+#include <strings.h>
+
+MINET_BEGIN
+
+static int _HexToInt(char ch)
+{
+    if ((ch >= '0') && (ch <= '9'))
+    {
+        return ch - '0';
+    }
+    if ((ch >= 'a') && (ch <= 'f'))
+    {
+        return ch - 'a' + 10;
+    }
+    if ((ch >= 'A') && (ch <= 'F'))
+    {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Decode %XX in the path.
+ * @return false if the encoding is broken.
+ */
+static bool _DecodePath(const std::string& path, std::string* decoded)
+{
+    decoded->clear();
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        if (path[i] != '%')
+        {
+            decoded->push_back(path[i]);
+            continue;
+        }
+        if (i + 2 >= path.size())
+        {
+            return false;
+        }
+        int high = _HexToInt(path[i + 1]);
+        int low = _HexToInt(path[i + 2]);
+        if ((high < 0) || (low < 0))
+        {
+            return false;
+        }
+        decoded->push_back(static_cast<char>(high * 16 + low));
+        i += 2;
+    }
+    return true;
+}
+
+StaticFileHandler::StaticFileHandler(const std::string& prefix, const std::string& root, size_t cacheSize)
+    : _prefix(http::CleanPath(prefix)), _root(root), _cache(cacheSize, CACHE_MAX_AGE)
+{
+    while ((_root.size() > 1) && (_root.back() == '/'))
+    {
+        _root.pop_back();
+    }
+}
+
+int StaticFileHandler::Handle(const Ref<HttpContext>& context)
+{
+    std::string path = MapPath(context->Request.Path);
+    if (path.empty())
+    {
+        return http::status::NOT_FOUND;
+    }
+
+    // A directory is served by its index page.
+    Ref<FileBody> file = _cache.Open(path);
+    if (!file)
+    {
+        path.append("/index.html");
+        file = _cache.Open(path);
+        if (!file)
+        {
+            return http::status::NOT_FOUND;
+        }
+    }
+
+    HttpResponse& response = context->Response;
+    response.StatusCode = http::status::OK;
+    response.ContentType = GetContentType(path);
+    response.File = file;
+
+    return http::status::OK;
+}
+
+std::string StaticFileHandler::MapPath(const std::string& path) const
+{
+    std::string target = path.substr(0, path.find('?'));
+    if ((target.compare(0, _prefix.size(), _prefix) != 0) ||
+        ((target.size() > _prefix.size()) && (target[_prefix.size()] != '/')))
+    {
+        return {};
+    }
+
+    std::string relative;
+    if (!_DecodePath(target.substr(_prefix.size()), &relative))
+    {
+        return {};
+    }
+
+    // Check every segment, after decoding, so that "%2e%2e" is caught too.
+    std::string mapped = _root;
+    size_t begin = 0;
+    while (begin < relative.size())
+    {
+        size_t end = relative.find('/', begin);
+        if (end == std::string::npos)
+        {
+            end = relative.size();
+        }
+        if (end > begin)
+        {
+            std::string segment = relative.substr(begin, end - begin);
+            if ((segment[0] == '.') || (segment.find('\0') != std::string::npos) ||
+                (segment.find('\\') != std::string::npos))
+            {
+                return {};
+            }
+            mapped.append("/").append(segment);
+        }
+        begin = end + 1;
+    }
+
+    return mapped;
+}
+
+const char* StaticFileHandler::GetContentType(const std::string& path)
+{
+    // clang-format off
+    static const std::pair<const char*, const char*> types[] = {
+        { "html",  "text/html; charset=utf-8" },
+        { "htm",   "text/html; charset=utf-8" },
+        { "css",   "text/css; charset=utf-8" },
+        { "js",    "text/javascript; charset=utf-8" },
+        { "mjs",   "text/javascript; charset=utf-8" },
+        { "json",  "application/json" },
+        { "map",   "application/json" },
+        { "txt",   "text/plain; charset=utf-8" },
+        { "csv",   "text/csv; charset=utf-8" },
+        { "xml",   "application/xml" },
+        { "svg",   "image/svg+xml" },
+        { "png",   "image/png" },
+        { "jpg",   "image/jpeg" },
+        { "jpeg",  "image/jpeg" },
+        { "gif",   "image/gif" },
+        { "webp",  "image/webp" },
+        { "ico",   "image/x-icon" },
+        { "woff",  "font/woff" },
+        { "woff2", "font/woff2" },
+        { "ttf",   "font/ttf" },
+        { "wasm",  "application/wasm" },
+        { "pdf",   "application/pdf" },
+    };
+    // clang-format on
+
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if ((dot != std::string::npos) && ((slash == std::string::npos) || (dot > slash)))
+    {
+        const char* extension = path.c_str() + dot + 1;
+        for (const auto& [name, type] : types)
+        {
+            if (strcasecmp(extension, name) == 0)
+            {
+                return type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+MINET_END
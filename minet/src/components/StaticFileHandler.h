@@ -0,0 +1,60 @@
+/**
+ * @author Tony S.
+ * @details Handler serving files under a directory.
+ */
+
+#pragma once
+
+#include "minet/core/IRequestHandler.h"
+
+#include "utils/FileCache.h"
+
+#include <string>
+
+MINET_BEGIN
+
+/**
+ * @brief Serve files under the root directory for paths under the prefix,
+ * e.g. "/assets/app.js" to "www/app.js" for "/assets" and "www".
+ * @note
+ * Files are sent with sendfile where the server writes to the socket
+ * directly, and kept open in an LRU cache.
+ * @note
+ * Paths with a segment starting with '.' are not found, so that neither
+ * ".." nor hidden files like ".git" can be reached. Symbolic links under
+ * the root are followed, though.
+ */
+class StaticFileHandler final : public IRequestHandler
+{
+public:
+    /**
+     * @param prefix Path prefix of the files.
+     * @param root Directory of the files.
+     * @param cacheSize Maximum number of files kept open.
+     */
+    StaticFileHandler(const std::string& prefix, const std::string& root, size_t cacheSize);
+
+    int Handle(const Ref<HttpContext>& context) override;
+
+    /**
+     * @brief Map the request path to a file under the root.
+     * @return The file path, or empty if the path is not under the prefix,
+     * or it may escape the root.
+     */
+    std::string MapPath(const std::string& path) const;
+
+    /**
+     * @brief Get the content type by the extension of the path.
+     */
+    static const char* GetContentType(const std::string& path);
+
+private:
+    // Cached files are checked again after this long, in milliseconds.
+    static constexpr unsigned CACHE_MAX_AGE = 1000;
+
+    std::string _prefix;
+    std::string _root;
+    FileCache _cache;
+};
+
+MINET_END
@@ -4,19 +4,40 @@
 #include "minet/components/Logger.h"
 #include "minet/core/HttpContext.h"
 
+#include "io/Stream.h"
 #include "threading/Task.h"
 #include "utils/Network.h"
 
+#include <chrono>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+
 MINET_BEGIN
 
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 ThreadedServer::ThreadedServer(const Ref<ServerConfig>& config)
-    : _config(config), _threadPool(config->Threads, config->Capacity), _listenFd(0), _isRunning(false)
+    : _config(config), _threadPool(config->Threads, config->Capacity, config->SpinTime, GetWorkerCpus(*config)),
+      _listenFd(0), _wakeFd(-1), _connections(0), _draining(false), _isRunning(false)
+{
+}
+
+ThreadedServer::~ThreadedServer()
 {
+    if (_wakeFd >= 0)
+    {
+        close(_wakeFd);
+    }
 }
 
 Ref<threading::Task> ThreadedServer::StartAsync()
 {
-    _logger->Info("Starting {} server on port {}", Name(), _config->Port);
+    _logger->Info("Starting {} server on {}", Name(), GetListenAddress(*_config));
 
     if (_isRunning)
     {
@@ -38,7 +59,25 @@ Ref<threading::Task> ThreadedServer::StartAsync()
         return threading::Task::Completed();
     }
 
+    if (_wakeFd < 0)
+    {
+        _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_wakeFd < 0)
+        {
+            _logger->Error("Failed to create eventfd");
+            _CloseSocket();
+            return threading::Task::Completed();
+        }
+    }
+    else
+    {
+        // Clear the wakeup left by the last Stop.
+        eventfd_t value;
+        eventfd_read(_wakeFd, &value);
+    }
+
     _isRunning = true;
+    _draining = false;
     Ref<threading::Task> task = threading::Task::Create(BIND_FN(_Serve))->StartAsync();
     _logger->Info("Server started");
 
@@ -53,19 +92,77 @@ void ThreadedServer::Stop()
         _logger->Warn("Server is not running");
     }
     _isRunning = false;
+    _draining = false;
+
+    // Wake up the accepting thread so that it can see the flag.
+    if (_wakeFd >= 0)
+    {
+        eventfd_write(_wakeFd, 1);
+    }
+}
+
+void ThreadedServer::Drain()
+{
+    if (_config->DrainTimeout == 0)
+    {
+        Stop();
+        return;
+    }
+
+    _logger->Info("Draining {} server", Name());
+    if (!_isRunning)
+    {
+        _logger->Warn("Server is not running");
+        return;
+    }
+
+    // Workers see the same flag, so kept-alive connections are closed
+    // after the current request, and idle ones are closed on the wakeup.
+    _draining = true;
+    _isRunning = false;
+    eventfd_write(_wakeFd, 1);
 }
 
 void ThreadedServer::_Serve()
 {
+    // Leave the rest to the next round, so that Stop is not delayed too much.
+    static constexpr int MAX_ACCEPTS = 64;
+
     network::AcceptData data;
+    // Closed sockets may wait for their zero copy bodies, see SocketStream.
+    int timeout = (_config->Socket.ZeroCopy > 0) ? io::SocketStream::LINGER_INTERVAL : -1;
+
+    _PinReactor(*_config);
     while (_isRunning)
     {
-        while (AcceptSocket(_listenFd, &data) && _isRunning)
+        io::SocketStream::ReapLingering();
+
+        // Sleep until there is a connection, instead of spinning on accept.
+        int r = network::WaitSocket(_listenFd, _wakeFd, timeout);
+        if (r < 0)
         {
-            if (!_threadPool.Submit([this, data] { _HandleConnection(data); }))
+            _logger->Error("Failed to wait for new connections");
+            _logger->Error("Unable to serve, shutting down server");
+            Stop(); // call stop to shut down gracefully
+        }
+        if (r <= 0)
+        {
+            continue;
+        }
+
+        // Requests are parsed synchronously, so the socket stays blocking.
+        for (int i = 0; (i < MAX_ACCEPTS) && _isRunning && AcceptSocket(_listenFd, &data, SOCK_CLOEXEC); i++)
+        {
+            network::TuneSocket(data.SocketFd, _config->Socket);
+            _connections++;
+            if (!_threadPool.Submit([this, data] {
+                    _HandleConnection(data);
+                    _connections--;
+                }))
             {
                 _logger->Warn("Server overwhelmed, new connection refused");
                 network::CloseSocket(data.SocketFd);
+                _connections--;
             }
         }
     }
@@ -73,32 +170,96 @@ void ThreadedServer::_Serve()
     _logger->Debug("Closing server socket");
     _CloseSocket();
 
+    if (_draining)
+    {
+        // Workers have no way to report back, so just check them from time to time.
+        static constexpr int DRAIN_INTERVAL = 10;
+        int64_t deadline = _Now() + _config->DrainTimeout;
+        while (_draining && (_connections > 0) && (_Now() < deadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL));
+        }
+        if (_connections > 0)
+        {
+            _logger->Warn("Drain ended with {} connections left", _connections.load());
+        }
+        else
+        {
+            _logger->Info("All connections drained");
+        }
+    }
+
     _logger->Info("{} server shut down", Name());
 }
 
 void ThreadedServer::_HandleConnection(const network::AcceptData& data)
 {
-    Ref<HttpContext> context;
-    if (int r = CreateHttpContext(data, &context); r == 0)
+    if (_config->KeepAlive)
     {
-        _DecorateContext(context);
-        _logger->Debug("New connection from {}", context->Request.Host);
-        _onConnectionCallback(context);
+        // Don't let an idle connection hold the worker forever.
+        network::SetReceiveTimeout(data.SocketFd, _config->IdleTimeout);
     }
-    else
+
+    // One builder for the whole connection, so that pipelined requests
+    // left in its buffer are not lost between requests.
+    AsyncHttpContextBuilder builder(data);
+    for (unsigned served = 0;; served++)
     {
-        _logger->Error("Failed to create HTTP context, error code: {}", r);
+        // Wait for the next request with the server, so that Stop does not
+        // have to wait for idle connections to time out.
+        if ((served > 0) && !builder.IsStarted() && !builder.IsBuffered() &&
+            (network::WaitSocket(data.SocketFd, _wakeFd, static_cast<int>(_config->IdleTimeout)) != 1))
+        {
+            _logger->Debug("Connection closed after {} requests", served);
+            // Close it with the stream, which may still hold zero copy bodies.
+            builder.GetContext()->Request.BodyStream->Close();
+            return;
+        }
+
+        // The socket is blocking, so 0 means the idle timeout expired.
+        if (int r = builder.Parse(); r != 1)
+        {
+            if (served == 0)
+            {
+                _logger->Error("Failed to create HTTP context, error code: {}", r);
+            }
+            else
+            {
+                // Closed by peer or idle for too long.
+                _logger->Debug("Connection closed after {} requests", served);
+            }
+            builder.GetContext()->Request.BodyStream->Close();
+            return;
+        }
+
+        Ref<HttpContext> context = builder.GetContext();
+        builder.Reset();
+
+        context->KeepAlive = _config->KeepAlive && _isRunning && context->Request.IsKeepAlive() &&
+                             ((_config->MaxRequests == 0) || (served + 1 < _config->MaxRequests));
+        _DecorateContext(context);
+        if (served == 0)
+        {
+            _logger->Debug("New connection from {}", context->Request.Host);
+        }
+        _onConnectionCallback(context);
+
+        if (!context->KeepAlive)
+        {
+            return; // closed with the context
+        }
     }
 }
 
 void ThreadedServer::_DecorateContext(const Ref<HttpContext>& context) const
 {
     context->Response.Headers["Server"] = Name();
+    EnableZeroCopy(*_config, context);
 }
 
 void ThreadedServer::_OpenSocket()
 {
-    _listenFd = network::OpenSocket(_config->Port);
+    _listenFd = OpenListenSocket(*_config);
     if (_listenFd < 0)
     {
         _logger->Error("Failed to open socket: {}", _listenFd);
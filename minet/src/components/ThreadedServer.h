@@ -5,6 +5,8 @@
 #include "threading/ThreadPool.h"
 #include "utils/Network.h"
 
+#include <atomic>
+
 MINET_BEGIN
 
 /**
@@ -14,7 +16,7 @@ class ThreadedServer final : public IServer
 {
 public:
     explicit ThreadedServer(const Ref<ServerConfig>& config);
-    ~ThreadedServer() override = default;
+    ~ThreadedServer() override;
 
     ThreadedServer(const ThreadedServer&) = delete;
     ThreadedServer& operator=(const ThreadedServer&) = delete;
@@ -30,11 +32,18 @@ public:
 
     void Stop() override;
 
+    void Drain() override;
+
     const char* Name() const override
     {
         return Identifier();
     }
 
+    std::vector<int> GetListenSockets() const override
+    {
+        return _listenFd ? std::vector<int>{ _listenFd } : std::vector<int>{};
+    }
+
 private:
     void _Serve();
 
@@ -51,7 +60,20 @@ private:
     threading::ThreadPool _threadPool;
 
     int _listenFd;
-    bool _isRunning;
+
+    /**
+     * @brief Stop wakes up the accepting thread with this eventfd.
+     */
+    int _wakeFd;
+
+    /**
+     * @brief Connections submitted to workers and not closed yet.
+     */
+    std::atomic<unsigned> _connections;
+    std::atomic<bool> _draining;
+
+    // Workers read it to decide whether to keep connections alive.
+    std::atomic<bool> _isRunning;
 };
 
 MINET_END
@@ -0,0 +1,591 @@
+#include "components/UringServer.h"
+
+#include "minet/common/Assert.h"
+#include "minet/components/Logger.h"
+#include "minet/core/HttpContext.h"
+
+#include "io/Stream.h"
+#include "threading/Task.h"
+#include "utils/Network.h"
+
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+
+MINET_BEGIN
+
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief State of one accepted connection.
+ * @note
+ * The stream is fed by the ring thread, and the response written into it
+ * by the worker is sent by the ring thread again, so the socket itself is
+ * never touched outside the ring.
+ */
+struct UringServer::Connection
+{
+    explicit Connection(int fd)
+        : Fd(fd), Stream(CreateRef<io::MemoryStream>()), Builder(CreateRef<AsyncHttpContextBuilder>(Stream, _Host(fd))),
+          Busy(false), Closing(false), CloseOnSend(false)
+    {
+    }
+
+    int Fd;
+    Ref<io::MemoryStream> Stream;
+    Ref<AsyncHttpContextBuilder> Builder;
+
+    /**
+     * @brief The request is being handled by a worker.
+     */
+    bool Busy;
+
+    /**
+     * @brief Close is submitted, waiting for its completion.
+     */
+    bool Closing;
+
+    /**
+     * @brief Only the send is submitted, so close once it completes, as
+     * the kernel reads the output till then.
+     */
+    bool CloseOnSend;
+
+private:
+    static std::string _Host(int fd)
+    {
+        sockaddr_storage address = {};
+        socklen_t size = sizeof(address);
+        if (getpeername(fd, reinterpret_cast<sockaddr*>(&address), &size) != 0)
+        {
+            return "unknown";
+        }
+        return network::AddressToHost(reinterpret_cast<sockaddr*>(&address), size);
+    }
+};
+
+namespace
+{
+
+/**
+ * @brief Operation kept in the upper half of user data, fd in the lower.
+ */
+enum class Operation : uint64_t
+{
+    Accept = 1,
+    Receive,
+    Send,
+    Close,
+    Cancel,
+    Wake
+};
+
+uint64_t Encode(Operation operation, int fd)
+{
+    return (static_cast<uint64_t>(operation) << 32) | static_cast<uint32_t>(fd);
+}
+
+Operation DecodeOperation(uint64_t userData)
+{
+    return static_cast<Operation>(userData >> 32);
+}
+
+int DecodeFd(uint64_t userData)
+{
+    return static_cast<int>(userData & 0xFFFFFFFFu);
+}
+
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr uint16_t BUFFER_GROUP = 0;
+constexpr unsigned BUFFER_COUNT = 1024;
+constexpr unsigned BUFFER_SIZE = 4096;
+
+} // namespace
+
+UringServer::UringServer(const Ref<ServerConfig>& config)
+    : _config(config),
+      _threadPool(CreateRef<threading::ThreadPool>(config->Threads, config->Capacity, config->SpinTime,
+                                                    GetWorkerCpus(*config), 0, config->QueueTarget)),
+      _overloadResponse(MakeOverloadResponse(*config, Identifier(), false)), _wakeFd(-1), _wakeValue(0), _listenFd(0),
+      _isRunning(false)
+{
+    if (_config->QueueTarget > 0)
+    {
+        _codel = CreateRef<CoDel>(_config->QueueTarget, _config->QueueInterval);
+    }
+}
+
+UringServer::~UringServer()
+{
+    _Close();
+}
+
+bool UringServer::IsSupported()
+{
+    return uring::IsSupported();
+}
+
+Ref<threading::Task> UringServer::StartAsync()
+{
+    _logger->Info("Starting {} server on {}", Name(), GetListenAddress(*_config));
+
+    if (_isRunning)
+    {
+        _logger->Warn("Server is already running");
+        return threading::Task::Completed();
+    }
+
+    if (!_onConnectionCallback)
+    {
+        _logger->Error("OnConnection callback is not set");
+        return threading::Task::Completed();
+    }
+
+    if (int r = _ring.Open(RING_ENTRIES); r != 0)
+    {
+        _logger->Error("Failed to set up io_uring: {}", r);
+        return threading::Task::Completed();
+    }
+
+    if (int r = _ring.RegisterBuffers(BUFFER_GROUP, BUFFER_COUNT, BUFFER_SIZE); r != 0)
+    {
+        _logger->Error("Failed to register io_uring buffers: {}", r);
+        _Close();
+        return threading::Task::Completed();
+    }
+
+    _wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (_wakeFd < 0)
+    {
+        _logger->Error("Failed to create eventfd");
+        _Close();
+        return threading::Task::Completed();
+    }
+
+    _OpenSocket();
+    if (!_listenFd)
+    {
+        _logger->Error("Failed to listen on port");
+        _Close();
+        return threading::Task::Completed();
+    }
+
+    if (!_ArmAccept() || !_ArmWake())
+    {
+        _logger->Error("Failed to submit initial requests");
+        _Close();
+        return threading::Task::Completed();
+    }
+
+    _isRunning = true;
+    Ref<threading::Task> task = threading::Task::Create(BIND_FN(_Serve))->StartAsync();
+    _logger->Info("Server started");
+
+    return task;
+}
+
+void UringServer::Stop()
+{
+    _logger->Info("Shutting down {} server", Name());
+    if (!_isRunning)
+    {
+        _logger->Warn("Server is not running");
+    }
+    _isRunning = false;
+
+    // Wake up the ring thread so that it can see the flag.
+    if (_wakeFd >= 0)
+    {
+        eventfd_write(_wakeFd, 1);
+    }
+}
+
+void UringServer::_Serve()
+{
+    static constexpr unsigned MAX_COMPLETIONS = 64;
+
+    uring::Completion completions[MAX_COMPLETIONS];
+
+    _PinReactor(*_config);
+    while (_isRunning)
+    {
+        int r = _ring.Submit(1);
+        if ((r < 0) && (r != -EINTR) && (r != -EBUSY) && (r != -EAGAIN))
+        {
+            _logger->Error("Failed to submit io_uring requests: {}", r);
+            _logger->Error("Unable to serve, shutting down server");
+            Stop(); // call stop to shut down gracefully
+            break;
+        }
+
+        unsigned count;
+        while ((count = _ring.Reap(completions, MAX_COMPLETIONS)) > 0)
+        {
+            for (unsigned i = 0; i < count; i++)
+            {
+                _OnCompletion(completions[i]);
+            }
+        }
+    }
+
+    // Wait for in-flight requests before tearing down their connections.
+    _threadPool.reset();
+
+    _logger->Debug("Closing io_uring and server socket");
+    _Close();
+
+    _logger->Info("{} server shut down", Name());
+}
+
+void UringServer::_OnCompletion(const uring::Completion& completion)
+{
+    int fd = DecodeFd(completion.UserData);
+    switch (DecodeOperation(completion.UserData))
+    {
+    case Operation::Accept:
+        _OnAccept(completion);
+        break;
+    case Operation::Receive:
+        _OnReceive(fd, completion);
+        break;
+    case Operation::Wake:
+        _OnWake(completion);
+        break;
+    case Operation::Close:
+        _OnClose(fd, completion);
+        break;
+    case Operation::Send:
+        if (completion.Result < 0)
+        {
+            _logger->Debug("Failed to send response: {}", completion.Result);
+        }
+        if ((static_cast<size_t>(fd) < _connections.size()) && _connections[fd] && _connections[fd]->CloseOnSend)
+        {
+            network::CloseSocket(fd);
+            _connections[fd].reset();
+        }
+        break;
+    case Operation::Cancel:
+        // Nothing to do, the cancelled request completes on its own.
+        break;
+    default:
+        MINET_ASSERT(false, "Unknown io_uring operation");
+        break;
+    }
+}
+
+void UringServer::_OnAccept(const uring::Completion& completion)
+{
+    if (completion.Result >= 0)
+    {
+        int fd = completion.Result;
+        network::TuneSocket(fd, _config->Socket);
+        if (static_cast<size_t>(fd) >= _connections.size())
+        {
+            _connections.resize(std::max(static_cast<size_t>(fd) + 1, _connections.size() * 2));
+        }
+
+        // A connection on the same fd may still be waiting for its close
+        // completion, it will not touch the new one as it is not closing.
+        _connections[fd] = CreateRef<Connection>(fd);
+        if (!_ArmReceive(fd))
+        {
+            _logger->Error("Failed to monitor new connection");
+            network::CloseSocket(fd);
+            _connections[fd].reset();
+        }
+    }
+    else if (completion.Result != -ECANCELED)
+    {
+        _logger->Error("Failed to accept connection: {}", completion.Result);
+    }
+
+    if (!uring::HasMore(completion) && _isRunning)
+    {
+        if (!_ArmAccept())
+        {
+            _logger->Error("Failed to accept new connections");
+        }
+    }
+}
+
+void UringServer::_OnReceive(int fd, const uring::Completion& completion)
+{
+    int bufferId = uring::BufferId(completion);
+    Ref<Connection> connection = (static_cast<size_t>(fd) < _connections.size()) ? _connections[fd] : nullptr;
+    bool active = connection && !connection->Busy && !connection->Closing;
+
+    if (bufferId >= 0)
+    {
+        if (active && (completion.Result > 0))
+        {
+            connection->Stream->Feed(_ring.GetBuffer(bufferId), completion.Result);
+        }
+        _ring.RecycleBuffer(bufferId);
+    }
+
+    if (!active)
+    {
+        // Late completion of a request that we have cancelled.
+        return;
+    }
+
+    if (completion.Result == 0)
+    {
+        // Peer closed the connection.
+        _CloseConnection(connection);
+        return;
+    }
+    if (completion.Result < 0)
+    {
+        if (completion.Result == -ENOBUFS)
+        {
+            // Ran out of provided buffers, just wait for the next round.
+            _logger->Debug("Receive buffers exhausted");
+        }
+        else
+        {
+            _logger->Error("Failed to receive request: {}", completion.Result);
+            _CloseConnection(connection);
+            return;
+        }
+    }
+    else
+    {
+        _Parse(connection);
+    }
+
+    if (!connection->Busy && !connection->Closing && !uring::HasMore(completion))
+    {
+        if (!_ArmReceive(fd))
+        {
+            _logger->Error("Failed to receive request");
+            _CloseConnection(connection);
+        }
+    }
+}
+
+void UringServer::_OnWake(const uring::Completion& completion)
+{
+    if (completion.Result < 0)
+    {
+        _logger->Error("Failed to read eventfd: {}", completion.Result);
+    }
+
+    std::vector<Ref<Connection>> completed;
+    {
+        std::lock_guard<std::mutex> lock(_completedMutex);
+        completed.swap(_completed);
+    }
+    for (auto& connection : completed)
+    {
+        _Respond(connection);
+    }
+
+    if (_isRunning && !_ArmWake())
+    {
+        _logger->Error("Failed to monitor eventfd");
+    }
+}
+
+void UringServer::_OnClose(int fd, const uring::Completion& completion)
+{
+    if (completion.Result == -ECANCELED)
+    {
+        // The linked send failed, so the close did not run.
+        network::CloseSocket(fd);
+    }
+    else if (completion.Result < 0)
+    {
+        _logger->Error("Failed to close connection: {}", completion.Result);
+    }
+
+    if ((static_cast<size_t>(fd) < _connections.size()) && _connections[fd] && _connections[fd]->Closing)
+    {
+        _connections[fd].reset();
+    }
+}
+
+void UringServer::_Parse(const Ref<Connection>& connection)
+{
+    int r = connection->Builder->Parse();
+    if (r == 1)
+    {
+        connection->Busy = true;
+
+        // Stop receiving, the connection is closed after the response.
+        _ring.PrepareCancel(Encode(Operation::Receive, connection->Fd), Encode(Operation::Cancel, connection->Fd),
+                            false);
+
+        Ref<HttpContext> context = connection->Builder->GetContext();
+        _DecorateContext(context);
+
+        // Cheap handlers are not worth the queue and the wake-up of a worker.
+        if (_isInlineCallback && _isInlineCallback(context))
+        {
+            _onConnectionCallback(context);
+            _Respond(connection);
+            return;
+        }
+
+        // Clients of requests queued for too long may have given up.
+        bool submitted = _threadPool->Submit([this, context, connection, queued = _Now()] {
+            int64_t now = _Now();
+            if (_codel && _codel->ShouldDrop(now - queued, now))
+            {
+                connection->Stream->Output() = _overloadResponse;
+            }
+            else
+            {
+                _onConnectionCallback(context);
+            }
+            {
+                std::lock_guard<std::mutex> lock(_completedMutex);
+                _completed.push_back(connection);
+            }
+            eventfd_write(_wakeFd, 1);
+        });
+        if (!submitted)
+        {
+            // Tell the client to come back later, rather than resetting it.
+            _logger->Debug("Server overwhelmed, request rejected");
+            connection->Stream->Output() = _overloadResponse;
+            _Respond(connection);
+        }
+    }
+    else if (r < 0)
+    {
+        // error occurred
+        _logger->Error("Failed to create HTTP context: {}", r);
+        _CloseConnection(connection);
+    }
+    // else, continue parsing
+}
+
+void UringServer::_Respond(const Ref<Connection>& connection)
+{
+    const std::string& output = connection->Stream->Output();
+    if (output.empty())
+    {
+        _CloseConnection(connection);
+        return;
+    }
+
+    int fd = connection->Fd;
+    if (!_ring.Reserve(2) || !_ring.PrepareSend(fd, output.data(), output.size(), Encode(Operation::Send, fd), true))
+    {
+        // Nothing is queued, so nothing refers to the output.
+        _logger->Error("Failed to send response");
+        network::CloseSocket(fd);
+        _connections[fd].reset();
+        return;
+    }
+
+    connection->Closing = true;
+    if (!_ring.PrepareClose(fd, Encode(Operation::Close, fd)))
+    {
+        // Not after Reserve, but if so, the kernel may still be sending the
+        // output, so keep it until the send completes.
+        _logger->Error("Failed to close connection");
+        connection->CloseOnSend = true;
+    }
+}
+
+void UringServer::_CloseConnection(const Ref<Connection>& connection)
+{
+    int fd = connection->Fd;
+    if (!_ring.Reserve(2) || !_ring.PrepareCancel(Encode(Operation::Receive, fd), Encode(Operation::Cancel, fd), true))
+    {
+        // Nothing is queued, and the receive has no output to free.
+        network::CloseSocket(fd);
+        _connections[fd].reset();
+        return;
+    }
+
+    connection->Closing = true;
+    if (!_ring.PrepareClose(fd, Encode(Operation::Close, fd)))
+    {
+        // Not after Reserve, but if so, keep the connection closing so that
+        // late receives are ignored, until a new one takes its place.
+        _logger->Error("Failed to close connection");
+        network::CloseSocket(fd);
+    }
+}
+
+bool UringServer::_ArmAccept()
+{
+    return _ring.PrepareMultishotAccept(_listenFd, Encode(Operation::Accept, _listenFd));
+}
+
+bool UringServer::_ArmReceive(int fd)
+{
+    return _ring.PrepareMultishotRecv(fd, BUFFER_GROUP, Encode(Operation::Receive, fd));
+}
+
+bool UringServer::_ArmWake()
+{
+    return _ring.PrepareRead(_wakeFd, &_wakeValue, sizeof(_wakeValue), Encode(Operation::Wake, _wakeFd));
+}
+
+void UringServer::_DecorateContext(const Ref<HttpContext>& context) const
+{
+    context->Response.Headers["Server"] = Name();
+}
+
+void UringServer::_OpenSocket()
+{
+    _listenFd = OpenListenSocket(*_config);
+    if (_listenFd < 0)
+    {
+        _logger->Error("Failed to open socket: {}", _listenFd);
+        _listenFd = 0;
+    }
+}
+
+void UringServer::_CloseSocket()
+{
+    if (_listenFd == 0)
+    {
+        return;
+    }
+
+    if (network::CloseSocket(_listenFd) != 0)
+    {
+        _logger->Error("Failed to close socket");
+    }
+    _listenFd = 0;
+}
+
+void UringServer::_Close()
+{
+    // Tear down the ring first, so that nothing is in flight on the fds.
+    _ring.Close();
+
+    // Closing ones may already be closed by the ring, and their fd reused.
+    for (auto& connection : _connections)
+    {
+        if (connection && !connection->Closing)
+        {
+            network::CloseSocket(connection->Fd);
+        }
+    }
+    _connections.clear();
+    _completed.clear();
+
+    _CloseSocket();
+
+    if (_wakeFd >= 0)
+    {
+        close(_wakeFd);
+        _wakeFd = -1;
+    }
+}
+
+MINET_END
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "core/IServer.h"
+
+#include "threading/ThreadPool.h"
+#include "utils/CoDel.h"
+#include "utils/Uring.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+MINET_BEGIN
+
+/**
+ * @brief Uring server drives all socket I/O with one io_uring.
+ * @note
+ * Connections are accepted with multishot accept, and read with multishot
+ * recv into a provided buffer ring, so one submission serves many events.
+ * Parsed requests are handled in the thread pool, and responses are sent
+ * back with a send linked to the close of the connection.
+ * @note
+ * It requires Linux 6.0 or newer. Check @link IsSupported @endlink first.
+ * @ref man 7 io_uring
+ */
+class UringServer final : public IServer
+{
+    struct Connection;
+
+public:
+    explicit UringServer(const Ref<ServerConfig>& config);
+    ~UringServer() override;
+
+    UringServer(const UringServer&) = delete;
+    UringServer& operator=(const UringServer&) = delete;
+    UringServer(UringServer&&) noexcept = delete;
+    UringServer& operator=(UringServer&&) noexcept = delete;
+
+    static const char* Identifier()
+    {
+        return "Uring";
+    }
+
+    /**
+     * @brief Whether the running kernel has everything this server needs.
+     */
+    static bool IsSupported();
+
+    Ref<threading::Task> StartAsync() override;
+
+    void Stop() override;
+
+    const char* Name() const override
+    {
+        return Identifier();
+    }
+
+    std::vector<int> GetListenSockets() const override
+    {
+        return _listenFd ? std::vector<int>{ _listenFd } : std::vector<int>{};
+    }
+
+private:
+    void _Serve();
+
+    void _OnCompletion(const uring::Completion& completion);
+    void _OnAccept(const uring::Completion& completion);
+    void _OnReceive(int fd, const uring::Completion& completion);
+    void _OnWake(const uring::Completion& completion);
+    void _OnClose(int fd, const uring::Completion& completion);
+
+    void _Parse(const Ref<Connection>& connection);
+    void _Respond(const Ref<Connection>& connection);
+    void _CloseConnection(const Ref<Connection>& connection);
+
+    bool _ArmAccept();
+    bool _ArmReceive(int fd);
+    bool _ArmWake();
+
+    void _DecorateContext(const Ref<HttpContext>& context) const;
+
+    void _OpenSocket();
+    void _CloseSocket();
+
+    void _Close();
+
+private:
+    Ref<ServerConfig> _config;
+
+    Ref<threading::ThreadPool> _threadPool;
+
+    /**
+     * @brief Prepared response to requests shed under overload.
+     */
+    std::string _overloadResponse;
+
+    /**
+     * @brief Drops requests queued for too long, nullptr if disabled.
+     */
+    Ref<CoDel> _codel;
+
+    uring::Ring _ring;
+
+    /**
+     * @brief Connections indexed by fd, grows on demand.
+     * @note Only touched by the ring thread.
+     */
+    std::vector<Ref<Connection>> _connections;
+
+    /**
+     * @brief Connections whose response is ready, handed over by workers.
+     */
+    std::vector<Ref<Connection>> _completed;
+    std::mutex _completedMutex;
+
+    /**
+     * @brief Workers and Stop wake up the ring thread with this eventfd.
+     */
+    int _wakeFd;
+    uint64_t _wakeValue;
+
+    int _listenFd;
+    std::atomic<bool> _isRunning;
+};
+
+MINET_END
@@ -7,6 +7,8 @@
 #include "utils/Network.h"
 
 #include <sstream>
+#include <strings.h>
+#include <unistd.h>
 
 MINET_BEGIN
 
@@ -15,7 +17,7 @@ int CreateHttpContext(const network::AcceptData& data, Ref<HttpContext>* context
     Ref<HttpContext> ctx = CreateRef<HttpContext>();
     Ref<io::Stream> stream = CreateRef<io::SocketStream>(data.SocketFd);
 
-    ctx->Request.Host = network::AddressToHost(data.Address.sin_addr.s_addr, data.Address.sin_port);
+    ctx->Request.Host = network::AddressToHost(reinterpret_cast<const sockaddr*>(&data.Address), data.AddressLength);
     ctx->Request.BodyStream = stream;
 
     ctx->Response.StatusCode = 200;
@@ -52,6 +54,12 @@ int CreateHttpContext(int fd, Ref<HttpContext>* context)
 
 int DestroyHttpContext(const Ref<HttpContext>& context)
 {
+    if (context->KeepAlive)
+    {
+        // The connection is reused by the server.
+        return 0;
+    }
+
     // Even if these two streams can be the same, the stream
     // ensures that double close is OK.
     int r1 = context->Request.BodyStream->Close();
@@ -60,6 +68,14 @@ int DestroyHttpContext(const Ref<HttpContext>& context)
     return (r1 == 0) && (r2 == 0);
 }
 
+FileBody::~FileBody()
+{
+    if (Fd >= 0)
+    {
+        close(Fd);
+    }
+}
+
 std::string HttpRequest::ToString() const
 {
     std::stringstream ss;
@@ -95,6 +111,21 @@ std::string HttpRequest::ToString() const
     return ss.str();
 }
 
+bool HttpRequest::IsKeepAlive() const
+{
+    auto it = Headers.find(http::entities::CONNECTION);
+    if (it == Headers.end())
+    {
+        return Version == http::HttpVersion::HTTP_1_1;
+    }
+    if (strcasecmp(it->second.c_str(), http::entities::CLOSE) == 0)
+    {
+        return false;
+    }
+    return (Version == http::HttpVersion::HTTP_1_1) ||
+           (strcasecmp(it->second.c_str(), http::entities::KEEP_ALIVE) == 0);
+}
+
 std::string HttpResponse::ToString() const
 {
     std::stringstream ss;
@@ -126,17 +157,39 @@ std::string HttpResponse::ToString() const
 }
 
 AsyncHttpContextBuilder::AsyncHttpContextBuilder(const network::AcceptData& data)
-    : _context(CreateRef<HttpContext>()), _parser(&(_context->Request))
+    : AsyncHttpContextBuilder(
+          CreateRef<io::SocketStream>(data.SocketFd),
+          network::AddressToHost(reinterpret_cast<const sockaddr*>(&data.Address), data.AddressLength))
 {
-    Ref<io::Stream> stream = CreateRef<io::SocketStream>(data.SocketFd);
+}
+
+AsyncHttpContextBuilder::AsyncHttpContextBuilder(const Ref<io::Stream>& stream, const std::string& host)
+    : _host(host), _context(CreateRef<HttpContext>()), _parser(&(_context->Request))
+{
+    _InitContext(stream);
+    _reader = CreateRef<io::BufferedStreamReader>(stream);
+}
 
-    _context->Request.Host = network::AddressToHost(data.Address.sin_addr.s_addr, data.Address.sin_port);
+void AsyncHttpContextBuilder::Reset()
+{
+    Ref<io::Stream> stream = _context->Request.BodyStream;
+    _context = CreateRef<HttpContext>();
+    _parser = http::AsyncHttpRequestParser(&(_context->Request));
+    _InitContext(stream);
+}
+
+bool AsyncHttpContextBuilder::IsBuffered() const
+{
+    return _reader->IsBuffered();
+}
+
+void AsyncHttpContextBuilder::_InitContext(const Ref<io::Stream>& stream)
+{
+    _context->Request.Host = _host;
     _context->Request.BodyStream = stream;
 
     _context->Response.StatusCode = 200;
     _context->Response.BodyStream = stream;
-
-    _reader = CreateRef<io::BufferedStreamReader>(stream);
 }
 
 int AsyncHttpContextBuilder::Parse()
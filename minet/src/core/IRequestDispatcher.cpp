@@ -8,6 +8,9 @@
 
 #include "components/LoggerFactory.h"
 
+#include <algorithm>
+#include <string_view>
+
 MINET_BEGIN
 
 IRequestDispatcher::IRequestDispatcher() : _logger(ILoggerFactory::GetDummyLogger())
@@ -15,7 +18,7 @@ IRequestDispatcher::IRequestDispatcher() : _logger(ILoggerFactory::GetDummyLogge
 }
 
 void IRequestDispatcher::RegisterHandler(const std::string& path, http::HttpMethod method,
-                                         const Ref<IRequestHandler>& handler)
+                                         const Ref<IRequestHandler>& handler, bool inlineSafe)
 {
     std::string cleanedPath = http::CleanPath(path);
     auto pathIt = _handlers.find(cleanedPath);
@@ -29,8 +32,32 @@ void IRequestDispatcher::RegisterHandler(const std::string& path, http::HttpMeth
         }
     }
 
-    _handlers[cleanedPath][method] = handler;
-    _logger->Debug("Registered handler for '{} {}'", HttpMethodToString(method), cleanedPath);
+    _handlers[cleanedPath][method] = { handler, inlineSafe };
+    _logger->Debug("Registered {}handler for '{} {}'", inlineSafe ? "inline " : "", HttpMethodToString(method),
+                   cleanedPath);
+}
+
+void IRequestDispatcher::RegisterPrefixHandler(const std::string& prefix, http::HttpMethod method,
+                                               const Ref<IRequestHandler>& handler)
+{
+    std::string cleanedPrefix = http::CleanPath(prefix);
+    auto it = std::find_if(_prefixHandlers.begin(), _prefixHandlers.end(),
+                           [&cleanedPrefix](const auto& entry) { return entry.first == cleanedPrefix; });
+    if (it == _prefixHandlers.end())
+    {
+        it = std::find_if(_prefixHandlers.begin(), _prefixHandlers.end(), [&cleanedPrefix](const auto& entry) {
+            return entry.first.size() < cleanedPrefix.size();
+        });
+        it = _prefixHandlers.insert(it, { cleanedPrefix, RouteMap() });
+    }
+    else if (it->second.find(method) != it->second.end())
+    {
+        _logger->Warn("Handler for '{} {}/*' already registered", HttpMethodToString(method), cleanedPrefix);
+        return;
+    }
+
+    it->second[method] = { handler, false };
+    _logger->Debug("Registered handler for '{} {}/*'", HttpMethodToString(method), cleanedPrefix);
 }
 
 void IRequestDispatcher::RegisterErrorHandler(int statusCode, const Ref<IRequestHandler>& handler)
@@ -50,15 +77,15 @@ void IRequestDispatcher::Dispatch(const Ref<HttpContext>& context)
     _logger->Debug("Dispatching request {}", path);
 
     // Find handler for the path and method.
-    auto pathIt = _handlers.find(path);
+    const RouteMap* routes = _FindRoutes(path);
     Ref<IRequestHandler> handler;
     int statusCode = http::status::OK;
-    if (pathIt != _handlers.end())
+    if (routes)
     {
-        auto methodId = pathIt->second.find(context->Request.Method);
-        if (methodId != pathIt->second.end())
+        auto methodId = routes->find(context->Request.Method);
+        if (methodId != routes->end())
         {
-            handler = methodId->second;
+            handler = methodId->second.Handler;
         }
         else
         {
@@ -120,11 +147,44 @@ void IRequestDispatcher::Dispatch(const Ref<HttpContext>& context)
     _logger->Debug("Request '{}' handled", path);
 }
 
+bool IRequestDispatcher::IsInline(const Ref<HttpContext>& context) const
+{
+    const RouteMap* routes = _FindRoutes(http::CleanPath(context->Request.Path));
+    if (!routes)
+    {
+        return false;
+    }
+    auto methodIt = routes->find(context->Request.Method);
+    return (methodIt != routes->end()) && methodIt->second.Inline;
+}
+
 void IRequestDispatcher::SetLogger(const Ref<Logger>& logger)
 {
     _logger = logger;
 }
 
+const IRequestDispatcher::RouteMap* IRequestDispatcher::_FindRoutes(const std::string& path) const
+{
+    auto pathIt = _handlers.find(path);
+    if (pathIt != _handlers.end())
+    {
+        return &pathIt->second;
+    }
+
+    // The query string is not part of the path to match.
+    std::string_view target(path);
+    target = target.substr(0, target.find('?'));
+    for (const auto& [prefix, routes] : _prefixHandlers)
+    {
+        if ((target.compare(0, prefix.size(), prefix) == 0) &&
+            ((target.size() == prefix.size()) || (target[prefix.size()] == '/')))
+        {
+            return &routes;
+        }
+    }
+    return nullptr;
+}
+
 Ref<IRequestHandler> IRequestDispatcher::_GetErrorHandler(int statusCode)
 {
     auto it = _errorHandlers.find(statusCode);
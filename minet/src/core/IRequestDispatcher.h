@@ -9,6 +9,7 @@
 #include "minet/core/HttpContext.h"
 
 #include <unordered_map>
+#include <vector>
 
 MINET_BEGIN
 
@@ -31,11 +32,22 @@ public:
 
     /**
      * @brief Register a handler for the given path.
+     * @param inlineSafe Whether the handler is cheap enough to run on the
+     * thread that parsed the request, see IsInline.
      * @note
      * If a handler is already registered for the given path, it will
      * be replaced by the new handler.
      */
-    void RegisterHandler(const std::string& path, http::HttpMethod method, const Ref<IRequestHandler>& handler);
+    void RegisterHandler(const std::string& path, http::HttpMethod method, const Ref<IRequestHandler>& handler,
+                         bool inlineSafe = false);
+
+    /**
+     * @brief Register a handler for all paths under the prefix, e.g. static
+     * files.
+     * @note Handlers of exact paths take precedence, then longer prefixes.
+     */
+    void RegisterPrefixHandler(const std::string& prefix, http::HttpMethod method,
+                               const Ref<IRequestHandler>& handler);
 
     void RegisterErrorHandler(int statusCode, const Ref<IRequestHandler>& handler);
 
@@ -47,6 +59,12 @@ public:
      */
     void Dispatch(const Ref<HttpContext>& context);
 
+    /**
+     * @brief Whether the handler of the request is registered as inline-safe,
+     * so that servers may run it right away instead of queueing it.
+     */
+    bool IsInline(const Ref<HttpContext>& context) const;
+
 protected:
     virtual int _InvokeHandler(const Ref<IRequestHandler>& handler, const Ref<HttpContext>& context) = 0;
 
@@ -60,8 +78,25 @@ protected:
     Ref<Logger> _logger;
 
 private:
-    using HandlerRegistry = std::unordered_map<std::string, std::unordered_map<http::HttpMethod, Ref<IRequestHandler>>>;
+    struct Route
+    {
+        Ref<IRequestHandler> Handler;
+        bool Inline;
+    };
+
+    using RouteMap = std::unordered_map<http::HttpMethod, Route>;
+    using HandlerRegistry = std::unordered_map<std::string, RouteMap>;
+
+    /**
+     * @brief Find routes of the path, by exact path first, then by prefix.
+     * @return nullptr if not found.
+     */
+    const RouteMap* _FindRoutes(const std::string& path) const;
+
     HandlerRegistry _handlers;
+
+    // Sorted by length, the longest first.
+    std::vector<std::pair<std::string, RouteMap>> _prefixHandlers;
     std::unordered_map<int, Ref<IRequestHandler>> _errorHandlers;
 };
 
@@ -1,6 +1,14 @@
 #include "core/IServer.h"
 
+#include "minet/common/Http.h"
+#include "minet/components/Logger.h"
+#include "minet/core/HttpContext.h"
+
+#include "io/Stream.h"
 #include "threading/ThreadPool.h"
+#include "utils/Native.h"
+
+#include <sched.h>
 
 MINET_BEGIN
 
@@ -13,6 +21,15 @@ void IServer::SetLogger(const Ref<Logger>& logger)
     _logger = logger;
 }
 
+void IServer::_PinReactor(const ServerConfig& config, unsigned index)
+{
+    int cpu = GetReactorCpu(config, index);
+    if (native::PinThread(cpu) != 0)
+    {
+        _logger->Warn("Failed to pin event loop {} to CPU {}", index, cpu);
+    }
+}
+
 Ref<ServerConfig> LoadServerConfig(const nlohmann::json& config)
 {
     Ref<ServerConfig> serverConfig = CreateRef<ServerConfig>();
@@ -25,6 +42,9 @@ Ref<ServerConfig> LoadServerConfig(const nlohmann::json& config)
         threads = threading::HardwareConcurrency();
     }
     serverConfig->Threads = threads;
+    serverConfig->Processes = config.value("processes", 0u);
+    serverConfig->Workers = config.value("workers", 0u);
+    serverConfig->Acceptors = config.value("acceptors", 0u);
 
     size_t capacity = config.value("capacity", 0u);
     if (capacity == 0)
@@ -33,6 +53,113 @@ Ref<ServerConfig> LoadServerConfig(const nlohmann::json& config)
     }
     serverConfig->Capacity = capacity;
 
+    // Idle connections would hold the workers of Threaded server, see ServerConfig.
+    serverConfig->KeepAlive = config.value("keepAlive", serverConfig->Name != "Threaded");
+    serverConfig->MaxRequests = config.value("maxRequests", 1000u);
+    serverConfig->IdleTimeout = config.value("idleTimeout", 5000u);
+    if (serverConfig->KeepAlive && serverConfig->IdleTimeout == 0)
+    {
+        throw std::runtime_error("Idle timeout must be positive for keep-alive");
+    }
+    serverConfig->HeaderTimeout = config.value("headerTimeout", 10000u);
+    serverConfig->BodyTimeout = config.value("bodyTimeout", 30000u);
+    serverConfig->DrainTimeout = config.value("drainTimeout", 10000u);
+    serverConfig->SpinTime = config.value("spinTime", 0u);
+    serverConfig->Affinity = config.value("affinity", 0u);
+    serverConfig->RetryAfter = config.value("retryAfter", 1u);
+    serverConfig->ParkOverloaded = config.value("parkOverloaded", false);
+    serverConfig->QueueTarget = config.value("queueTarget", 0u);
+    serverConfig->QueueInterval = config.value("queueInterval", 100u);
+    if (serverConfig->QueueTarget > 0 && serverConfig->QueueInterval == 0)
+    {
+        throw std::runtime_error("Queue interval must be positive for queue target");
+    }
+
+    if (auto it = config.find("socket"); it != config.end())
+    {
+        if (!it->is_object())
+        {
+            throw std::runtime_error("Socket profile must be an object");
+        }
+
+        network::SocketProfile& profile = serverConfig->Socket;
+        profile.NoDelay = it->value("noDelay", profile.NoDelay);
+        profile.DeferAccept = it->value("deferAccept", profile.DeferAccept);
+        profile.FastOpen = it->value("fastOpen", profile.FastOpen);
+        profile.Backlog = it->value("backlog", profile.Backlog);
+        if (profile.Backlog == 0)
+        {
+            throw std::runtime_error("Listen backlog must be positive");
+        }
+        profile.ReceiveBuffer = it->value("receiveBuffer", profile.ReceiveBuffer);
+        profile.SendBuffer = it->value("sendBuffer", profile.SendBuffer);
+        profile.QuickAck = it->value("quickAck", profile.QuickAck);
+        profile.KeepAlive = it->value("keepAlive", profile.KeepAlive);
+        profile.BusyPoll = it->value("busyPoll", profile.BusyPoll);
+        profile.ZeroCopy = it->value("zeroCopy", profile.ZeroCopy);
+    }
+
+    if (auto it = config.find("tls"); it != config.end())
+    {
+        if (!it->is_object())
+        {
+            throw std::runtime_error("TLS profile must be an object");
+        }
+
+        io::TlsProfile& profile = serverConfig->Tls;
+        profile.Certificate = it->value("certificate", profile.Certificate);
+        profile.PrivateKey = it->value("privateKey", profile.PrivateKey);
+        profile.SessionCache = it->value("sessionCache", profile.SessionCache);
+        profile.SessionTickets = it->value("sessionTickets", profile.SessionTickets);
+        profile.TicketKey = it->value("ticketKey", profile.TicketKey);
+        if (profile.IsEnabled())
+        {
+            if (!io::TlsContext::IsSupported())
+            {
+                throw std::runtime_error("TLS is not supported by this build");
+            }
+            if (serverConfig->Name != "Mayhem")
+            {
+                throw std::runtime_error("TLS is only supported by Mayhem server");
+            }
+        }
+    }
+
+    if (auto it = config.find("cpus"); it != config.end())
+    {
+        if (it->is_string())
+        {
+            if (it->get<std::string>() != "auto")
+            {
+                throw std::runtime_error("CPUs must be \"auto\" or a list of CPU numbers");
+            }
+            serverConfig->Cpus = native::GetAllowedCpus();
+        }
+        else if (it->is_array())
+        {
+            for (const auto& cpu : *it)
+            {
+                if (!cpu.is_number_integer() || cpu.get<int>() < 0 || cpu.get<int>() >= CPU_SETSIZE)
+                {
+                    throw std::runtime_error("Invalid CPU number: " + cpu.dump());
+                }
+                serverConfig->Cpus.push_back(cpu.get<int>());
+            }
+        }
+        else if (!it->is_null())
+        {
+            throw std::runtime_error("CPUs must be \"auto\" or a list of CPU numbers");
+        }
+    }
+
+    serverConfig->UnixSocket = config.value("unixSocket", "");
+    if (!serverConfig->UnixSocket.empty())
+    {
+        // So that accepted sockets are not tuned with TCP options in vain.
+        serverConfig->Socket.NoDelay = false;
+        serverConfig->Socket.QuickAck = false;
+    }
+
     int port = config.value("port", 5000);
     if (port <= 0 || port > 65535)
     {
@@ -43,4 +170,72 @@ Ref<ServerConfig> LoadServerConfig(const nlohmann::json& config)
     return serverConfig;
 }
 
+int OpenListenSocket(const ServerConfig& config, bool reusePort)
+{
+    if (!config.UnixSocket.empty())
+    {
+        return network::OpenUnixSocket(config.UnixSocket, false, config.Socket);
+    }
+    return network::OpenSocket(config.Port, false, reusePort, config.Socket);
+}
+
+std::string MakeOverloadResponse(const ServerConfig& config, const char* server, bool keepAlive)
+{
+    using namespace http;
+    using namespace http::entities;
+
+    std::string response;
+    response.append(HTTP_VERSION).append(SPACE);
+    response.append(std::to_string(status::SERVICE_UNAVAILABLE)).append(SPACE);
+    response.append(StatusCodeToDescription(status::SERVICE_UNAVAILABLE)).append(NEW_LINE);
+    response.append(CONTENT_LENGTH).append(COLON).append("0").append(NEW_LINE);
+    response.append(CONNECTION).append(COLON).append(keepAlive ? KEEP_ALIVE : CLOSE).append(NEW_LINE);
+    response.append(RETRY_AFTER).append(COLON).append(std::to_string(config.RetryAfter)).append(NEW_LINE);
+    response.append("Server").append(COLON).append(server).append(NEW_LINE);
+    response.append(NEW_LINE);
+    return response;
+}
+
+int EnableZeroCopy(const ServerConfig& config, const Ref<HttpContext>& context)
+{
+    if (config.Socket.ZeroCopy == 0)
+    {
+        return 0;
+    }
+
+    auto stream = std::dynamic_pointer_cast<io::SocketStream>(context->Response.BodyStream);
+    if (!stream)
+    {
+        return 0;
+    }
+    return stream->EnableZeroCopy(config.Socket.ZeroCopy);
+}
+
+int GetReactorCpu(const ServerConfig& config, unsigned index)
+{
+    if (config.Cpus.empty())
+    {
+        return -1;
+    }
+    return config.Cpus[index % config.Cpus.size()];
+}
+
+std::vector<int> GetWorkerCpus(const ServerConfig& config, unsigned reactors)
+{
+    if (config.Cpus.size() <= reactors)
+    {
+        return config.Cpus;
+    }
+    return std::vector<int>(config.Cpus.begin() + reactors, config.Cpus.end());
+}
+
+std::string GetListenAddress(const ServerConfig& config)
+{
+    if (!config.UnixSocket.empty())
+    {
+        return "unix:" + config.UnixSocket;
+    }
+    return "port " + std::to_string(config.Port);
+}
+
 MINET_END
@@ -7,9 +7,13 @@
 
 #include "minet/core/ILoggerFactory.h"
 
+#include "io/TlsStream.h"
+#include "utils/Network.h"
+
 #include <nlohmann/json.hpp>
 
 #include <functional>
+#include <vector>
 
 MINET_BEGIN
 
@@ -26,7 +30,8 @@ struct ServerConfig
 {
     /**
      * @brief Which server to use.
-     * @note Can be "Basic" or "Mayhem".
+     * @note Can be "Basic", "Threaded", "Mayhem", "Sharded" or "Uring".
+     * @note "Uring" falls back to "Mayhem" if io_uring is not supported.
      */
     std::string Name;
 
@@ -35,15 +40,138 @@ struct ServerConfig
      */
     uint16_t Port;
 
+    /**
+     * @brief Listen on a Unix domain socket instead of the port, if not empty.
+     * @note A path, or a Linux abstract name starting with '@'.
+     */
+    std::string UnixSocket;
+
     /**
      * @brief The number of threads to use if the server supports multi-threading.
+     * @note For Sharded server, this is the number of shards.
      */
     unsigned Threads;
 
+    /**
+     * @brief The number of worker processes, each running its own server.
+     * @note 0 or 1 to serve in this process.
+     */
+    unsigned Processes;
+
+    /**
+     * @brief The number of handler threads owned by each shard.
+     * @note Only used by Sharded server, 0 to run handlers on the shard thread.
+     */
+    unsigned Workers;
+
+    /**
+     * @brief The number of threads accepting new connections.
+     * @note Only used by Mayhem server, 0 to accept on the event loop.
+     */
+    unsigned Acceptors;
+
     /**
      * @brief Request queue size for each thread.
      */
     size_t Capacity;
+
+    /**
+     * @brief Whether to keep connections open between requests.
+     * @note Only used by Threaded and Mayhem server for now.
+     * @note
+     * Off by default for Threaded server, which waits for the next request
+     * on the worker of the connection. So each idle connection holds a
+     * worker for up to IdleTimeout, and a few of them can starve the pool.
+     * Turn it on only if clients are few and busy, to save the handshakes.
+     * Mayhem server waits on its event loop, so idle connections are cheap.
+     */
+    bool KeepAlive;
+
+    /**
+     * @brief Maximum requests served on one connection, 0 for no limit.
+     */
+    unsigned MaxRequests;
+
+    /**
+     * @brief Close a kept-alive connection if idle for this long, in ms.
+     */
+    unsigned IdleTimeout;
+
+    /**
+     * @brief Time allowed to receive all headers of a request, in ms, 0 for no limit.
+     * @note Only used by Mayhem server for now.
+     */
+    unsigned HeaderTimeout;
+
+    /**
+     * @brief Time allowed to receive the body after headers, in ms, 0 for no limit.
+     * @note Only used by Mayhem server for now.
+     */
+    unsigned BodyTimeout;
+
+    /**
+     * @brief Time allowed for in-flight requests on graceful shutdown, in ms.
+     * @note Only used by Mayhem, Threaded and Sharded server for now, 0 to stop at once.
+     */
+    unsigned DrainTimeout;
+
+    /**
+     * @brief Time event loops and idle pool workers spin before blocking, in us.
+     * @note 0 to block at once. Event loops of Uring server never spin.
+     */
+    unsigned SpinTime;
+
+    /**
+     * @brief CPUs to pin event loops and pool workers to, empty to let them float.
+     * @note Event loops take the first CPUs, and workers take the rest.
+     */
+    std::vector<int> Cpus;
+
+    /**
+     * @brief Pending requests at which a handler thread is overloaded, 0 to
+     * spread requests of one connection over all handler threads.
+     * @note
+     * Only used by Mayhem server. Requests of one connection go to
+     * the same thread, and other threads only take them once it is overloaded.
+     */
+    unsigned Affinity;
+
+    /**
+     * @brief Seconds for clients to wait before retrying a request shed
+     * with 503 under overload.
+     */
+    unsigned RetryAfter;
+
+    /**
+     * @brief Park requests that no handler thread can take, and retry them
+     * later instead of answering 503.
+     * @note Only used by Mayhem server for now.
+     */
+    bool ParkOverloaded;
+
+    /**
+     * @brief Acceptable time for a request to wait for a handler thread, in
+     * ms, 0 to never drop requests.
+     * @note
+     * Only used by Mayhem and Uring server. Once requests wait longer than
+     * this for QueueInterval, some of them are dropped with 503, see CoDel.
+     * @note
+     * Once the oldest request waits longer than this, the newest ones are
+     * handled first, see threading::AdaptiveQueue.
+     */
+    unsigned QueueTarget;
+    unsigned QueueInterval;
+
+    /**
+     * @brief Options of listen sockets and accepted connections.
+     */
+    network::SocketProfile Socket;
+
+    /**
+     * @brief Terminate TLS on accepted connections, if a certificate is set.
+     * @note Only used by Mayhem server for now.
+     */
+    io::TlsProfile Tls;
 };
 
 /**
@@ -57,6 +185,7 @@ class IServer
 
 public:
     using OnConnectionCallback = std::function<void(const Ref<HttpContext>&)>;
+    using IsInlineCallback = std::function<bool(const Ref<HttpContext>&)>;
 
     IServer();
     virtual ~IServer() = default;
@@ -74,20 +203,54 @@ public:
 
     virtual void Stop() = 0;
 
+    /**
+     * @brief Stop accepting new connections, and stop once in-flight
+     * requests are finished.
+     * @note Servers that cannot drain simply stop.
+     */
+    virtual void Drain()
+    {
+        Stop();
+    }
+
     virtual const char* Name() const = 0;
 
+    /**
+     * @brief Get the sockets the server is listening on, to hand them over
+     * to another process on hot restart.
+     * @note Empty if the server is not running.
+     */
+    virtual std::vector<int> GetListenSockets() const = 0;
+
     void SetOnConnection(const OnConnectionCallback& callback)
     {
         _onConnectionCallback = callback;
     }
 
+    /**
+     * @brief Tell whether a request may be handled on the thread that parsed it.
+     * @note Servers that always queue requests may ignore it.
+     */
+    void SetIsInline(const IsInlineCallback& callback)
+    {
+        _isInlineCallback = callback;
+    }
+
 private:
     // Only used by WebHostBuilder.
     void SetLogger(const Ref<Logger>& logger);
 
+protected:
+    /**
+     * @brief Pin the calling event loop thread to its CPU, if configured.
+     * @param index Index of the event loop, see GetReactorCpu.
+     */
+    void _PinReactor(const ServerConfig& config, unsigned index = 0);
+
 protected:
     Ref<Logger> _logger;
     OnConnectionCallback _onConnectionCallback;
+    IsInlineCallback _isInlineCallback;
 };
 
 /**
@@ -98,4 +261,49 @@ protected:
  */
 Ref<ServerConfig> LoadServerConfig(const nlohmann::json& config);
 
+/**
+ * @brief Open the listen socket of the configuration, on the port or the
+ * Unix domain socket.
+ * @param config The server configuration.
+ * @param reusePort Whether to set SO_REUSEPORT, ignored for Unix domain sockets.
+ * @return The non-blocking listen socket, < 0 on failure.
+ */
+int OpenListenSocket(const ServerConfig& config, bool reusePort = false);
+
+/**
+ * @brief Make the response to requests shed under overload, i.e. 503 with
+ * Retry-After, so that servers can prepare it once.
+ * @param server Value of the Server header.
+ * @param keepAlive Whether the connection is kept alive after it.
+ */
+std::string MakeOverloadResponse(const ServerConfig& config, const char* server, bool keepAlive);
+
+/**
+ * @brief Send large bodies of the response with MSG_ZEROCOPY, if enabled
+ * in the socket profile.
+ * @note Only for contexts writing to the socket directly.
+ * @return 0 on success or if not enabled, < 0 on failure.
+ */
+int EnableZeroCopy(const ServerConfig& config, const Ref<HttpContext>& context);
+
+/**
+ * @brief Get the CPU of an event loop thread.
+ * @param index Index of the event loop, e.g. the shard id.
+ * @return The CPU, or -1 if threads are not pinned.
+ */
+int GetReactorCpu(const ServerConfig& config, unsigned index = 0);
+
+/**
+ * @brief Get the CPUs of pool workers, those left by event loops.
+ * @param reactors The number of event loop threads.
+ * @note If event loops take all CPUs, workers share them all.
+ */
+std::vector<int> GetWorkerCpus(const ServerConfig& config, unsigned reactors = 1);
+
+/**
+ * @brief Describe where the server listens, for logging.
+ * @return e.g. "port 5000" or "unix:/run/minet.sock".
+ */
+std::string GetListenAddress(const ServerConfig& config);
+
 MINET_END
@@ -7,13 +7,73 @@
 
 #include "threading/Task.h"
 #include "utils/Native.h"
+#include "utils/Network.h"
+
+#include <algorithm>
+#include <chrono>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
 
 MINET_BEGIN
 
+// Tells a process spawned for hot restart where to get the listen sockets.
+static const char* const HANDOVER_ENV = "MINET_HANDOVER_FD";
+
+// Tells a worker process of prefork mode the listen socket of the master.
+static const char* const WORKER_ENV = "MINET_WORKER_FD";
+
+// Time allowed for the new process to start serving, in milliseconds.
+static constexpr int HANDOVER_TIMEOUT = 30000;
+
+// A worker crashing sooner than this after start is restarted this late.
+static constexpr int64_t RESPAWN_DELAY = 1000;
+
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
 void WebHost::Run() const
 {
     _logger->Info("Starting web host");
-    _server->StartAsync()->Await();
+
+    // Signals are blocked since WebHostBuilder is created, and received
+    // here instead of in a signal handler.
+    native::BlockSignals({ SIGINT, SIGTERM, SIGUSR2, SIGCHLD });
+    int signalFd = native::OpenSignalFd({ SIGINT, SIGTERM, SIGUSR2, SIGCHLD });
+    if (signalFd < 0)
+    {
+        _logger->Error("Failed to open signalfd, signals are ignored");
+    }
+
+    // A worker process shares the listen socket of its master.
+    int listenFd = native::TakeSpawnedFd(WORKER_ENV);
+    if (listenFd >= 0)
+    {
+        network::InheritSockets({ listenFd });
+    }
+
+    int channel = _TakeOver();
+    unsigned processes = _container->Resolve<ServerConfig>()->Processes;
+    if ((listenFd < 0) && (processes > 1))
+    {
+        _RunMaster(signalFd, channel, processes);
+    }
+    else
+    {
+        // A worker is restarted by its master instead.
+        _RunServer(signalFd, channel, listenFd < 0);
+    }
+
+    if (signalFd >= 0)
+    {
+        close(signalFd);
+    }
+
     _logger->Info("Web host stopped");
     _logger->Info("See you next time!");
 }
@@ -27,13 +87,284 @@ WebHost::WebHost(const Ref<IServer>& server, const Ref<IRequestDispatcher>& disp
     MINET_ASSERT(container);
 
     _server->SetOnConnection([this](const Ref<HttpContext>& context) { _dispatcher->Dispatch(context); });
-    native::SetSignalHandler(SIGINT, BIND_FN(_OnInterrupted));
+    _server->SetIsInline([this](const Ref<HttpContext>& context) { return _dispatcher->IsInline(context); });
+}
+
+void WebHost::_RunServer(int signalFd, int channel, bool restartable) const
+{
+    int wakeFd = eventfd(0, EFD_CLOEXEC);
+    Ref<threading::Task> watcher;
+    if ((signalFd >= 0) && (wakeFd >= 0))
+    {
+        watcher = threading::Task::Create([this, signalFd, wakeFd, restartable] {
+                      _WatchSignals(signalFd, wakeFd, restartable);
+                  })->StartAsync();
+    }
+
+    Ref<threading::Task> task = _server->StartAsync();
+
+    // Sockets of a different server configuration are not adopted.
+    network::CloseInheritedSockets();
+    _FinishTakeOver(channel, !_server->GetListenSockets().empty());
+
+    task->Await();
+
+    if (watcher)
+    {
+        eventfd_write(wakeFd, 1);
+        watcher->Await();
+    }
+    if (wakeFd >= 0)
+    {
+        close(wakeFd);
+    }
+}
+
+void WebHost::_RunMaster(int signalFd, int channel, unsigned processes) const
+{
+    Ref<ServerConfig> config = _container->Resolve<ServerConfig>();
+
+    // Reuse the port, so that workers of Sharded server can add their own.
+    int listenFd = OpenListenSocket(*config, true);
+    network::CloseInheritedSockets();
+    _FinishTakeOver(channel, listenFd >= 0);
+    if (listenFd < 0)
+    {
+        _logger->Error("Failed to listen on {}", GetListenAddress(*config));
+        return;
+    }
+    if (signalFd < 0)
+    {
+        network::CloseSocket(listenFd);
+        return;
+    }
+
+    _logger->Info("Starting {} worker processes on {}", processes, GetListenAddress(*config));
+
+    // Start time of each worker, and when to start the missing ones.
+    std::unordered_map<pid_t, int64_t> workers;
+    std::vector<int64_t> pending(processes, _Now());
+    bool stopping = false;
+
+    while (!stopping || !workers.empty())
+    {
+        int64_t now = _Now();
+        int timeout = -1;
+        std::vector<int64_t> later;
+        for (int64_t due : pending)
+        {
+            if (due > now)
+            {
+                later.push_back(due);
+                continue;
+            }
+
+            pid_t pid = native::SpawnSelf(listenFd, WORKER_ENV, true);
+            if (pid < 0)
+            {
+                _logger->Error("Failed to start worker process");
+                later.push_back(now + RESPAWN_DELAY);
+                continue;
+            }
+            _logger->Debug("Worker {} started", pid);
+            workers[pid] = now;
+        }
+        pending.swap(later);
+        for (int64_t due : pending)
+        {
+            int left = static_cast<int>(due - now);
+            timeout = (timeout < 0) ? left : std::min(timeout, left);
+        }
+
+        if (network::WaitSocket(signalFd, -1, timeout) != 1)
+        {
+            continue;
+        }
+
+        int sig = native::ReadSignal(signalFd);
+        if (sig == SIGCHLD)
+        {
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                auto it = workers.find(pid);
+                if (it == workers.end())
+                {
+                    continue;
+                }
+                int64_t started = it->second;
+                workers.erase(it);
+                if (stopping)
+                {
+                    _logger->Debug("Worker {} exited", pid);
+                    continue;
+                }
+
+                if (WIFSIGNALED(status))
+                {
+                    _logger->Warn("Worker {} killed by signal {}, restarting", pid, WTERMSIG(status));
+                }
+                else
+                {
+                    _logger->Warn("Worker {} exited with code {}, restarting", pid, WEXITSTATUS(status));
+                }
+                pending.push_back(std::max(_Now(), started + RESPAWN_DELAY));
+            }
+        }
+        else if ((sig == SIGINT) || (sig == SIGTERM))
+        {
+            // Workers do not get signals from the terminal, so pass them on.
+            _logger->Warn("{} received, stopping workers", (sig == SIGINT) ? "^C" : "SIGTERM");
+            stopping = true;
+            pending.clear();
+            for (const auto& worker : workers)
+            {
+                kill(worker.first, sig);
+            }
+        }
+        else if (sig == SIGUSR2)
+        {
+            if (stopping)
+            {
+                _logger->Warn("Already stopping, hot restart ignored");
+            }
+            else if (_HotRestart({ listenFd }))
+            {
+                stopping = true;
+                pending.clear();
+                for (const auto& worker : workers)
+                {
+                    kill(worker.first, SIGTERM);
+                }
+            }
+        }
+    }
+
+    network::CloseSocket(listenFd);
 }
 
-void WebHost::_OnInterrupted() const
+void WebHost::_WatchSignals(int signalFd, int wakeFd, bool restartable) const
 {
-    _logger->Warn("^C received, stopping");
-    _server->Stop();
+    bool draining = false;
+    while (network::WaitSocket(signalFd, wakeFd) == 1)
+    {
+        int sig = native::ReadSignal(signalFd);
+        if (sig == SIGUSR2)
+        {
+            if (!restartable)
+            {
+                _logger->Warn("Hot restart is left to the master process");
+            }
+            else if (draining)
+            {
+                _logger->Warn("Already draining, hot restart ignored");
+            }
+            else if (_HotRestart(_server->GetListenSockets()))
+            {
+                draining = true;
+                _server->Drain();
+            }
+        }
+        else if ((sig == SIGTERM) && !draining)
+        {
+            // Another signal during the drain stops the server at once.
+            _logger->Warn("SIGTERM received, draining");
+            draining = true;
+            _server->Drain();
+        }
+        else if ((sig == SIGINT) || (sig == SIGTERM))
+        {
+            _logger->Warn("{} received, stopping", (sig == SIGINT) ? "^C" : "SIGTERM");
+            _server->Stop();
+        }
+    }
+}
+
+int WebHost::_TakeOver() const
+{
+    int channel = native::TakeSpawnedFd(HANDOVER_ENV);
+    if (channel < 0)
+    {
+        return -1;
+    }
+
+    std::vector<int> fds;
+    if (network::ReceiveSockets(channel, &fds) == 0)
+    {
+        _logger->Info("Took over {} listen sockets", fds.size());
+        network::InheritSockets(fds);
+    }
+    else
+    {
+        _logger->Error("Failed to receive listen sockets");
+    }
+
+    return channel;
+}
+
+void WebHost::_FinishTakeOver(int channel, bool serving) const
+{
+    if (channel < 0)
+    {
+        return;
+    }
+
+    // Tell the previous process to drain only if we are serving.
+    if (serving)
+    {
+        char ready = 1;
+        if (write(channel, &ready, 1) != 1)
+        {
+            _logger->Error("Failed to notify previous process");
+        }
+    }
+    close(channel);
+}
+
+bool WebHost::_HotRestart(const std::vector<int>& fds) const
+{
+    _logger->Warn("SIGUSR2 received, hot restarting");
+
+    if (fds.empty())
+    {
+        _logger->Error("No listen socket to hand over");
+        return false;
+    }
+
+    int channels[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channels) != 0)
+    {
+        _logger->Error("Failed to create handover channel");
+        return false;
+    }
+
+    pid_t pid = native::SpawnSelf(channels[1], HANDOVER_ENV);
+    close(channels[1]);
+    if (pid < 0)
+    {
+        _logger->Error("Failed to spawn new process");
+        close(channels[0]);
+        return false;
+    }
+
+    // The sockets stay open here until the drain, so both processes accept
+    // from the same queue for a while and no connection is refused.
+    char ready = 0;
+    bool success = (network::SendSockets(channels[0], fds) == 0) &&
+                   (network::WaitSocket(channels[0], -1, HANDOVER_TIMEOUT) == 1) && (read(channels[0], &ready, 1) == 1);
+    close(channels[0]);
+
+    if (!success)
+    {
+        _logger->Error("New process {} failed to take over, keep serving", pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return false;
+    }
+
+    _logger->Info("Handed over {} listen sockets to process {}, draining", fds.size(), pid);
+    return true;
 }
 
 MINET_END
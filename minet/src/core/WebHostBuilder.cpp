@@ -5,17 +5,24 @@
 #include "minet/version.h"
 
 #include "components/LoggerFactory.h"
+#include "components/EmbeddedAssetHandler.h"
 #include "components/RequestDispatcher.h"
+#include "components/StaticFileHandler.h"
 
 #include "components/BasicServer.h"
 #include "components/MayhemServer.h"
+#include "components/ShardedServer.h"
 #include "components/ThreadedServer.h"
+#include "components/UringServer.h"
 
 #include "impl/DefaultHandlers.h"
 
+#include "utils/Native.h"
+
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <string_view>
 
 MINET_BEGIN
 
@@ -28,6 +35,9 @@ WebHostBuilder::WebHostBuilder(Private) : _container(mioc::ServiceContainer::New
 
 Ref<WebHostBuilder> WebHostBuilder::Create()
 {
+    // WebHost receives these from a signalfd, so they must be blocked
+    // before any server thread is started to inherit the mask.
+    native::BlockSignals({ SIGINT, SIGTERM, SIGUSR2, SIGCHLD });
     return CreateRef<WebHostBuilder>(Private());
 }
 
@@ -54,24 +64,25 @@ Ref<WebHostBuilder> WebHostBuilder::UseAppSettings(const std::string& path)
     return shared_from_this();
 }
 
-Ref<WebHostBuilder> WebHostBuilder::Get(const std::string& path, const Ref<IRequestHandler>& handler)
+Ref<WebHostBuilder> WebHostBuilder::Get(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe)
 {
-    return _RegisterHandler(path, http::HttpMethod::GET, handler);
+    return _RegisterHandler(path, http::HttpMethod::GET, handler, inlineSafe);
 }
 
-Ref<WebHostBuilder> WebHostBuilder::Post(const std::string& path, const Ref<IRequestHandler>& handler)
+Ref<WebHostBuilder> WebHostBuilder::Post(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe)
 {
-    return _RegisterHandler(path, http::HttpMethod::POST, handler);
+    return _RegisterHandler(path, http::HttpMethod::POST, handler, inlineSafe);
 }
 
-Ref<WebHostBuilder> WebHostBuilder::Put(const std::string& path, const Ref<IRequestHandler>& handler)
+Ref<WebHostBuilder> WebHostBuilder::Put(const std::string& path, const Ref<IRequestHandler>& handler, bool inlineSafe)
 {
-    return _RegisterHandler(path, http::HttpMethod::PUT, handler);
+    return _RegisterHandler(path, http::HttpMethod::PUT, handler, inlineSafe);
 }
 
-Ref<WebHostBuilder> WebHostBuilder::Delete(const std::string& path, const Ref<IRequestHandler>& handler)
+Ref<WebHostBuilder> WebHostBuilder::Delete(const std::string& path, const Ref<IRequestHandler>& handler,
+                                           bool inlineSafe)
 {
-    return _RegisterHandler(path, http::HttpMethod::DELETE, handler);
+    return _RegisterHandler(path, http::HttpMethod::DELETE, handler, inlineSafe);
 }
 
 Ref<WebHostBuilder> WebHostBuilder::Error(int statusCode, const Ref<IRequestHandler>& handler)
@@ -79,6 +90,35 @@ Ref<WebHostBuilder> WebHostBuilder::Error(int statusCode, const Ref<IRequestHand
     return _RegisterErrorHandler(statusCode, handler);
 }
 
+Ref<WebHostBuilder> WebHostBuilder::UseStaticFiles(const std::string& prefix, const std::string& root, size_t cacheSize)
+{
+    _Preamble();
+    _container->Resolve<IRequestDispatcher>()->RegisterPrefixHandler(
+        prefix, http::HttpMethod::GET, CreateRef<StaticFileHandler>(prefix, root, cacheSize));
+    return shared_from_this();
+}
+
+Ref<WebHostBuilder> WebHostBuilder::UseEmbeddedAssets(const EmbeddedAssets& assets)
+{
+    static constexpr std::string_view INDEX = "index.html";
+
+    for (size_t i = 0; i < assets.Count; i++)
+    {
+        const EmbeddedAsset& asset = assets.Assets[i];
+        auto handler = CreateRef<EmbeddedAssetHandler>(asset);
+        std::string path(asset.Path);
+        _RegisterHandler(path, http::HttpMethod::GET, handler, true);
+
+        // The directory is kept with the trailing '/', so that the root is "/".
+        size_t slash = path.rfind('/');
+        if ((slash != std::string::npos) && (path.compare(slash + 1, std::string::npos, INDEX) == 0))
+        {
+            _RegisterHandler(path.substr(0, slash + 1), http::HttpMethod::GET, handler, true);
+        }
+    }
+    return shared_from_this();
+}
+
 Ref<Logger> WebHostBuilder::GetLogger(const std::string& name) const
 {
     _Preamble();
@@ -108,10 +148,10 @@ Ref<WebHost> WebHostBuilder::Build()
 }
 
 Ref<WebHostBuilder> WebHostBuilder::_RegisterHandler(const std::string& path, http::HttpMethod method,
-                                                     const Ref<IRequestHandler>& handler)
+                                                     const Ref<IRequestHandler>& handler, bool inlineSafe)
 {
     _Preamble();
-    _container->Resolve<IRequestDispatcher>()->RegisterHandler(path, method, handler);
+    _container->Resolve<IRequestDispatcher>()->RegisterHandler(path, method, handler, inlineSafe);
     return shared_from_this();
 }
 
@@ -191,6 +231,22 @@ void WebHostBuilder::_InitializeComponents()
     {
         _container->AddSingleton<IServer, MayhemServer, ServerConfig>();
     }
+    else if (serverConfig->Name == ShardedServer::Identifier())
+    {
+        _container->AddSingleton<IServer, ShardedServer, ServerConfig>();
+    }
+    else if (serverConfig->Name == UringServer::Identifier())
+    {
+        if (UringServer::IsSupported())
+        {
+            _container->AddSingleton<IServer, UringServer, ServerConfig>();
+        }
+        else
+        {
+            std::cerr << "io_uring is not supported, fall back to " << MayhemServer::Identifier() << '\n';
+            _container->AddSingleton<IServer, MayhemServer, ServerConfig>();
+        }
+    }
     else
     {
         std::cerr << "Unknown server: " << serverConfig->Name << '\n';
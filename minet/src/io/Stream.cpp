@@ -3,22 +3,109 @@
 #include "utils/Network.h"
 
 #include <errno.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
 
 MINET_BEGIN
 
 namespace io
 {
 
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Close the socket with a reset, so that the kernel drops data not
+ * sent yet, instead of sending it from bodies freed right after.
+ */
+static int _AbortSocket(int fd)
+{
+    linger option = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+    return network::CloseSocket(fd);
+}
+
+ssize_t Stream::WriteVector(const iovec* vector, int count)
+{
+    size_t written = 0;
+    for (int i = 0; i < count; i++)
+    {
+        const char* base = static_cast<const char*>(vector[i].iov_base);
+        for (size_t done = 0; done < vector[i].iov_len;)
+        {
+            ssize_t r = Write(base + done, vector[i].iov_len - done);
+            if (r < 0)
+            {
+                return r;
+            }
+            done += r;
+        }
+        written += vector[i].iov_len;
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t Stream::WriteFile(int fd, off_t offset, size_t length)
+{
+    char buffer[16384];
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t r = pread(fd, buffer, std::min(sizeof(buffer), length - written), offset + written);
+        if (r <= 0)
+        {
+            return StreamStatus::Error; // the file is shorter than expected
+        }
+        for (ssize_t done = 0; done < r;)
+        {
+            ssize_t w = Write(buffer + done, r - done);
+            if (w < 0)
+            {
+                return w;
+            }
+            done += w;
+        }
+        written += r;
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t Stream::WriteBody(std::string&& body)
+{
+    iovec part = { &body[0], body.size() };
+    return WriteVector(&part, 1);
+}
+
 /*
  * ===================================================================
  * ------------------------- Socket Stream ---------------------------
  * ===================================================================
  */
 
+std::vector<SocketStream::LingeringSocket> SocketStream::_sLingering;
+std::mutex SocketStream::_sLingeringMutex;
+std::atomic<size_t> SocketStream::_sLingeringCount(0);
+
 SocketStream::SocketStream(int fd) : _fd(fd)
 {
 }
 
+SocketStream::~SocketStream()
+{
+    // The kernel may still read the bodies, which must not be freed yet.
+    if (!_inFlight.empty())
+    {
+        Close();
+    }
+}
+
 // TODO: Check if the file descriptor is readable.
 bool SocketStream::IsReadable() const
 {
@@ -52,13 +139,152 @@ ssize_t SocketStream::Read(char* buffer, size_t length)
 }
 
 ssize_t SocketStream::Write(const char* buffer, size_t length)
+{
+    return _Send(buffer, length, 0);
+}
+
+ssize_t SocketStream::WriteMore(const char* buffer, size_t length)
+{
+    return _Send(buffer, length, MSG_MORE);
+}
+
+ssize_t SocketStream::WriteVector(const iovec* vector, int count)
 {
     if (!IsWritable())
     {
         return StreamStatus::Error;
     }
 
-    ssize_t written = network::WriteSocket(_fd, buffer, length);
+    std::vector<iovec> parts(vector, vector + count);
+    msghdr message = {};
+    message.msg_iov = parts.data();
+    message.msg_iovlen = parts.size();
+
+    size_t written = 0;
+    while (message.msg_iovlen > 0)
+    {
+        // Not writev, which raises SIGPIPE if the peer is gone.
+        ssize_t r = sendmsg(_fd, &message, MSG_NOSIGNAL);
+        if (r < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return StreamStatus::Again;
+            }
+            return StreamStatus::Error;
+        }
+        written += r;
+
+        // Skip what is sent for a partial write.
+        size_t left = r;
+        while ((message.msg_iovlen > 0) && (left >= message.msg_iov->iov_len))
+        {
+            left -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+        if (message.msg_iovlen > 0)
+        {
+            message.msg_iov->iov_base = static_cast<char*>(message.msg_iov->iov_base) + left;
+            message.msg_iov->iov_len -= left;
+        }
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t SocketStream::WriteFile(int fd, off_t offset, size_t length)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t r = sendfile(_fd, fd, &offset, length - written);
+        if (r <= 0)
+        {
+            if ((r < 0) && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return StreamStatus::Again;
+            }
+            return StreamStatus::Error;
+        }
+        written += r;
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t SocketStream::WriteBody(std::string&& body)
+{
+    if ((_zeroCopy > 0) && (body.size() >= _zeroCopy))
+    {
+        return _SendZeroCopy(std::move(body));
+    }
+    return Stream::WriteBody(std::move(body));
+}
+
+int SocketStream::Close()
+{
+    ReapLingering();
+
+    if (_fd <= 0)
+    {
+        return 0;
+    }
+
+    int fd = _fd;
+    _fd = 0;
+    if (_inFlight.empty())
+    {
+        return network::CloseSocket(fd);
+    }
+
+    bool copied = false;
+    bool reaped = _ReapZeroCopy(fd, &_inFlight, &copied);
+    if (_inFlight.empty())
+    {
+        return network::CloseSocket(fd);
+    }
+    if (!reaped)
+    {
+        _inFlight.clear();
+        return _AbortSocket(fd);
+    }
+
+    // Let the peer see the end of the response now, and close the socket
+    // once the kernel is done with the bodies.
+    shutdown(fd, SHUT_WR);
+    std::lock_guard<std::mutex> lock(_sLingeringMutex);
+    _sLingering.push_back({ fd, _Now() + ZERO_COPY_TIMEOUT, std::move(_inFlight) });
+    _sLingeringCount.store(_sLingering.size(), std::memory_order_relaxed);
+    _inFlight.clear();
+
+    return 0;
+}
+
+int SocketStream::EnableZeroCopy(size_t threshold)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+
+    MINET_TRY(network::EnableZeroCopy(_fd));
+    _zeroCopy = threshold;
+
+    return 0;
+}
+
+ssize_t SocketStream::_Send(const char* buffer, size_t length, int flags)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+
+    ssize_t written = network::WriteSocket(_fd, buffer, length, flags);
     if (written == -1)
     {
         if (errno == EAGAIN || errno == EWOULDBLOCK)
@@ -71,15 +297,126 @@ ssize_t SocketStream::Write(const char* buffer, size_t length)
     return written;
 }
 
-int SocketStream::Close()
+ssize_t SocketStream::_SendZeroCopy(std::string&& body)
 {
-    if (_fd > 0)
+    if (!IsWritable())
     {
-        int r = network::CloseSocket(_fd);
-        _fd = 0;
-        return r;
+        return StreamStatus::Error;
     }
-    return 0;
+
+    ZeroCopyBody sent = { _zeroCopySends, 0, 0, std::make_unique<std::string>(std::move(body)) };
+    const char* data = sent.Body->data();
+    size_t length = sent.Body->size();
+    size_t written = 0;
+    ssize_t status = 0;
+    while (written < length)
+    {
+        ssize_t r = network::WriteSocket(_fd, data + written, length - written, MSG_ZEROCOPY);
+        if (r >= 0)
+        {
+            // Only successful sends are numbered.
+            _zeroCopySends++;
+            written += r;
+            continue;
+        }
+
+        // Out of pinned memory allowed for the socket, just copy the rest then.
+        if (errno == ENOBUFS)
+        {
+            r = _Send(data + written, length - written, 0);
+            if (r >= 0)
+            {
+                written += r;
+                continue;
+            }
+            status = r;
+        }
+        else
+        {
+            status = (errno == EAGAIN || errno == EWOULDBLOCK) ? StreamStatus::Again : StreamStatus::Error;
+        }
+        break;
+    }
+
+    // Keep the body until all its sends are completed, even if it failed.
+    if (_zeroCopySends != sent.First)
+    {
+        sent.Last = _zeroCopySends - 1;
+        _inFlight.push_back(std::move(sent));
+    }
+
+    // Release bodies sent before, which is all a later send waits for.
+    bool copied = false;
+    _ReapZeroCopy(_fd, &_inFlight, &copied);
+
+    // It is only overhead if the kernel copies anyway, e.g. on loopback.
+    if (copied)
+    {
+        _zeroCopy = 0;
+    }
+
+    return (status < 0) ? status : static_cast<ssize_t>(written);
+}
+
+bool SocketStream::_ReapZeroCopy(int fd, std::vector<ZeroCopyBody>* inFlight, bool* copied)
+{
+    int r = network::ReapZeroCopy(
+        fd,
+        [inFlight](uint32_t first, uint32_t last) {
+            for (auto& body : *inFlight)
+            {
+                uint32_t begin = std::max(first, body.First);
+                uint32_t end = std::min(last, body.Last);
+                if (begin <= end)
+                {
+                    body.Completed += end - begin + 1;
+                }
+            }
+        },
+        copied);
+
+    inFlight->erase(std::remove_if(inFlight->begin(), inFlight->end(),
+                                   [](const ZeroCopyBody& body) {
+                                       return body.Completed == body.Last - body.First + 1;
+                                   }),
+                    inFlight->end());
+    return r >= 0;
+}
+
+void SocketStream::ReapLingering()
+{
+    if (_sLingeringCount.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_sLingeringMutex, std::try_to_lock);
+    if (!lock.owns_lock())
+    {
+        return; // someone else is on it
+    }
+
+    int64_t now = _Now();
+    for (auto it = _sLingering.begin(); it != _sLingering.end();)
+    {
+        bool copied = false;
+        if (_ReapZeroCopy(it->Fd, &it->InFlight, &copied) && !it->InFlight.empty() && (now < it->Deadline))
+        {
+            ++it;
+            continue;
+        }
+
+        if (it->InFlight.empty())
+        {
+            network::CloseSocket(it->Fd);
+        }
+        else
+        {
+            _AbortSocket(it->Fd);
+        }
+        it = _sLingering.erase(it);
+    }
+    _sLingeringCount.store(_sLingering.size(), std::memory_order_relaxed);
 }
 
 /*
@@ -122,6 +459,91 @@ int BufferInputStream::Close()
     return 0;
 }
 
+/*
+ * ===================================================================
+ * ------------------------- Memory Stream ---------------------------
+ * ===================================================================
+ */
+
+MemoryStream::MemoryStream() : _offset(0), _finished(false), _closed(false)
+{
+}
+
+ssize_t MemoryStream::Read(char* buffer, size_t length)
+{
+    if (!IsReadable())
+    {
+        return StreamStatus::Error;
+    }
+
+    if (_offset >= _input.size())
+    {
+        return _finished ? 0 : StreamStatus::Again;
+    }
+
+    size_t size = std::min(length, _input.size() - _offset);
+    std::copy(_input.begin() + _offset, _input.begin() + _offset + size, buffer);
+    _offset += size;
+    if (_offset == _input.size())
+    {
+        // All consumed, reuse the space for later input.
+        _input.clear();
+        _offset = 0;
+    }
+
+    return size;
+}
+
+ssize_t MemoryStream::Write(const char* buffer, size_t length)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+
+    _output.append(buffer, length);
+    return length;
+}
+
+ssize_t MemoryStream::WriteFile(int fd, off_t offset, size_t length)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+
+    size_t size = _output.size();
+    _output.resize(size + length);
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t r = pread(fd, _output.data() + size + written, length - written, offset + written);
+        if (r <= 0)
+        {
+            _output.resize(size);
+            return StreamStatus::Error;
+        }
+        written += r;
+    }
+    return static_cast<ssize_t>(written);
+}
+
+int MemoryStream::Close()
+{
+    _closed = true;
+    return 0;
+}
+
+void MemoryStream::Feed(const char* buffer, size_t length)
+{
+    _input.insert(_input.end(), buffer, buffer + length);
+}
+
+void MemoryStream::Finish()
+{
+    _finished = true;
+}
+
 } // namespace io
 
 MINET_END
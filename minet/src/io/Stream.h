@@ -6,6 +6,12 @@
 #pragma once
 
 #include <sys/types.h> // ssize_t
+#include <sys/uio.h>   // iovec
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include "minet/common/Base.h"
 
@@ -59,6 +65,38 @@ public:
     virtual ssize_t Read(char* buffer, size_t length) = 0;
     virtual ssize_t Write(const char* buffer, size_t length) = 0;
 
+    /**
+     * @brief Write with more to follow right away, so that the stream may
+     * hold it back and send both together, e.g. headers before the body.
+     */
+    virtual ssize_t WriteMore(const char* buffer, size_t length)
+    {
+        return Write(buffer, length);
+    }
+
+    /**
+     * @brief Write all the buffers in order, all of them unless failed.
+     * @return How many bytes written, < 0 on failure.
+     * @note By default, it writes them one by one.
+     */
+    virtual ssize_t WriteVector(const iovec* vector, int count);
+
+    /**
+     * @brief Write part of a file, all of it unless failed.
+     * @param fd The file to read from, its offset is not changed.
+     * @return How many bytes written, < 0 on failure.
+     * @note By default, it reads the file in chunks and writes them.
+     */
+    virtual ssize_t WriteFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief Write a body handed over to the stream, which may keep it
+     * until it is sent, all of it unless failed.
+     * @return How many bytes written, < 0 on failure.
+     * @note By default, it is written like any other buffer.
+     */
+    virtual ssize_t WriteBody(std::string&& body);
+
     /**
      * @brief Close the stream.
      * @return 0 on success, otherwise failed.
@@ -74,18 +112,115 @@ class SocketStream : public Stream
 {
 public:
     SocketStream(int fd);
-    ~SocketStream() override = default;
+
+    /**
+     * @note It closes the socket if zero copy sends are still in flight.
+     */
+    ~SocketStream() override;
 
     bool IsReadable() const override;
     bool IsWritable() const override;
 
     ssize_t Read(char* buffer, size_t length) override;
     ssize_t Write(const char* buffer, size_t length) override;
+    ssize_t WriteMore(const char* buffer, size_t length) override;
+
+    /**
+     * @brief Send all buffers with one call, like writev.
+     */
+    ssize_t WriteVector(const iovec* vector, int count) override;
+
+    /**
+     * @brief Send the file with sendfile, without copying it to user space.
+     */
+    ssize_t WriteFile(int fd, off_t offset, size_t length) override;
 
+    /**
+     * @brief Send the body with MSG_ZEROCOPY if it is large enough, see
+     * EnableZeroCopy, otherwise like WriteVector.
+     */
+    ssize_t WriteBody(std::string&& body) override;
+
+    /**
+     * @note
+     * If zero copy sends are still in flight, the socket is shut down for
+     * writing, and closed once the kernel is done with their bodies.
+     */
     int Close() override;
 
+    /**
+     * @brief Send bodies of at least threshold bytes with MSG_ZEROCOPY.
+     * @return 0 on success, < 0 if the socket does not support it.
+     * @note
+     * Sending does not wait for the peer. Bodies are kept until the kernel
+     * reports their sends completed, which is checked on later sends and
+     * on close.
+     */
+    int EnableZeroCopy(size_t threshold);
+
+    /**
+     * @brief Close lingering sockets whose bodies are completed, and abort
+     * those that waited too long.
+     * @note
+     * Servers with zero copy call it every LINGER_INTERVAL, so that it is
+     * done even if no other stream is closed.
+     */
+    static void ReapLingering();
+
+    // How often to check lingering sockets, in ms.
+    static constexpr int LINGER_INTERVAL = 100;
+
+private:
+    /**
+     * @brief A body sent with MSG_ZEROCOPY, by sends numbered from First to
+     * Last, kept until all of them are completed.
+     */
+    struct ZeroCopyBody
+    {
+        uint32_t First;
+        uint32_t Last;
+        uint32_t Completed;
+
+        // On the heap, so that the kernel reads from the same address even
+        // if the body is moved, or held inline by a short string.
+        std::unique_ptr<std::string> Body;
+    };
+
+    /**
+     * @brief A closed stream waiting for its zero copy sends.
+     */
+    struct LingeringSocket
+    {
+        int Fd;
+        int64_t Deadline;
+        std::vector<ZeroCopyBody> InFlight;
+    };
+
+    ssize_t _Send(const char* buffer, size_t length, int flags);
+    ssize_t _SendZeroCopy(std::string&& body);
+
+    /**
+     * @brief Release bodies whose sends are completed, without waiting.
+     * @return false if the error queue cannot be read.
+     */
+    static bool _ReapZeroCopy(int fd, std::vector<ZeroCopyBody>* inFlight, bool* copied);
+
 protected:
     int _fd;
+
+private:
+    // Give up on a client that does not take the data in this long, in ms.
+    static constexpr int ZERO_COPY_TIMEOUT = 10000;
+
+    static std::vector<LingeringSocket> _sLingering;
+    static std::mutex _sLingeringMutex;
+    static std::atomic<size_t> _sLingeringCount;
+
+    size_t _zeroCopy = 0;
+
+    // Sequence number of the next MSG_ZEROCOPY send on the socket.
+    uint32_t _zeroCopySends = 0;
+    std::vector<ZeroCopyBody> _inFlight;
 };
 
 /**
@@ -117,6 +252,68 @@ private:
     bool _closed;
 };
 
+/**
+ * @brief In-memory duplex stream.
+ * @note
+ * It is used when the socket I/O is done by someone else, e.g. io_uring.
+ * Received bytes are fed into it for reading, and written bytes are kept
+ * for whoever sends them.
+ */
+class MemoryStream final : public Stream
+{
+public:
+    MemoryStream();
+    ~MemoryStream() override = default;
+
+    bool IsReadable() const override
+    {
+        return !_closed;
+    }
+    bool IsWritable() const override
+    {
+        return !_closed;
+    }
+
+    /**
+     * @return Bytes read, 0 after @link Finish @endlink, or Again if no data yet.
+     */
+    ssize_t Read(char* buffer, size_t length) override;
+    ssize_t Write(const char* buffer, size_t length) override;
+
+    /**
+     * @brief Read the file right into the output.
+     */
+    ssize_t WriteFile(int fd, off_t offset, size_t length) override;
+
+    int Close() override;
+
+    /**
+     * @brief Append received bytes for reading.
+     */
+    void Feed(const char* buffer, size_t length);
+
+    /**
+     * @brief Mark the end of input, i.e. the peer closed the connection.
+     */
+    void Finish();
+
+    /**
+     * @brief Bytes written so far.
+     * @note Still accessible after the stream is closed.
+     */
+    std::string& Output()
+    {
+        return _output;
+    }
+
+private:
+    std::vector<char> _input;
+    size_t _offset;
+    std::string _output;
+    bool _finished;
+    bool _closed;
+};
+
 } // namespace io
 
 MINET_END
@@ -74,7 +74,8 @@ void BufferedStreamReader::_Flush()
         return;
     }
 
-    _head = _buffer;
+    // Drop consumed bytes, so that they are not read again on Again.
+    _head = _tail = _buffer;
     ssize_t size = _stream->Read(_buffer, _sBufferSize);
     if (size >= 0)
     {
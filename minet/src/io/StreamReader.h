@@ -35,6 +35,11 @@ public:
 
     virtual bool IsEof() = 0;
 
+    /**
+     * @brief Whether some bytes are read from the stream but not consumed.
+     */
+    virtual bool IsBuffered() const = 0;
+
 protected:
     Ref<Stream> _stream;
 };
@@ -53,6 +58,11 @@ public:
         return _eof;
     }
 
+    bool IsBuffered() const override
+    {
+        return !_IsEmpty();
+    }
+
 private:
     size_t _BufferSize() const
     {
@@ -44,11 +44,34 @@ int BufferedStreamWriter::Write(char ch)
 
 ssize_t BufferedStreamWriter::Write(const char* buffer, size_t length)
 {
+    // Make room in one go, as it is followed by this write.
+    if (length > _sBufferSize - _BufferSize())
+    {
+        if (_Flush(true) < 0)
+        {
+            return 0;
+        }
+
+        // Copying it into the buffer piece by piece gains nothing.
+        if (length >= _sBufferSize)
+        {
+            size_t written = 0;
+            while (written < length)
+            {
+                ssize_t r = _stream->Write(buffer + written, length - written);
+                if (r < 0)
+                {
+                    break;
+                }
+                written += r;
+            }
+            return static_cast<ssize_t>(written);
+        }
+    }
+
     size_t remaining = length;
     while (remaining > 0)
     {
-        size_t size = std::min(remaining, _sBufferSize - _BufferSize());
-        std::memcpy(_tail, buffer, size);
         if (_BufferSize() == _sBufferSize)
         {
             if (Flush() < 0)
@@ -56,6 +79,8 @@ ssize_t BufferedStreamWriter::Write(const char* buffer, size_t length)
                 break;
             }
         }
+        size_t size = std::min(remaining, _sBufferSize - _BufferSize());
+        std::memcpy(_tail, buffer, size);
         _tail += size;
         buffer += size;
         remaining -= size;
@@ -63,25 +88,53 @@ ssize_t BufferedStreamWriter::Write(const char* buffer, size_t length)
     return static_cast<ssize_t>(length - remaining);
 }
 
-ssize_t BufferedStreamWriter::Flush()
+ssize_t BufferedStreamWriter::WriteFile(int fd, off_t offset, size_t length)
 {
-    if (_BufferSize() == 0)
+    MINET_TRY(_Flush(true));
+    return _stream->WriteFile(fd, offset, length);
+}
+
+ssize_t BufferedStreamWriter::WriteBody(std::string&& body)
+{
+    if (body.size() < _sBufferSize)
     {
-        return 0;
+        return Write(body);
     }
+    MINET_TRY(_Flush(true));
+    return _stream->WriteBody(std::move(body));
+}
+
+ssize_t BufferedStreamWriter::Flush()
+{
+    return _Flush(false);
+}
 
-    ssize_t r = _stream->Write(_buffer, _BufferSize());
-    if (r >= 0)
+ssize_t BufferedStreamWriter::_Flush(bool more)
+{
+    size_t size = _BufferSize();
+    if (size == 0)
     {
-        MINET_ASSERT(r == static_cast<ssize_t>(_BufferSize()));
-        _tail = _buffer;
+        return 0;
     }
-    else if (r == StreamStatus::Again)
+
+    // The response must go out in whole, or a kept-alive connection
+    // would be out of sync.
+    const char* head = _buffer;
+    while (head != _tail)
     {
-        return StreamStatus::Again;
+        ssize_t r = more ? _stream->WriteMore(head, _tail - head) : _stream->Write(head, _tail - head);
+        if (r < 0)
+        {
+            // Keep what is left for the next flush.
+            std::memmove(_buffer, head, _tail - head);
+            _tail = _buffer + (_tail - head);
+            return r;
+        }
+        head += r;
     }
+    _tail = _buffer;
 
-    return StreamStatus::Error;
+    return static_cast<ssize_t>(size);
 }
 
 } // namespace io
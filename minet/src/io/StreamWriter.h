@@ -40,6 +40,12 @@ protected:
     Ref<Stream> _stream;
 };
 
+/**
+ * @brief Writer that gathers small writes into a buffer.
+ * @note
+ * Writes that do not fit in the buffer skip it, after the buffered bytes
+ * are sent with more to follow, so a large body costs no extra copy.
+ */
 class BufferedStreamWriter final : public StreamWriter
 {
 public:
@@ -52,9 +58,25 @@ public:
     int Write(char ch) override;
     ssize_t Write(const char* buffer, size_t length) override;
 
+    /**
+     * @brief Write part of a file after what is buffered, see Stream::WriteFile.
+     */
+    ssize_t WriteFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief Write a body handed over after what is buffered, see
+     * Stream::WriteBody. Small ones are buffered as usual.
+     */
+    ssize_t WriteBody(std::string&& body);
+
     ssize_t Flush() override;
 
 private:
+    /**
+     * @param more Whether more is written right after, see Stream::WriteMore.
+     */
+    ssize_t _Flush(bool more);
+
     size_t _BufferSize() const
     {
         return _tail - _buffer;
@@ -0,0 +1,422 @@
+#include "io/TlsStream.h"
+
+#include "utils/Network.h"
+
+#ifdef MINET_HAS_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+#include <errno.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+MINET_BEGIN
+
+namespace io
+{
+
+#ifdef MINET_HAS_TLS
+
+/*
+ * ===================================================================
+ * --------------------------- TlsContext ----------------------------
+ * ===================================================================
+ */
+
+// Length of a ticket key, i.e. name, HMAC secret and AES key.
+static constexpr size_t TICKET_KEY_LENGTH = 80;
+
+static std::string _LastError()
+{
+    char buffer[256];
+    ERR_error_string_n(ERR_get_error(), buffer, sizeof(buffer));
+    ERR_clear_error();
+    return buffer;
+}
+
+/*
+ * The socket BIO of OpenSSL writes with write, which raises SIGPIPE if the
+ * peer is gone, so go through send with MSG_NOSIGNAL instead.
+ */
+
+static int _SocketOf(BIO* bio)
+{
+    return static_cast<int>(reinterpret_cast<intptr_t>(BIO_get_data(bio)));
+}
+
+static int _BioRead(BIO* bio, char* buffer, int length)
+{
+    BIO_clear_retry_flags(bio);
+    ssize_t r = network::ReadSocket(_SocketOf(bio), buffer, length);
+    if ((r < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+        BIO_set_retry_read(bio);
+    }
+#ifdef BIO_FLAGS_IN_EOF
+    else if (r == 0)
+    {
+        // So that EOF is told from errors, e.g. on unexpected EOF.
+        BIO_set_flags(bio, BIO_FLAGS_IN_EOF);
+    }
+#endif
+    return static_cast<int>(r);
+}
+
+static int _BioWrite(BIO* bio, const char* buffer, int length)
+{
+    BIO_clear_retry_flags(bio);
+    ssize_t r = network::WriteSocket(_SocketOf(bio), buffer, length);
+    if ((r < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+        BIO_set_retry_write(bio);
+    }
+    return static_cast<int>(r);
+}
+
+static long _BioControl(BIO* bio, int command, long /* number */, void* /* pointer */)
+{
+    switch (command)
+    {
+    case BIO_CTRL_FLUSH:
+        return 1; // nothing is buffered
+#ifdef BIO_FLAGS_IN_EOF
+    case BIO_CTRL_EOF:
+        return BIO_test_flags(bio, BIO_FLAGS_IN_EOF) != 0;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static const BIO_METHOD* _SocketMethod()
+{
+    static BIO_METHOD* method = []() {
+        BIO_METHOD* m = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "minet socket");
+        BIO_meth_set_read(m, _BioRead);
+        BIO_meth_set_write(m, _BioWrite);
+        BIO_meth_set_ctrl(m, _BioControl);
+        return m;
+    }();
+    return method;
+}
+
+/**
+ * @brief ALPN callback, HTTP/1.1 is all we speak.
+ * @note If the client does not offer it, go on without ALPN instead of
+ * failing the handshake.
+ */
+static int _SelectProtocol(SSL* /* ssl */, const unsigned char** out, unsigned char* outLength,
+                           const unsigned char* in, unsigned int inLength, void* /* arg */)
+{
+    static const unsigned char PROTOCOLS[] = "\x08http/1.1";
+
+    unsigned char* selected;
+    if (SSL_select_next_proto(&selected, outLength, PROTOCOLS, sizeof(PROTOCOLS) - 1, in, inLength) !=
+        OPENSSL_NPN_NEGOTIATED)
+    {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::TlsContext(SSL_CTX* ctx) : _ctx(ctx)
+{
+}
+
+TlsContext::~TlsContext()
+{
+    SSL_CTX_free(_ctx);
+}
+
+bool TlsContext::IsSupported()
+{
+    return true;
+}
+
+Ref<TlsContext> TlsContext::Create(const TlsProfile& profile, std::string* error)
+{
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx)
+    {
+        *error = "Failed to create TLS context: " + _LastError();
+        return nullptr;
+    }
+    // Free it on failure from now on.
+    Ref<TlsContext> context = CreateRef(new TlsContext(ctx));
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, profile.Certificate.c_str()) != 1)
+    {
+        *error = "Failed to load certificate " + profile.Certificate + ": " + _LastError();
+        return nullptr;
+    }
+    const std::string& key = profile.PrivateKey.empty() ? profile.Certificate : profile.PrivateKey;
+    if ((SSL_CTX_use_PrivateKey_file(ctx, key.c_str(), SSL_FILETYPE_PEM) != 1) || (SSL_CTX_check_private_key(ctx) != 1))
+    {
+        *error = "Failed to load private key " + key + ": " + _LastError();
+        return nullptr;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    uint64_t options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Clients often close without close_notify, which is just EOF for HTTP.
+    options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
+#endif
+    if (!profile.SessionTickets)
+    {
+        options |= SSL_OP_NO_TICKET;
+    }
+    SSL_CTX_set_options(ctx, options);
+
+    // Kept-alive connections waiting for the next request do not need
+    // buffers, which add up to 34K each otherwise.
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    // Sessions are shared by all connections of the server.
+    static const unsigned char SESSION_ID_CONTEXT[] = "minet";
+    SSL_CTX_set_session_id_context(ctx, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+    if (profile.SessionCache > 0)
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, profile.SessionCache);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    if (!profile.TicketKey.empty())
+    {
+        std::ifstream file(profile.TicketKey, std::ios::binary);
+        std::string keys((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file || (keys.size() != TICKET_KEY_LENGTH))
+        {
+            *error = "Ticket key " + profile.TicketKey + " must have " + std::to_string(TICKET_KEY_LENGTH) + " bytes";
+            return nullptr;
+        }
+        if (SSL_CTX_set_tlsext_ticket_keys(ctx, &keys[0], keys.size()) != 1)
+        {
+            *error = "Failed to set ticket key: " + _LastError();
+            return nullptr;
+        }
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, _SelectProtocol, nullptr);
+
+    return context;
+}
+
+/*
+ * ===================================================================
+ * ---------------------------- TlsStream ----------------------------
+ * ===================================================================
+ */
+
+TlsStream::TlsStream(int fd, const Ref<TlsContext>& context)
+    : _fd(fd), _ssl(SSL_new(context->Native())), _failed(false), _context(context)
+{
+    BIO* bio = _ssl ? BIO_new(_SocketMethod()) : nullptr;
+    if (bio)
+    {
+        BIO_set_data(bio, reinterpret_cast<void*>(static_cast<intptr_t>(fd)));
+        BIO_set_init(bio, 1);
+        SSL_set_bio(_ssl, bio, bio);
+        SSL_set_accept_state(_ssl);
+    }
+    else
+    {
+        _failed = true;
+    }
+}
+
+TlsStream::~TlsStream()
+{
+    SSL_free(_ssl);
+}
+
+bool TlsStream::IsReadable() const
+{
+    return (_fd > 0) && !_failed;
+}
+
+bool TlsStream::IsWritable() const
+{
+    return (_fd > 0) && !_failed;
+}
+
+ssize_t TlsStream::Read(char* buffer, size_t length)
+{
+    if (!IsReadable())
+    {
+        return StreamStatus::Error;
+    }
+
+    // The error queue is per thread, and may hold errors of others.
+    ERR_clear_error();
+    int r = SSL_read(_ssl, buffer, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    return (r > 0) ? r : _Status(r);
+}
+
+ssize_t TlsStream::Write(const char* buffer, size_t length)
+{
+    if (!IsWritable())
+    {
+        return StreamStatus::Error;
+    }
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    ERR_clear_error();
+    int r = SSL_write(_ssl, buffer, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    return (r > 0) ? r : _Status(r);
+}
+
+int TlsStream::Close()
+{
+    if (_fd <= 0)
+    {
+        return 0;
+    }
+
+    // Best effort, as the socket never blocks.
+    if (!_failed && SSL_is_init_finished(_ssl))
+    {
+        ERR_clear_error();
+        SSL_shutdown(_ssl);
+    }
+
+    int r = network::CloseSocket(_fd);
+    _fd = 0;
+    return r;
+}
+
+bool TlsStream::IsResumed() const
+{
+    return _ssl && (SSL_session_reused(_ssl) == 1);
+}
+
+std::string TlsStream::GetProtocol() const
+{
+    if (!_ssl)
+    {
+        return "";
+    }
+
+    const unsigned char* protocol = nullptr;
+    unsigned int length = 0;
+    SSL_get0_alpn_selected(_ssl, &protocol, &length);
+    return protocol ? std::string(reinterpret_cast<const char*>(protocol), length) : "";
+}
+
+ssize_t TlsStream::_Status(int r)
+{
+    switch (SSL_get_error(_ssl, r))
+    {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        return StreamStatus::Again;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0;
+    case SSL_ERROR_SYSCALL:
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return StreamStatus::Again;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // OpenSSL must not be used for this connection any more, not even to
+    // send close_notify.
+    _failed = true;
+    return StreamStatus::Error;
+}
+
+#else
+
+TlsContext::TlsContext(SSL_CTX* ctx) : _ctx(ctx)
+{
+}
+
+TlsContext::~TlsContext() = default;
+
+bool TlsContext::IsSupported()
+{
+    return false;
+}
+
+Ref<TlsContext> TlsContext::Create(const TlsProfile& /* profile */, std::string* error)
+{
+    *error = "minet is built without TLS";
+    return nullptr;
+}
+
+TlsStream::TlsStream(int fd, const Ref<TlsContext>& context)
+    : _fd(fd), _ssl(nullptr), _failed(true), _context(context)
+{
+}
+
+TlsStream::~TlsStream() = default;
+
+bool TlsStream::IsReadable() const
+{
+    return false;
+}
+
+bool TlsStream::IsWritable() const
+{
+    return false;
+}
+
+ssize_t TlsStream::Read(char* /* buffer */, size_t /* length */)
+{
+    return StreamStatus::Error;
+}
+
+ssize_t TlsStream::Write(const char* /* buffer */, size_t /* length */)
+{
+    return StreamStatus::Error;
+}
+
+int TlsStream::Close()
+{
+    if (_fd <= 0)
+    {
+        return 0;
+    }
+    int r = network::CloseSocket(_fd);
+    _fd = 0;
+    return r;
+}
+
+bool TlsStream::IsResumed() const
+{
+    return false;
+}
+
+std::string TlsStream::GetProtocol() const
+{
+    return "";
+}
+
+ssize_t TlsStream::_Status(int /* r */)
+{
+    return StreamStatus::Error;
+}
+
+#endif
+
+} // namespace io
+
+MINET_END
@@ -0,0 +1,157 @@
+/**
+ * @author Tony S.
+ * @details TLS stream over a non-blocking socket, backed by OpenSSL.
+ */
+
+#pragma once
+
+#include "io/Stream.h"
+
+#include <string>
+
+// Keep OpenSSL headers out of the way.
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct ssl_st SSL;
+
+MINET_BEGIN
+
+namespace io
+{
+
+/**
+ * @brief Options of TLS listeners.
+ */
+struct TlsProfile
+{
+    /**
+     * @brief PEM file of the certificate chain, server certificate first.
+     * @note TLS is disabled if empty.
+     */
+    std::string Certificate;
+
+    /**
+     * @brief PEM file of the private key, empty if it is in the certificate file.
+     */
+    std::string PrivateKey;
+
+    /**
+     * @brief Maximum sessions kept in the server side cache for resumption.
+     */
+    unsigned SessionCache = 20480;
+
+    /**
+     * @brief Resume sessions with tickets held by clients, so that the
+     * server keeps no state for them.
+     */
+    bool SessionTickets = true;
+
+    /**
+     * @brief File of 80 random bytes to encrypt session tickets, empty to
+     * generate the key on start.
+     * @note
+     * Processes with the same key resume sessions of each other, and
+     * across restarts. Otherwise, each process has its own key.
+     */
+    std::string TicketKey;
+
+    bool IsEnabled() const
+    {
+        return !Certificate.empty();
+    }
+};
+
+/**
+ * @brief Shared state of all TLS connections of a server, i.e. the
+ * certificate, session cache and ticket keys.
+ */
+class TlsContext final
+{
+public:
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    /**
+     * @brief Whether minet is built with TLS.
+     */
+    static bool IsSupported();
+
+    /**
+     * @brief Load the certificate and key, and set up session resumption
+     * and ALPN.
+     * @param error Reason of the failure, if any.
+     * @return nullptr on failure.
+     */
+    static Ref<TlsContext> Create(const TlsProfile& profile, std::string* error);
+
+    SSL_CTX* Native() const
+    {
+        return _ctx;
+    }
+
+private:
+    explicit TlsContext(SSL_CTX* ctx);
+
+private:
+    SSL_CTX* _ctx;
+};
+
+/**
+ * @brief Server side TLS stream.
+ * @note
+ * The handshake is done on the first reads, so that it never blocks the
+ * event loop. Read and Write return Again whenever OpenSSL needs the
+ * socket to be ready, in either direction.
+ * @note
+ * Partial writes are enabled, and the buffer may move between retries, as
+ * long as it starts with the bytes not written yet.
+ * @warning It does not own the socket, but Close closes it like SocketStream.
+ */
+class TlsStream final : public Stream
+{
+public:
+    TlsStream(int fd, const Ref<TlsContext>& context);
+    ~TlsStream() override;
+
+    bool IsReadable() const override;
+    bool IsWritable() const override;
+
+    /**
+     * @return Decrypted bytes, 0 if the peer closed, or Again.
+     */
+    ssize_t Read(char* buffer, size_t length) override;
+    ssize_t Write(const char* buffer, size_t length) override;
+
+    /**
+     * @brief Send close_notify if possible, and close the socket.
+     */
+    int Close() override;
+
+    /**
+     * @brief Whether the session is resumed instead of a full handshake.
+     */
+    bool IsResumed() const;
+
+    /**
+     * @brief Protocol chosen by ALPN, empty if none.
+     */
+    std::string GetProtocol() const;
+
+private:
+    ssize_t _Status(int r);
+
+private:
+    int _fd;
+    SSL* _ssl;
+
+    // Set once OpenSSL fails, after which the connection is unusable.
+    bool _failed;
+
+    // Keep the certificate and session cache alive.
+    Ref<TlsContext> _context;
+};
+
+} // namespace io
+
+MINET_END
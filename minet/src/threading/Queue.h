@@ -10,6 +10,8 @@
 #include "minet/common/Assert.h"
 
 #include <atomic>
+#include <chrono>
+#include <mutex>
 #include <new> // std::hardware_destructive_interference_size
 #include <utility>
 #include <vector>
@@ -65,6 +67,12 @@ public:
      */
     bool Pop(TData* data);
 
+    /**
+     * @brief Get the number of data in the queue.
+     * @note It is only a snapshot, as other threads may push or pop meanwhile.
+     */
+    size_t Size() const;
+
 private:
     struct Slot
     {
@@ -209,6 +217,136 @@ template <typename TData> bool Queue<TData>::Pop(TData* data)
     return true;
 }
 
+template <typename TData> size_t Queue<TData>::Size() const
+{
+    // Load dequeue first, as enqueue never falls behind it.
+    size_t dequeue = _nextDequeue.load(std::memory_order_relaxed);
+    size_t enqueue = _nextEnqueue.load(std::memory_order_relaxed);
+    return (enqueue > dequeue) ? (enqueue - dequeue) : 0;
+}
+
+/**
+ * @brief A locked queue that turns to LIFO under overload.
+ * @tparam TData Type of the data in this queue.
+ * @note
+ * Data is taken in order while the oldest one has waited less than the
+ * target. Once it has waited longer, the newest is taken instead, whose
+ * client is most likely still waiting, until the queue catches up. Stale
+ * ones left behind are taken last, when they are cheap to drop.
+ * @note Slower than Queue, so only used when the discipline is enabled.
+ * @note Entries are allocated up front, like Queue, so that they are first
+ * touched by the thread creating it.
+ * @ref https://queue.acm.org/detail.cfm?id=2839461
+ */
+template <typename TData> class AdaptiveQueue final
+{
+public:
+    /**
+     * @param capacity Maximum number of data in the queue.
+     * @param target Time the oldest data may wait before turning to LIFO,
+     * in milliseconds.
+     */
+    AdaptiveQueue(size_t capacity, unsigned target);
+    ~AdaptiveQueue() = default;
+
+    AdaptiveQueue(const AdaptiveQueue&) = delete;
+    AdaptiveQueue& operator=(const AdaptiveQueue&) = delete;
+
+    /**
+     * @brief Push data into the queue.
+     * @return true on success, false if the queue is full, in which case
+     * data is not moved from.
+     */
+    template <typename T> bool Push(T&& data);
+
+    /**
+     * @brief Pop the oldest data, or the newest if the oldest is late.
+     * @return true on success, false if the queue is empty.
+     */
+    bool Pop(TData* data);
+
+    size_t Size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        TData Data;
+        Clock::time_point Queued;
+    };
+
+    // Take the entry out of the ring, which is either end of it.
+    void _Take(size_t index, TData* data);
+
+private:
+    size_t _capacity;
+    Clock::duration _target;
+
+    mutable std::mutex _mutex;
+    std::vector<Entry> _entries; // ring of _size entries from _head
+    size_t _head;
+    size_t _size;
+};
+
+template <typename TData>
+AdaptiveQueue<TData>::AdaptiveQueue(size_t capacity, unsigned target)
+    : _capacity(capacity), _target(std::chrono::milliseconds(target)), _entries(capacity), _head(0), _size(0)
+{
+    MINET_ASSERT(capacity > 0);
+}
+
+template <typename TData> template <typename T> bool AdaptiveQueue<TData>::Push(T&& data)
+{
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_size >= _capacity)
+    {
+        return false;
+    }
+    Entry& entry = _entries[(_head + _size) % _capacity];
+    entry.Data = std::forward<T>(data);
+    entry.Queued = now;
+    _size++;
+    return true;
+}
+
+template <typename TData> bool AdaptiveQueue<TData>::Pop(TData* data)
+{
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_size == 0)
+    {
+        return false;
+    }
+    if (now - _entries[_head].Queued > _target)
+    {
+        _Take((_head + _size - 1) % _capacity, data);
+    }
+    else
+    {
+        _Take(_head, data);
+        _head = (_head + 1) % _capacity;
+    }
+    _size--;
+    return true;
+}
+
+template <typename TData> size_t AdaptiveQueue<TData>::Size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
+template <typename TData> void AdaptiveQueue<TData>::_Take(size_t index, TData* data)
+{
+    *data = std::move(_entries[index].Data);
+    // Do not hold on to what the task captured.
+    _entries[index].Data = TData();
+}
+
 } // namespace threading
 
 MINET_END
\ No newline at end of file
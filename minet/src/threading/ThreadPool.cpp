@@ -10,14 +10,17 @@ unsigned int HardwareConcurrency()
     return std::thread::hardware_concurrency();
 }
 
-ThreadPool::ThreadPool(unsigned int threads, size_t capacity)
-    : _threads(threads), _running(false), _workers(threads), _next(0)
+ThreadPool::ThreadPool(unsigned int threads, size_t capacity, unsigned spin, const std::vector<int>& cpus,
+                       size_t overload, unsigned lifo)
+    : _threads(threads), _running(false), _capacity(threads * detail::MakePowerOfTwo(capacity)), _overload(overload),
+      _workers(threads), _next(0)
 {
     MINET_ASSERT(threads > 0);
 
     for (unsigned int i = 0; i < threads; i++)
     {
-        _workers[i] = CreateRef<Worker<TaskFn>>(capacity);
+        _workers[i] = CreateRef<Worker<TaskFn>>(capacity, spin, cpus.empty() ? -1 : cpus[i % cpus.size()], overload,
+                                               lifo);
     }
 
     for (unsigned int i = 0; i < _threads; i++)
@@ -38,6 +41,8 @@ ThreadPool::ThreadPool(ThreadPool&& other) noexcept
 {
     _threads = other._threads;
     _running = other._running;
+    _capacity = other._capacity;
+    _overload = other._overload;
     _workers = std::move(other._workers);
     _next.store(other._next.load());
 }
@@ -48,12 +53,24 @@ ThreadPool& ThreadPool::operator=(ThreadPool&& other) noexcept
     {
         _threads = other._threads;
         _running = other._running;
+        _capacity = other._capacity;
+        _overload = other._overload;
         _workers = std::move(other._workers);
         _next.store(other._next.load());
     }
     return *this;
 }
 
+size_t ThreadPool::Pending() const
+{
+    size_t pending = 0;
+    for (const auto& worker : _workers)
+    {
+        pending += worker->Pending();
+    }
+    return pending;
+}
+
 } // namespace threading
 
 MINET_END
@@ -27,6 +27,12 @@ unsigned int HardwareConcurrency();
  * The thread pool manages collection of workers using the following strategy:
  *   1. Round-robin: Distribute tasks to workers in a round-robin fashion.
  *   2. Stealing: Workers can steal tasks from their neighbor to keep themselves busy.
+ * @note
+ * With an overload threshold, tasks with a key, e.g. a connection, go to the
+ * same home worker, and are only stolen or spread once it is overloaded.
+ * @note
+ * With a LIFO target, workers take the newest task first once the oldest
+ * one has waited longer than it, see AdaptiveQueue.
  */
 class ThreadPool final
 {
@@ -37,12 +43,19 @@ public:
      * @brief Create a thread pool. Won't start the workers.
      * @param threads Number of threads in the pool.
      * @param capacity Capacity of each worker, should be in power of 2.
+     * @param spin Time idle workers spin before parking, in microseconds.
+     * @param cpus CPUs to pin workers to in turn, empty to let them float.
+     * @param overload Pending tasks at which a worker is overloaded, 0 to
+     * always spread tasks round-robin, and let idle workers steal any time.
+     * @param lifo Time a task may wait before newer ones are taken first, in
+     * milliseconds, 0 to always take tasks in order.
      * @note The maximum capacity of the thread pool is thread * capacity.
      * @note
      * If capacity is not power of 2, it will be adjusted to the nearest
      * power of 2 that is greater than or equal to the given capacity.
      */
-    explicit ThreadPool(unsigned int threads, size_t capacity = 1024u);
+    explicit ThreadPool(unsigned int threads, size_t capacity = 1024u, unsigned spin = 0,
+                        const std::vector<int>& cpus = {}, size_t overload = 0, unsigned lifo = 0);
     ~ThreadPool();
 
     ThreadPool(const ThreadPool&) = delete;
@@ -56,14 +69,40 @@ public:
      * @param task The task to submit.
      * @return true on submitted, false if failed.
      * @note
-     * Return false doesn't mean the thread pool is completely full. It is
-     * just that the current selected worker is full.
+     * If the selected worker is full, other workers are tried in turn, so
+     * false means all of them are full at the moment.
      */
     template <typename T> bool Submit(T&& task);
 
+    /**
+     * @brief Submit a task to the home worker of the key, so that tasks of
+     * the same key run on the same core while it keeps up.
+     * @param key e.g. The connection the task belongs to.
+     * @note
+     * Fall back to round-robin if the home worker is overloaded, or the
+     * pool has no overload threshold.
+     */
+    template <typename T> bool Submit(size_t key, T&& task);
+
+    /**
+     * @brief Get the number of tasks waiting in all workers.
+     * @note It is only a snapshot, just like Worker::Pending.
+     */
+    size_t Pending() const;
+
+    /**
+     * @brief Get the maximum number of tasks waiting in all workers.
+     */
+    size_t Capacity() const
+    {
+        return _capacity;
+    }
+
 private:
     unsigned int _threads;
     bool _running;
+    size_t _capacity;
+    size_t _overload;
 
     /**
      * @brief Here, we use pointer to avoid move overhead.
@@ -74,8 +113,34 @@ private:
 
 template <typename T> bool ThreadPool::Submit(T&& task)
 {
-    size_t next = _next.fetch_add(1, std::memory_order_relaxed) % _threads;
-    return _workers[next]->Post(std::forward<T>(task));
+    size_t next = _next.fetch_add(1, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < _threads; i++)
+    {
+        // The task is only moved from on success, see below.
+        if (_workers[(next + i) % _threads]->Post(std::forward<T>(task)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T> bool ThreadPool::Submit(size_t key, T&& task)
+{
+    if (_overload > 0)
+    {
+        Worker<TaskFn>* home = _workers[key % _threads].get();
+        if (home->Pending() < _overload)
+        {
+            // The task is only moved from on success, so it is still
+            // there for round-robin if the queue is full.
+            if (home->Post(std::forward<T>(task)))
+            {
+                return true;
+            }
+        }
+    }
+    return Submit(std::forward<T>(task));
 }
 
 } // namespace threading
@@ -9,9 +9,13 @@
 #include "minet/common/Base.h"
 
 #include "threading/Queue.h"
+#include "utils/Native.h"
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
 #include <thread>
 
 MINET_BEGIN
@@ -52,11 +56,30 @@ namespace threading
  * @note
  * Although workers run asynchronously, they are managed in one thread by
  * the pool. So, there should be no concurrent problem in this layer.
+ * @note
+ * With an overload threshold, a worker keeps its tasks to itself until it
+ * has that many pending, so that tasks posted to it stay on its core.
+ * @note
+ * An idle worker spins for a while before it parks, and Post wakes up a
+ * parked worker at once. Parked workers still wake up from time to time
+ * to steal from their donor, which does not wake them up.
+ * @note
+ * With a LIFO target, tasks are kept in an AdaptiveQueue instead, so that
+ * fresh tasks are taken first once the oldest one is late.
  */
 template <typename TTask> class Worker final
 {
 public:
-    Worker(size_t capacity);
+    /**
+     * @param capacity Capacity of the task queue.
+     * @param spin Time to spin for new tasks before parking, in microseconds.
+     * @param cpu The CPU to pin the worker to, < 0 to let it float.
+     * @param overload Pending tasks at which the worker is overloaded, see
+     * Pending. Its neighbor only steals from it then, 0 to steal any time.
+     * @param lifo Time the oldest task may wait before newer ones are taken
+     * first, in milliseconds, 0 to always take tasks in order.
+     */
+    Worker(size_t capacity, unsigned spin = 0, int cpu = -1, size_t overload = 0, unsigned lifo = 0);
     ~Worker() = default;
 
     Worker(const Worker&) = delete;
@@ -75,26 +98,67 @@ public:
      */
     template <typename T> bool Post(T&& task);
 
+    /**
+     * @brief Get the number of tasks waiting in the queue.
+     */
+    size_t Pending() const
+    {
+        return _lifo ? _lifo->Size() : _queue->Size();
+    }
+
 private:
+    bool _Pop(TTask* task);
     bool _Steal(TTask* task);
     void _Routine(Worker* donor);
 
+    /**
+     * @brief Sleep until a task is posted, or the park timeout expires.
+     * @param task Output the task posted right before parking.
+     * @return Whether there is such a task.
+     */
+    bool _Park(TTask* task);
+
+    /**
+     * @brief Create the task queue on the CPU of the worker, so that it is
+     * first touched, thus allocated, on the local NUMA node.
+     */
+    void _CreateQueue(size_t capacity, unsigned lifo);
+
 private:
-    Queue<TTask> _queue;
+    // Parked workers check their donor this often, in milliseconds.
+    static constexpr int PARK_TIMEOUT = 1;
+
+    // Only one of them is created.
+    std::optional<Queue<TTask>> _queue;
+    Ref<AdaptiveQueue<TTask>> _lifo;
     std::thread _thread;
     std::atomic<bool> _running;
+    unsigned _spin;
+    int _cpu;
+    size_t _overload;
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::atomic<bool> _parked;
 };
 
 template <typename TTask>
-Worker<TTask>::Worker(size_t capacity) : _queue(detail::MakePowerOfTwo(capacity)), _running(false)
+Worker<TTask>::Worker(size_t capacity, unsigned spin, int cpu, size_t overload, unsigned lifo)
+    : _running(false), _spin(spin), _cpu(cpu), _overload(overload), _parked(false)
 {
+    _CreateQueue(detail::MakePowerOfTwo(capacity), lifo);
 }
 
 template <typename TTask> Worker<TTask>::Worker(Worker&& other) noexcept
 {
     _queue = std::move(other._queue);
+    _lifo = std::move(other._lifo);
     _thread = std::move(other._thread);
-    _running = other._running;
+    _running = other._running.load();
+    _spin = other._spin;
+    _cpu = other._cpu;
+    _overload = other._overload;
+    _parked = false;
 }
 
 template <typename TTask> Worker<TTask>& Worker<TTask>::operator=(Worker&& other) noexcept
@@ -102,8 +166,12 @@ template <typename TTask> Worker<TTask>& Worker<TTask>::operator=(Worker&& other
     if (this != &other)
     {
         _queue = std::move(other._queue);
+        _lifo = std::move(other._lifo);
         _thread = std::move(other._thread);
-        _running = other._running;
+        _running = other._running.load();
+        _spin = other._spin;
+        _cpu = other._cpu;
+        _overload = other._overload;
     }
     return *this;
 }
@@ -117,35 +185,134 @@ template <typename TTask> void Worker<TTask>::Start(Worker* donor)
 template <typename TTask> void Worker<TTask>::Stop()
 {
     _running.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cv.notify_one();
+    }
     _thread.join();
 }
 
 template <typename TTask> template <typename T> bool Worker<TTask>::Post(T&& task)
 {
-    return _queue.Push(std::forward<T>(task));
+    if (!(_lifo ? _lifo->Push(std::forward<T>(task)) : _queue->Push(std::forward<T>(task))))
+    {
+        return false;
+    }
+
+    // Pairs with the fence in _Park, so that either the worker sees the
+    // task, or we see it parked.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_parked.load(std::memory_order_relaxed))
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _parked.store(false, std::memory_order_relaxed);
+        }
+        _cv.notify_one();
+    }
+
+    return true;
+}
+
+template <typename TTask> bool Worker<TTask>::_Pop(TTask* task)
+{
+    return _lifo ? _lifo->Pop(task) : _queue->Pop(task);
 }
 
 template <typename TTask> bool Worker<TTask>::_Steal(TTask* task)
 {
-    return _queue.Pop(task);
+    // Leave the tasks to this worker, whose cache is warm for them.
+    if ((_overload > 0) && (Pending() < _overload))
+    {
+        return false;
+    }
+    return _Pop(task);
 }
 
 template <typename TTask> void Worker<TTask>::_Routine(Worker* donor)
 {
+    using namespace std::chrono;
+
+    native::PinThread(_cpu);
+
     TTask task;
+    steady_clock::time_point spinUntil;
+    bool spinning = false;
     while (_running.load(std::memory_order_relaxed))
     {
         // Get one from the worker itself, or steal one to keep busy.
-        if (_queue.Pop(&task) || donor->_Steal(&task))
+        if (_Pop(&task) || donor->_Steal(&task))
+        {
+            task();
+            spinning = false;
+            continue;
+        }
+
+        // Spin for a while first, trading CPU for the latency of a wake-up.
+        if (_spin > 0)
+        {
+            auto now = steady_clock::now();
+            if (!spinning)
+            {
+                spinning = true;
+                spinUntil = now + microseconds(_spin);
+            }
+            if (now < spinUntil)
+            {
+                continue;
+            }
+        }
+
+        // Avoid consuming too much CPU.
+        if (_Park(&task))
         {
             task();
         }
+        spinning = false;
+    }
+}
+
+template <typename TTask> bool Worker<TTask>::_Park(TTask* task)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // A task posted before the flag is visible would not wake us up.
+    bool popped = _Pop(task);
+    if (!popped)
+    {
+        _cv.wait_for(lock, std::chrono::milliseconds(PARK_TIMEOUT), [this] {
+            return !_parked.load(std::memory_order_relaxed) || !_running.load(std::memory_order_relaxed);
+        });
+    }
+    _parked.store(false, std::memory_order_relaxed);
+
+    return popped;
+}
+
+template <typename TTask> void Worker<TTask>::_CreateQueue(size_t capacity, unsigned lifo)
+{
+    auto create = [this, capacity, lifo] {
+        if (lifo > 0)
+        {
+            _lifo = CreateRef<AdaptiveQueue<TTask>>(capacity, lifo);
+        }
         else
         {
-            // Avoid consuming too much CPU.
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            _queue.emplace(capacity);
         }
+    };
+
+    if (_cpu < 0)
+    {
+        create();
+        return;
     }
+    std::thread([&create, this] {
+        native::PinThread(_cpu);
+        create();
+    }).join();
 }
 
 }; // namespace threading
@@ -16,7 +16,8 @@ namespace details
 
 inline bool IsPathChar(char ch)
 {
-    static const char EXTRA_PATH_CHARS[] = "-._~:/?#[]@!$&'()*+,;=";
+    // Including '%' of percent-encoded characters.
+    static const char EXTRA_PATH_CHARS[] = "-._~:/?#[]@!$&'()*+,;=%";
     return isalnum(ch) || (strchr(EXTRA_PATH_CHARS, ch) != nullptr);
 }
 
@@ -64,6 +65,16 @@ int AsyncHttpRequestParser::Feed(char ch)
     return (this->*_handler)(ch);
 }
 
+bool AsyncHttpRequestParser::IsStarted() const
+{
+    return _handler != &AsyncHttpRequestParser::_ParseStart;
+}
+
+bool AsyncHttpRequestParser::IsHeaderCompleted() const
+{
+    return (_handler == &AsyncHttpRequestParser::_ParseBody) || (_handler == &AsyncHttpRequestParser::_ParseDone);
+}
+
 int AsyncHttpRequestParser::_ParseStart(char ch)
 {
     if (isalpha(ch))
@@ -0,0 +1,77 @@
+#include "utils/CoDel.h"
+
+#include "minet/common/Assert.h"
+
+#include <cmath>
+
+MINET_BEGIN
+
+CoDel::CoDel(unsigned target, unsigned interval)
+    : _target(target), _interval(interval), _firstAbove(0), _dropNext(0), _count(0), _lastCount(0), _dropping(false)
+{
+    MINET_ASSERT(interval > 0);
+}
+
+bool CoDel::ShouldDrop(int64_t sojourn, int64_t now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    bool above = _IsAboveTarget(sojourn, now);
+    if (_dropping)
+    {
+        if (!above)
+        {
+            _dropping = false;
+            return false;
+        }
+        if (now < _dropNext)
+        {
+            return false;
+        }
+        _count++;
+        _dropNext = _ControlLaw(_dropNext);
+        return true;
+    }
+
+    if (!above)
+    {
+        return false;
+    }
+
+    // Pick up the drop rate from last time, if it was not long ago, as the
+    // queue is likely still overloaded.
+    _dropping = true;
+    unsigned delta = _count - _lastCount;
+    _count = ((delta > 1) && (now - _dropNext < 16 * _interval)) ? delta : 1;
+    _lastCount = _count;
+    _dropNext = _ControlLaw(now);
+    return true;
+}
+
+bool CoDel::IsDropping() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _dropping;
+}
+
+bool CoDel::_IsAboveTarget(int64_t sojourn, int64_t now)
+{
+    if (sojourn < _target)
+    {
+        _firstAbove = 0;
+        return false;
+    }
+    if (_firstAbove == 0)
+    {
+        _firstAbove = now + _interval;
+        return false;
+    }
+    return now >= _firstAbove;
+}
+
+int64_t CoDel::_ControlLaw(int64_t time) const
+{
+    return time + static_cast<int64_t>(static_cast<double>(_interval) / std::sqrt(static_cast<double>(_count)));
+}
+
+MINET_END
@@ -0,0 +1,71 @@
+/**
+ * @author Tony S.
+ * @details Controlled delay for request queues.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <cstdint>
+#include <mutex>
+
+MINET_BEGIN
+
+/**
+ * @brief CoDel, deciding which requests to drop by how long they queued.
+ * @note
+ * A short burst is absorbed, as nothing is dropped until requests have
+ * waited longer than the target for a whole interval. Then requests are
+ * dropped at a rate growing with the square root of the drop count, until
+ * the delay goes below the target again.
+ * @note Thread-safe, as all workers report to the same one.
+ * @ref https://queue.acm.org/detail.cfm?id=2209336
+ * @ref RFC 8289
+ */
+class CoDel final
+{
+public:
+    /**
+     * @param target Acceptable time in queue, in milliseconds.
+     * @param interval Time the delay may stay above the target before
+     * dropping starts, in milliseconds.
+     */
+    CoDel(unsigned target, unsigned interval);
+
+    /**
+     * @brief Tell whether to drop a request just taken from the queue.
+     * @param sojourn Time the request has spent in queue, in milliseconds.
+     * @param now Current time, in milliseconds.
+     */
+    bool ShouldDrop(int64_t sojourn, int64_t now);
+
+    /**
+     * @brief Whether requests are being dropped now.
+     */
+    bool IsDropping() const;
+
+private:
+    /**
+     * @brief Whether the delay has stayed above the target for an interval.
+     */
+    bool _IsAboveTarget(int64_t sojourn, int64_t now);
+
+    /**
+     * @brief Time of the next drop, sooner as more are dropped.
+     */
+    int64_t _ControlLaw(int64_t time) const;
+
+private:
+    int64_t _target;
+    int64_t _interval;
+
+    mutable std::mutex _mutex;
+    int64_t _firstAbove; // when the delay is known above target for an interval, 0 if below
+    int64_t _dropNext;   // when to drop the next one while dropping
+    unsigned _count;     // drops since dropping started
+    unsigned _lastCount; // count when dropping stopped last time
+    bool _dropping;
+};
+
+MINET_END
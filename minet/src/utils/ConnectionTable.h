@@ -0,0 +1,165 @@
+/**
+ * @author Tony S.
+ * @details Connection table indexed by file descriptor.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+MINET_BEGIN
+
+namespace network
+{
+
+/**
+ * @brief Maps file descriptors to connections, and grows on demand.
+ * @tparam TConnection Type of the connection.
+ * @note
+ * Each slot carries a generation, bumped every time the fd is reused, so
+ * that a stale connection held by someone else can be told from the new
+ * one with the same fd.
+ * @warning Not thread-safe, it belongs to the reactor.
+ */
+template <typename TConnection> class ConnectionTable final
+{
+public:
+    /**
+     * @param limit Maximum fd plus one, the table never grows beyond it.
+     */
+    explicit ConnectionTable(size_t limit);
+
+    /**
+     * @brief Add a connection.
+     * @return The generation of the connection, 0 if the fd is out of limit.
+     */
+    uint32_t Insert(int fd, const Ref<TConnection>& connection);
+
+    /**
+     * @brief Remove the connection, and invalidate its generation.
+     */
+    void Remove(int fd);
+
+    /**
+     * @return The connection on fd, nullptr if none.
+     */
+    const Ref<TConnection>& Get(int fd) const;
+
+    /**
+     * @brief Whether the connection on fd is still the one of the generation.
+     */
+    bool IsCurrent(int fd, uint32_t generation) const;
+
+    /**
+     * @return Upper bound of fd in use, for iteration.
+     */
+    int End() const
+    {
+        return static_cast<int>(_slots.size());
+    }
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+    size_t Limit() const
+    {
+        return _limit;
+    }
+
+private:
+    struct Slot
+    {
+        Ref<TConnection> Connection;
+        uint32_t Generation = 0;
+    };
+
+    std::vector<Slot> _slots;
+    size_t _size;
+    size_t _limit;
+
+    static const Ref<TConnection> _empty;
+};
+
+/*
+ * ===================================================================
+ * ------------------ ConnectionTable Implementation -----------------
+ * ===================================================================
+ */
+
+template <typename TConnection> const Ref<TConnection> ConnectionTable<TConnection>::_empty;
+
+template <typename TConnection> ConnectionTable<TConnection>::ConnectionTable(size_t limit) : _size(0), _limit(limit)
+{
+    static constexpr size_t INITIAL_SLOTS = 1024;
+    _slots.resize(std::min(INITIAL_SLOTS, _limit));
+}
+
+template <typename TConnection>
+uint32_t ConnectionTable<TConnection>::Insert(int fd, const Ref<TConnection>& connection)
+{
+    size_t index = static_cast<size_t>(fd);
+    if ((fd < 0) || (index >= _limit))
+    {
+        return 0;
+    }
+    if (index >= _slots.size())
+    {
+        // fd is allocated from the lowest, so doubling is enough most of the time.
+        _slots.resize(std::min(std::max(index + 1, _slots.size() * 2), _limit));
+    }
+
+    Slot& slot = _slots[index];
+    if (!slot.Connection)
+    {
+        _size++;
+    }
+    slot.Connection = connection;
+    if (++slot.Generation == 0)
+    {
+        slot.Generation = 1; // 0 is never valid
+    }
+
+    return slot.Generation;
+}
+
+template <typename TConnection> void ConnectionTable<TConnection>::Remove(int fd)
+{
+    size_t index = static_cast<size_t>(fd);
+    if ((fd < 0) || (index >= _slots.size()) || !_slots[index].Connection)
+    {
+        return;
+    }
+    _slots[index].Connection.reset();
+    _slots[index].Generation++;
+    _size--;
+}
+
+template <typename TConnection> const Ref<TConnection>& ConnectionTable<TConnection>::Get(int fd) const
+{
+    size_t index = static_cast<size_t>(fd);
+    if ((fd < 0) || (index >= _slots.size()))
+    {
+        return _empty;
+    }
+    return _slots[index].Connection;
+}
+
+template <typename TConnection> bool ConnectionTable<TConnection>::IsCurrent(int fd, uint32_t generation) const
+{
+    size_t index = static_cast<size_t>(fd);
+    if ((fd < 0) || (index >= _slots.size()))
+    {
+        return false;
+    }
+    return _slots[index].Connection && (_slots[index].Generation == generation);
+}
+
+} // namespace network
+
+MINET_END
@@ -1,5 +1,6 @@
 #include "utils/Epoll.h"
 
+#include <chrono>
 #include <unistd.h>
 
 MINET_BEGIN
@@ -9,7 +10,7 @@ namespace epoll
 
 int Create()
 {
-    return epoll_create1(0);
+    return epoll_create1(EPOLL_CLOEXEC);
 }
 
 int Close(int epfd)
@@ -42,6 +43,14 @@ int Unmonitor(int epfd, int fd)
     return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
 }
 
+int Modify(int epfd, int fd, uint32_t events)
+{
+    epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event);
+}
+
 int Modify(int epfd, int fd, uint32_t events, void* data)
 {
     epoll_event event;
@@ -55,6 +64,26 @@ int Wait(int epfd, epoll_event* events, int maxEvents, int timeout)
     return epoll_wait(epfd, events, maxEvents, timeout);
 }
 
+int BusyWait(int epfd, epoll_event* events, int maxEvents, int timeout, unsigned spin)
+{
+    using namespace std::chrono;
+
+    if ((spin > 0) && (timeout != 0))
+    {
+        auto spinUntil = steady_clock::now() + microseconds(spin);
+        do
+        {
+            int count = epoll_wait(epfd, events, maxEvents, 0);
+            if (count != 0)
+            {
+                return count;
+            }
+        } while (steady_clock::now() < spinUntil);
+    }
+
+    return epoll_wait(epfd, events, maxEvents, timeout);
+}
+
 } // namespace epoll
 
 MINET_END
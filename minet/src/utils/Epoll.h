@@ -49,6 +49,15 @@ int Monitor(int epfd, int fd, uint32_t events, void* data);
  */
 int Unmonitor(int epfd, int fd);
 
+/**
+ * @brief Modify a monitored epoll event.
+ * @param epfd Epoll fd.
+ * @param fd The fd.
+ * @param events The events to monitor.
+ * @return 0 on success, -1 on failure.
+ */
+int Modify(int epfd, int fd, uint32_t events);
+
 /**
  * @brief Modify a monitored epoll event.
  * @param epfd Epoll fd.
@@ -70,6 +79,18 @@ int Modify(int epfd, int fd, uint32_t events, void* data);
  */
 int Wait(int epfd, epoll_event* events, int maxEvents, int timeout = 5000);
 
+/**
+ * @brief Poll epoll events for a while before blocking on them.
+ * @param epfd Wait for epoll events.
+ * @param events The events buffer.
+ * @param maxEvents Maximum events returned this time.
+ * @param timeout The maximum wait time after spinning, -1 to block forever.
+ * @param spin Time to poll with zero timeout first, in microseconds.
+ * @return The number of events returned. -1 on failure.
+ * @note It trades CPU for the latency of waking up the thread.
+ */
+int BusyWait(int epfd, epoll_event* events, int maxEvents, int timeout, unsigned spin);
+
 } // namespace epoll
 
 MINET_END
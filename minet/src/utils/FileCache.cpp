@@ -0,0 +1,89 @@
+#include "utils/FileCache.h"
+
+#include "minet/core/HttpContext.h"
+
+#include <chrono>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MINET_BEGIN
+
+static int64_t _Now()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+FileCache::FileCache(size_t capacity, unsigned maxAge) : _capacity(capacity), _maxAge(maxAge)
+{
+}
+
+Ref<FileBody> FileCache::Open(const std::string& path)
+{
+    int64_t now = _Now();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _index.find(path);
+        if (it != _index.end())
+        {
+            if (now - it->second->Opened < _maxAge)
+            {
+                _entries.splice(_entries.begin(), _entries, it->second);
+                return it->second->File;
+            }
+            _entries.erase(it->second);
+            _index.erase(it);
+        }
+    }
+
+    // Do not hold up others while talking to the file system.
+    Ref<FileBody> file = _OpenFile(path);
+    if (!file || (_capacity == 0) || (_maxAge == 0))
+    {
+        return file;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_index.find(path) != _index.end())
+    {
+        return file; // someone else opened it meanwhile
+    }
+    while (_entries.size() >= _capacity)
+    {
+        _index.erase(_entries.back().Path);
+        _entries.pop_back();
+    }
+    _entries.push_front({ path, file, now });
+    _index[path] = _entries.begin();
+
+    return file;
+}
+
+size_t FileCache::Size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+Ref<FileBody> FileCache::_OpenFile(const std::string& path)
+{
+    // Opening a FIFO would block until a writer shows up, and it has no
+    // effect on regular files.
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+
+    struct stat info;
+    if ((fstat(fd, &info) != 0) || !S_ISREG(info.st_mode))
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    return CreateRef<FileBody>(fd, static_cast<size_t>(info.st_size));
+}
+
+MINET_END
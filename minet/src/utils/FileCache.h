@@ -0,0 +1,71 @@
+/**
+ * @author Tony S.
+ * @details Cache of open files.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+MINET_BEGIN
+
+struct FileBody;
+
+/**
+ * @brief LRU cache of open files and their sizes, so that files served over
+ * and over are not opened and stat'ed for every request.
+ * @note
+ * Files are opened again once cached longer than the max age, so that a
+ * replaced file is picked up. Files taken out of the cache stay open until
+ * nobody is sending them.
+ * @note Thread-safe, as all workers share it.
+ */
+class FileCache final
+{
+public:
+    /**
+     * @param capacity Maximum number of files kept open.
+     * @param maxAge Time to trust a cached file, in milliseconds, 0 to open
+     * the file every time.
+     */
+    FileCache(size_t capacity, unsigned maxAge);
+
+    /**
+     * @brief Open a regular file, or take it from the cache.
+     * @param path Path of the file.
+     * @return The open file, nullptr if it is not a regular file, or it
+     * cannot be opened.
+     */
+    Ref<FileBody> Open(const std::string& path);
+
+    /**
+     * @brief Get the number of files cached.
+     */
+    size_t Size() const;
+
+private:
+    static Ref<FileBody> _OpenFile(const std::string& path);
+
+private:
+    struct Entry
+    {
+        std::string Path;
+        Ref<FileBody> File;
+        int64_t Opened;
+    };
+
+    size_t _capacity;
+    int64_t _maxAge;
+
+    mutable std::mutex _mutex;
+    std::list<Entry> _entries; // the most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+};
+
+MINET_END
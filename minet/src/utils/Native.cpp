@@ -1,6 +1,23 @@
 #include "utils/Native.h"
 
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
+
+extern char** environ;
 
 MINET_BEGIN
 
@@ -48,6 +65,151 @@ int RemoveSignalHandler(int sig)
     return 0;
 }
 
+static sigset_t _MakeSignalSet(std::initializer_list<int> signals)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    for (int sig : signals)
+    {
+        sigaddset(&set, sig);
+    }
+    return set;
+}
+
+int BlockSignals(std::initializer_list<int> signals)
+{
+    sigset_t set = _MakeSignalSet(signals);
+    return pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+int OpenSignalFd(std::initializer_list<int> signals)
+{
+    sigset_t set = _MakeSignalSet(signals);
+    return signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+int ReadSignal(int fd)
+{
+    signalfd_siginfo info;
+    if (read(fd, &info, sizeof(info)) != sizeof(info))
+    {
+        return 0;
+    }
+    return static_cast<int>(info.ssi_signo);
+}
+
+pid_t SpawnSelf(int fd, const char* name, bool child)
+{
+    // Everything is prepared before fork, as only async-signal-safe calls
+    // are allowed in the child of a multi-threaded process.
+    std::string cmdline;
+    {
+        std::ifstream file("/proc/self/cmdline", std::ios::binary);
+        cmdline.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if (cmdline.empty())
+    {
+        return -1;
+    }
+
+    // Start the executable now at the path, which may be a new version
+    // deployed over the running one.
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+    {
+        return -1;
+    }
+    path[length] = '\0';
+    static const char DELETED[] = " (deleted)";
+    if ((length > static_cast<ssize_t>(sizeof(DELETED) - 1)) &&
+        (strcmp(path + length - (sizeof(DELETED) - 1), DELETED) == 0))
+    {
+        path[length - (sizeof(DELETED) - 1)] = '\0';
+    }
+
+    std::vector<char*> argv;
+    for (size_t i = 0; i < cmdline.size(); i += strlen(&cmdline[i]) + 1)
+    {
+        argv.push_back(&cmdline[i]);
+    }
+    argv.push_back(nullptr);
+
+    std::string prefix = std::string(name) + "=";
+    std::string variable = prefix + std::to_string(fd);
+    std::vector<char*> envp;
+    for (char** env = environ; *env; env++)
+    {
+        if (strncmp(*env, prefix.c_str(), prefix.size()) != 0)
+        {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back(&variable[0]);
+    envp.push_back(nullptr);
+
+    sigset_t empty;
+    sigemptyset(&empty);
+
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        if (child)
+        {
+            // The parent may be gone before the death signal is set.
+            if ((prctl(PR_SET_PDEATHSIG, SIGTERM) != 0) || (getppid() != parent))
+            {
+                _exit(1);
+            }
+            setpgid(0, 0);
+        }
+        fcntl(fd, F_SETFD, 0);
+        sigprocmask(SIG_SETMASK, &empty, nullptr);
+        execve(path, argv.data(), envp.data());
+        _exit(127);
+    }
+
+    return pid;
+}
+
+int TakeSpawnedFd(const char* name)
+{
+    const char* value = getenv(name);
+    if (!value)
+    {
+        return -1;
+    }
+
+    int fd = atoi(value);
+    unsetenv(name);
+    if ((fd <= 0) || (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0))
+    {
+        return -1;
+    }
+
+    return fd;
+}
+
+size_t RaiseFileLimit()
+{
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+    {
+        return 0;
+    }
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        rlim_t current = limit.rlim_cur;
+        limit.rlim_cur = limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &limit) != 0)
+        {
+            limit.rlim_cur = current;
+        }
+    }
+    return static_cast<size_t>(limit.rlim_cur);
+}
+
 void _SignalHandler(int sig)
 {
     auto it = sSignalHandlers.find(sig);
@@ -63,6 +225,41 @@ void _SignalHandler(int sig)
     }
 }
 
+std::vector<int> GetAllowedCpus()
+{
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+int PinThread(int cpu)
+{
+    if (cpu < 0)
+    {
+        return 0;
+    }
+    if (cpu >= CPU_SETSIZE)
+    {
+        return EINVAL;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
 } // namespace native
 
 MINET_END
@@ -4,6 +4,9 @@
 
 #include <csignal> // include this so other files won't need manual inclusion
 #include <functional>
+#include <initializer_list>
+#include <sys/types.h> // pid_t
+#include <vector>
 
 MINET_BEGIN
 
@@ -27,6 +30,71 @@ int SetSignalHandler(int sig, const std::function<void()>& handler, bool once =
  */
 int RemoveSignalHandler(int sig);
 
+/**
+ * @brief Block the given signals in the calling thread, so that they are
+ * only received by a signalfd.
+ * @return 0 on success, others on failure.
+ * @note Threads created afterwards inherit the signal mask, so call it
+ * before any thread is started.
+ */
+int BlockSignals(std::initializer_list<int> signals);
+
+/**
+ * @brief Open a signalfd for the given signals, which must be blocked.
+ * @return The signalfd, or -1 on failure.
+ */
+int OpenSignalFd(std::initializer_list<int> signals);
+
+/**
+ * @brief Read one pending signal from a signalfd.
+ * @return The signal number, or 0 if none is pending.
+ */
+int ReadSignal(int fd);
+
+/**
+ * @brief Start the current executable again with the same arguments, and
+ * pass an open fd to it.
+ * @param fd The fd to keep open in the new process.
+ * @param name Environment variable telling the new process the fd.
+ * @param child Whether the new process is bound to this one, i.e. it gets
+ * SIGTERM when this process exits, and no signal from the terminal.
+ * @return Pid of the new process, or -1 on failure.
+ * @note
+ * The new process starts with no signal blocked, and inherits all fds
+ * without FD_CLOEXEC as well.
+ */
+pid_t SpawnSelf(int fd, const char* name, bool child = false);
+
+/**
+ * @brief Get the fd passed by SpawnSelf, so that it is not passed further.
+ * @param name The same environment variable given to SpawnSelf.
+ * @return The fd, or -1 if this process is not spawned by SpawnSelf.
+ */
+int TakeSpawnedFd(const char* name);
+
+/**
+ * @brief Raise the soft limit of open files up to the hard limit.
+ * @return The limit of open files after raising.
+ * @note If it cannot be raised, the current limit is returned.
+ */
+size_t RaiseFileLimit();
+
+/**
+ * @brief Get the CPUs this process is allowed to run on.
+ * @return CPU numbers in ascending order, empty on failure.
+ */
+std::vector<int> GetAllowedCpus();
+
+/**
+ * @brief Pin the calling thread to one CPU.
+ * @param cpu The CPU, < 0 to leave the thread as it is.
+ * @return 0 on success, error number on failure.
+ * @note
+ * Memory first touched by the thread afterwards comes from the NUMA node
+ * of the CPU, under the default memory policy.
+ */
+int PinThread(int cpu);
+
 } // namespace native
 
 MINET_END
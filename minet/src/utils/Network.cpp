@@ -2,9 +2,19 @@
 
 #include "minet/common/Assert.h"
 
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
 #include <fcntl.h>
+#include <linux/errqueue.h>
+#include <mutex>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 MINET_BEGIN
@@ -12,9 +22,33 @@ MINET_BEGIN
 namespace network
 {
 
-int OpenSocket(uint16_t port, bool block)
+// At most this many sockets are handed over at once.
+static constexpr size_t MAX_PASSED_SOCKETS = 64;
+
+static std::vector<int> sInheritedSockets;
+static std::mutex sInheritedMutex;
+
+static int _AdoptSocket(const sockaddr* address, socklen_t length);
+static int _ReuseSocket(int fd, bool block, const SocketProfile& profile);
+static int _MakeUnixAddress(const std::string& path, sockaddr_un* address, socklen_t* length);
+static int _RemoveStaleSocket(const sockaddr_un& address, socklen_t length);
+static int _SetOption(int fd, int level, int name, int value);
+static int _TuneListenSocket(int fd, const SocketProfile& profile);
+
+int OpenSocket(uint16_t port, bool block, bool reusePort, const SocketProfile& profile)
 {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    int fd = _AdoptSocket(reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    if (fd >= 0)
+    {
+        return _ReuseSocket(fd, block, profile);
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (fd < 0)
     {
         return fd;
@@ -23,14 +57,15 @@ int OpenSocket(uint16_t port, bool block)
     // Here, we do not reuse the address and port.
     int opt = 1;
     MINET_TRY_WITH_ACTION(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)), close(fd));
+    if (reusePort)
+    {
+        MINET_TRY_WITH_ACTION(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)), close(fd));
+    }
 
-    sockaddr_in address = {};
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons(port);
     MINET_TRY_WITH_ACTION(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), close(fd));
 
-    MINET_TRY_WITH_ACTION(listen(fd, 2048), close(fd));
+    MINET_TRY_WITH_ACTION(_TuneListenSocket(fd, profile), close(fd));
+    MINET_TRY_WITH_ACTION(listen(fd, static_cast<int>(profile.Backlog)), close(fd));
 
     if (!block)
     {
@@ -40,23 +75,291 @@ int OpenSocket(uint16_t port, bool block)
     return fd;
 }
 
+int OpenUnixSocket(const std::string& path, bool block, const SocketProfile& profile)
+{
+    sockaddr_un address = {};
+    socklen_t length = 0;
+    MINET_TRY(_MakeUnixAddress(path, &address, &length));
+
+    int fd = _AdoptSocket(reinterpret_cast<sockaddr*>(&address), length);
+    if (fd >= 0)
+    {
+        return _ReuseSocket(fd, block, profile);
+    }
+
+    // A file left by a process that did not exit cleanly blocks bind.
+    MINET_TRY(_RemoveStaleSocket(address, length));
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return fd;
+    }
+
+    MINET_TRY_WITH_ACTION(bind(fd, reinterpret_cast<sockaddr*>(&address), length), close(fd));
+
+    MINET_TRY_WITH_ACTION(_TuneListenSocket(fd, profile), close(fd));
+    MINET_TRY_WITH_ACTION(listen(fd, static_cast<int>(profile.Backlog)), close(fd));
+
+    if (!block)
+    {
+        MINET_TRY_WITH_ACTION(MakeNonBlockingSocket(fd), close(fd));
+    }
+
+    return fd;
+}
+
+void InheritSockets(const std::vector<int>& fds)
+{
+    std::lock_guard<std::mutex> lock(sInheritedMutex);
+    sInheritedSockets.insert(sInheritedSockets.end(), fds.begin(), fds.end());
+}
+
+void CloseInheritedSockets()
+{
+    std::lock_guard<std::mutex> lock(sInheritedMutex);
+    for (int fd : sInheritedSockets)
+    {
+        close(fd);
+    }
+    sInheritedSockets.clear();
+}
+
+int SendSockets(int channel, const std::vector<int>& fds)
+{
+    if (fds.empty() || (fds.size() > MAX_PASSED_SOCKETS))
+    {
+        return -1;
+    }
+
+    // At least one byte of data must go with the fds.
+    uint32_t count = static_cast<uint32_t>(fds.size());
+    iovec iov = { &count, sizeof(count) };
+
+    char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_SOCKETS)] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+    return (sendmsg(channel, &msg, MSG_NOSIGNAL) == sizeof(count)) ? 0 : -1;
+}
+
+int ReceiveSockets(int channel, std::vector<int>* fds)
+{
+    MINET_ASSERT(fds);
+
+    uint32_t count = 0;
+    iovec iov = { &count, sizeof(count) };
+
+    char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_SOCKETS)] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != sizeof(count))
+    {
+        return -1;
+    }
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS))
+        {
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* data = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds->insert(fds->end(), data, data + n);
+        }
+    }
+
+    return ((fds->size() == count) && !(msg.msg_flags & MSG_CTRUNC)) ? 0 : -1;
+}
+
+int _AdoptSocket(const sockaddr* address, socklen_t length)
+{
+    std::lock_guard<std::mutex> lock(sInheritedMutex);
+    for (auto it = sInheritedSockets.begin(); it != sInheritedSockets.end(); ++it)
+    {
+        sockaddr_storage bound = {};
+        socklen_t size = sizeof(bound);
+        if ((getsockname(*it, reinterpret_cast<sockaddr*>(&bound), &size) != 0) ||
+            (bound.ss_family != address->sa_family))
+        {
+            continue;
+        }
+
+        // TCP sockets are matched by port only, as they listen on any address.
+        bool matched = (address->sa_family == AF_INET)
+                           ? (reinterpret_cast<sockaddr_in*>(&bound)->sin_port ==
+                              reinterpret_cast<const sockaddr_in*>(address)->sin_port)
+                           : ((size == length) && (memcmp(&bound, address, length) == 0));
+        if (matched)
+        {
+            int fd = *it;
+            sInheritedSockets.erase(it);
+            return fd;
+        }
+    }
+    return -1;
+}
+
+int _ReuseSocket(int fd, bool block, const SocketProfile& profile)
+{
+    // The previous process may have used another mode and profile,
+    // and listen again only updates the backlog.
+    int flag = fcntl(fd, F_GETFL, 0);
+    flag = block ? (flag & ~O_NONBLOCK) : (flag | O_NONBLOCK);
+    MINET_TRY_WITH_ACTION(fcntl(fd, F_SETFL, flag), close(fd));
+    MINET_TRY_WITH_ACTION(_TuneListenSocket(fd, profile), close(fd));
+    MINET_TRY_WITH_ACTION(listen(fd, static_cast<int>(profile.Backlog)), close(fd));
+    return fd;
+}
+
+int _MakeUnixAddress(const std::string& path, sockaddr_un* address, socklen_t* length)
+{
+    // Abstract names are not NUL-terminated, and paths must leave room for it.
+    bool abstract = !path.empty() && (path[0] == '@');
+    if (path.empty() || (path.size() > sizeof(address->sun_path) - (abstract ? 0 : 1)))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, path.data(), path.size());
+    if (abstract)
+    {
+        address->sun_path[0] = '\0';
+    }
+    *length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + (abstract ? 0 : 1));
+
+    return 0;
+}
+
+int _RemoveStaleSocket(const sockaddr_un& address, socklen_t length)
+{
+    struct stat st = {};
+    if ((address.sun_path[0] == '\0') || (stat(address.sun_path, &st) != 0) || !S_ISSOCK(st.st_mode))
+    {
+        return 0; // abstract, missing, or not ours to remove
+    }
+
+    // Only remove the file if no one is listening on it.
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return fd;
+    }
+    int r = connect(fd, reinterpret_cast<const sockaddr*>(&address), length);
+    int error = errno;
+    close(fd);
+    if (r == 0)
+    {
+        errno = EADDRINUSE;
+        return -1;
+    }
+
+    return (error == ECONNREFUSED) ? unlink(address.sun_path) : 0;
+}
+
+int _SetOption(int fd, int level, int name, int value)
+{
+    return setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+int _TuneListenSocket(int fd, const SocketProfile& profile)
+{
+    int domain = AF_INET;
+    socklen_t size = sizeof(domain);
+    MINET_TRY(getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &size));
+
+    // Set switches either way, as an adopted socket may carry the profile
+    // of the previous process. Unix domain sockets have no TCP options.
+    if (domain == AF_INET)
+    {
+        MINET_TRY(_SetOption(fd, IPPROTO_TCP, TCP_NODELAY, profile.NoDelay ? 1 : 0));
+        MINET_TRY(_SetOption(fd, SOL_SOCKET, SO_KEEPALIVE, profile.KeepAlive ? 1 : 0));
+        MINET_TRY(
+            _SetOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, static_cast<int>((profile.DeferAccept + 999) / 1000)));
+        MINET_TRY(_SetOption(fd, IPPROTO_TCP, TCP_FASTOPEN, static_cast<int>(profile.FastOpen)));
+        MINET_TRY(_SetOption(fd, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(profile.BusyPoll)));
+    }
+
+    if (profile.ReceiveBuffer > 0)
+    {
+        MINET_TRY(_SetOption(fd, SOL_SOCKET, SO_RCVBUF, static_cast<int>(profile.ReceiveBuffer)));
+    }
+    if (profile.SendBuffer > 0)
+    {
+        MINET_TRY(_SetOption(fd, SOL_SOCKET, SO_SNDBUF, static_cast<int>(profile.SendBuffer)));
+    }
+
+    return 0;
+}
+
 int CloseSocket(int fd)
 {
     return close(fd);
 }
 
-bool AcceptSocket(int fd, AcceptData* data)
+bool AcceptSocket(int fd, AcceptData* data, int flags)
 {
-    // This is annoying, but we have to do this.
-    static socklen_t size = sizeof(sockaddr_in);
-
     MINET_ASSERT(data);
 
-    data->SocketFd = accept(fd, reinterpret_cast<sockaddr*>(&data->Address), &size);
+    // This is annoying, but we have to do this. It is an in-out parameter,
+    // so it cannot be shared between threads accepting concurrently.
+    data->AddressLength = sizeof(data->Address);
+
+    // Set flags of the new socket at once, saving fcntl calls after it.
+    data->SocketFd = accept4(fd, reinterpret_cast<sockaddr*>(&data->Address), &data->AddressLength, flags);
 
     return data->SocketFd > 0;
 }
 
+int TuneSocket(int fd, const SocketProfile& profile)
+{
+    MINET_ASSERT(fd > 0);
+
+    // Buffer sizes and SO_KEEPALIVE are inherited from the listen socket,
+    // but TCP_NODELAY is not on every kernel, and TCP_QUICKACK never is.
+    if (profile.NoDelay)
+    {
+        MINET_TRY(_SetOption(fd, IPPROTO_TCP, TCP_NODELAY, 1));
+    }
+    if (profile.QuickAck)
+    {
+        MINET_TRY(_SetOption(fd, IPPROTO_TCP, TCP_QUICKACK, 1));
+    }
+
+    return 0;
+}
+
+int WaitSocket(int fd, int wakeFd, int timeout)
+{
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+    int r = poll(fds, (wakeFd < 0) ? 1 : 2, timeout);
+    if (r < 0)
+    {
+        return (errno == EINTR) ? 0 : r;
+    }
+
+    // Being woken up takes precedence.
+    if ((wakeFd >= 0) && (fds[1].revents != 0))
+    {
+        return 0;
+    }
+    return (fds[0].revents != 0) ? 1 : 0;
+}
+
 int MakeNonBlockingSocket(int fd)
 {
     MINET_ASSERT(fd > 0);
@@ -73,14 +376,99 @@ int MakeNonBlockingSocket(int fd)
     return 0;
 }
 
+int SetReceiveTimeout(int fd, unsigned milliseconds)
+{
+    MINET_ASSERT(fd > 0);
+
+    timeval timeout;
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_usec = (milliseconds % 1000) * 1000;
+    MINET_TRY(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+
+    return 0;
+}
+
 ssize_t ReadSocket(int fd, char* buffer, size_t length)
 {
     return recv(fd, buffer, length, 0);
 }
 
-ssize_t WriteSocket(int fd, const char* buffer, size_t length)
+ssize_t WriteSocket(int fd, const char* buffer, size_t length, int flags)
+{
+    // Peer may close a kept-alive connection at any time, don't get killed by SIGPIPE.
+    return send(fd, buffer, length, flags | MSG_NOSIGNAL);
+}
+
+int EnableZeroCopy(int fd)
+{
+    MINET_ASSERT(fd > 0);
+    return _SetOption(fd, SOL_SOCKET, SO_ZEROCOPY, 1);
+}
+
+int ReapZeroCopy(int fd, const std::function<void(uint32_t, uint32_t)>& completed, bool* copied)
 {
-    return send(fd, buffer, length, 0);
+    MINET_ASSERT(fd > 0);
+
+    int ranges = 0;
+    while (true)
+    {
+        alignas(cmsghdr) char control[128];
+        msghdr message = {};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? ranges : -1;
+        }
+
+        for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg))
+        {
+            bool ip = (cmsg->cmsg_level == SOL_IP) && (cmsg->cmsg_type == IP_RECVERR);
+            bool ipv6 = (cmsg->cmsg_level == SOL_IPV6) && (cmsg->cmsg_type == IPV6_RECVERR);
+            if (!ip && !ipv6)
+            {
+                continue;
+            }
+
+            // Completions of consecutive sends are merged into a range.
+            const auto* error = reinterpret_cast<const sock_extended_err*>(CMSG_DATA(cmsg));
+            if (error->ee_origin == SO_EE_ORIGIN_ZEROCOPY)
+            {
+                if (error->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                {
+                    *copied = true;
+                }
+                completed(error->ee_info, error->ee_data);
+                ranges++;
+            }
+        }
+    }
+}
+
+std::string AddressToHost(const sockaddr* address, socklen_t length)
+{
+    if (address->sa_family == AF_INET)
+    {
+        const auto* in = reinterpret_cast<const sockaddr_in*>(address);
+        return AddressToHost(in->sin_addr.s_addr, in->sin_port);
+    }
+    if (address->sa_family != AF_UNIX)
+    {
+        return "unknown";
+    }
+
+    // Clients of a Unix domain socket are usually not bound to any name.
+    const auto* un = reinterpret_cast<const sockaddr_un*>(address);
+    size_t size = (length > offsetof(sockaddr_un, sun_path)) ? (length - offsetof(sockaddr_un, sun_path)) : 0;
+    if (size == 0)
+    {
+        return "unix";
+    }
+    if (un->sun_path[0] == '\0')
+    {
+        return "unix:@" + std::string(un->sun_path + 1, size - 1);
+    }
+    return "unix:" + std::string(un->sun_path, strnlen(un->sun_path, size));
 }
 
 std::string AddressToHost(uint32_t address, uint16_t port)
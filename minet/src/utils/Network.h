@@ -7,8 +7,12 @@
 
 #include "minet/common/Base.h"
 
+#include <functional>
 #include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
 #include <sys/types.h> // ssize_t
+#include <vector>
 
 MINET_BEGIN
 
@@ -17,21 +21,137 @@ namespace network
 
 struct AcceptData
 {
-    sockaddr_in Address;
+    /**
+     * @brief Address of the peer, sockaddr_in or sockaddr_un.
+     */
+    sockaddr_storage Address;
+    socklen_t AddressLength;
     int SocketFd;
 };
 
+/**
+ * @brief Options applied to listen sockets and the connections they accept.
+ * @ref man 7 tcp, man 7 socket
+ */
+struct SocketProfile
+{
+    /**
+     * @brief Disable Nagle's algorithm with TCP_NODELAY, so that small
+     * responses are not held back waiting for the ACK of the last one.
+     */
+    bool NoDelay = true;
+
+    /**
+     * @brief Wake up accept only when data arrives, with TCP_DEFER_ACCEPT,
+     * in ms, 0 to disable. The kernel rounds it up to whole seconds.
+     */
+    unsigned DeferAccept = 0;
+
+    /**
+     * @brief Queue length for TCP_FASTOPEN, 0 to disable.
+     */
+    unsigned FastOpen = 0;
+
+    /**
+     * @brief Backlog of listen, capped by net.core.somaxconn.
+     */
+    unsigned Backlog = 2048;
+
+    /**
+     * @brief SO_RCVBUF and SO_SNDBUF in bytes, 0 for the kernel default.
+     * @note Set on the listen socket before listen, so that accepted
+     * connections inherit them and the window scale matches.
+     */
+    unsigned ReceiveBuffer = 0;
+    unsigned SendBuffer = 0;
+
+    /**
+     * @brief Send ACKs at once with TCP_QUICKACK, instead of delaying them.
+     * @note Not permanent, the kernel may fall back to delayed ACKs later.
+     */
+    bool QuickAck = false;
+
+    /**
+     * @brief Probe idle connections with SO_KEEPALIVE, to find dead peers.
+     */
+    bool KeepAlive = false;
+
+    /**
+     * @brief Busy poll the device queue on blocking reads with SO_BUSY_POLL,
+     * in microseconds, 0 to disable.
+     * @note Raising it above net.core.busy_read needs CAP_NET_ADMIN.
+     */
+    unsigned BusyPoll = 0;
+
+    /**
+     * @brief Send response bodies of at least this many bytes with
+     * MSG_ZEROCOPY, 0 to disable.
+     * @note
+     * Only pays off for large bodies, as each body is kept until the kernel
+     * releases its pages, and the kernel copies anyway on loopback.
+     */
+    unsigned ZeroCopy = 0;
+};
+
 /**
  * @brief Open a socket to the given host and port.
  * @param port The port to connect to.
  * @param block Whether to set the socket to blocking mode.
+ * @param reusePort Whether to set SO_REUSEPORT, so that multiple sockets
+ * can listen on the same port and the kernel balances connections among them.
  * @ref https://www.geeksforgeeks.org/socket-programming-cc/
+ * @ref man 7 socket
  * @note
  * If block set to true, then @link accept @endlink will block
  * until a new connection arrives. This may hang the server
  * when interrupt signal received.
+ * @param profile Options of the socket, also inherited by accepted sockets.
+ * @note
+ * If a socket listening on the port is inherited from the previous
+ * process, it is adopted instead of opening a new one.
+ */
+int OpenSocket(uint16_t port, bool block = false, bool reusePort = false,
+               const SocketProfile& profile = SocketProfile());
+
+/**
+ * @brief Open a Unix domain socket listening on the given path.
+ * @param path File system path, or a Linux abstract name starting with '@'.
+ * @param block Whether to set the socket to blocking mode.
+ * @param profile Options of the socket, TCP options are ignored.
+ * @ref man 7 unix
+ * @note
+ * A socket file left behind is removed, unless someone still listens on it.
+ * The file is not removed on close, so that it stays in place on hot restart.
+ */
+int OpenUnixSocket(const std::string& path, bool block = false, const SocketProfile& profile = SocketProfile());
+
+/**
+ * @brief Keep listen sockets handed over by the previous process, so that
+ * OpenSocket can adopt them.
+ */
+void InheritSockets(const std::vector<int>& fds);
+
+/**
+ * @brief Close inherited sockets not adopted by OpenSocket.
+ */
+void CloseInheritedSockets();
+
+/**
+ * @brief Pass sockets to another process over a Unix domain socket.
+ * @param channel Connected Unix domain socket.
+ * @param fds Sockets to pass, which are still open in this process.
+ * @return 0 on success, < 0 on failure.
+ * @ref man 7 unix, SCM_RIGHTS
  */
-int OpenSocket(uint16_t port, bool block = false);
+int SendSockets(int channel, const std::vector<int>& fds);
+
+/**
+ * @brief Receive sockets passed by SendSockets.
+ * @param channel Connected Unix domain socket.
+ * @param fds Output received sockets, with FD_CLOEXEC set.
+ * @return 0 on success, < 0 on failure.
+ */
+int ReceiveSockets(int channel, std::vector<int>* fds);
 
 /**
  * @brief Close the socket.
@@ -44,11 +164,31 @@ int CloseSocket(int fd);
  * @brief Accept a new socket, i.e. request.
  * @param fd The listening socket file descriptor.
  * @param data Output the accepted data.
+ * @param flags Flags of the new socket, e.g. SOCK_NONBLOCK, see accept4.
  * @return Whether there is a new data or not.
  * @warning If no new socket, the data will still be modified, and the SocketFd
  * will be -1.
  */
-bool AcceptSocket(int fd, AcceptData* data);
+bool AcceptSocket(int fd, AcceptData* data, int flags = 0);
+
+/**
+ * @brief Apply per connection options of the profile to an accepted socket.
+ * @param fd Accepted socket fd.
+ * @param profile The profile of the listen socket.
+ * @note Only for TCP sockets.
+ * @return 0 on success, < 0 on failure.
+ */
+int TuneSocket(int fd, const SocketProfile& profile);
+
+/**
+ * @brief Wait for the socket to become readable, e.g. a new connection.
+ * @param fd The socket to wait for.
+ * @param wakeFd Another fd to interrupt the wait, e.g. an eventfd, -1 for none.
+ * @param timeout In milliseconds, -1 to wait forever.
+ * @return 1 if the socket is readable, 0 if interrupted or timed out,
+ * < 0 on failure.
+ */
+int WaitSocket(int fd, int wakeFd, int timeout = -1);
 
 /**
  * @brief Make the given socket non-blocking.
@@ -57,6 +197,14 @@ bool AcceptSocket(int fd, AcceptData* data);
  */
 int MakeNonBlockingSocket(int fd);
 
+/**
+ * @brief Make blocking reads on the socket give up after the timeout.
+ * @param fd Existing socket fd.
+ * @param milliseconds The timeout, 0 to block forever.
+ * @return 0 on success, < 0 on failure.
+ */
+int SetReceiveTimeout(int fd, unsigned milliseconds);
+
 /**
  * @brief Read from the given socket.
  * @param fd Socket fd.
@@ -71,9 +219,40 @@ ssize_t ReadSocket(int fd, char* buffer, size_t length);
  * @param fd Socket fd.
  * @param buffer Content to write.
  * @param length Length to write.
+ * @param flags Extra flags of send, e.g. MSG_MORE.
  * @return Bytes wrote. -1 if error.
  */
-ssize_t WriteSocket(int fd, const char* buffer, size_t length);
+ssize_t WriteSocket(int fd, const char* buffer, size_t length, int flags = 0);
+
+/**
+ * @brief Allow MSG_ZEROCOPY sends on the socket with SO_ZEROCOPY.
+ * @param fd Socket fd.
+ * @return 0 on success, < 0 on failure, e.g. not a TCP socket.
+ */
+int EnableZeroCopy(int fd);
+
+/**
+ * @brief Read completions of MSG_ZEROCOPY sends from the error queue,
+ * without waiting for more.
+ * @param fd Socket fd.
+ * @param completed Called with each range of completed sends, first and
+ * last sequence number included.
+ * @param copied Output whether the kernel copied the data after all.
+ * @return Number of ranges read, < 0 on failure.
+ * @note
+ * The kernel numbers successful MSG_ZEROCOPY sends of a socket from 0,
+ * and a buffer may be modified once all sends of it are completed.
+ * Ranges may arrive out of order.
+ */
+int ReapZeroCopy(int fd, const std::function<void(uint32_t, uint32_t)>& completed, bool* copied);
+
+/**
+ * @brief Convert the address of a peer to a host string.
+ * @param address sockaddr_in or sockaddr_un.
+ * @param length The length of the address.
+ * @note Unix domain peers are shown as "unix", or "unix:" and their name.
+ */
+std::string AddressToHost(const sockaddr* address, socklen_t length);
 
 /**
  * @brief Convert integer address to IP string.
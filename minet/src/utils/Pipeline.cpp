@@ -0,0 +1,80 @@
+#include "utils/Pipeline.h"
+
+#include "minet/common/Assert.h"
+
+MINET_BEGIN
+
+namespace http
+{
+
+HttpPipeline::HttpPipeline() : _base(0), _next(0), _running(0), _barrier(false)
+{
+}
+
+size_t HttpPipeline::Push(bool concurrent)
+{
+    _entries.push_back({ concurrent, false, {} });
+    return _base + _entries.size() - 1;
+}
+
+bool HttpPipeline::Poll(size_t* seq)
+{
+    if ((_next == _base + _entries.size()) || _barrier)
+    {
+        return false;
+    }
+
+    const Entry& entry = _entries[_next - _base];
+    if (!entry.Concurrent)
+    {
+        if (_running > 0)
+        {
+            return false;
+        }
+        _barrier = true;
+    }
+
+    _running++;
+    *seq = _next++;
+
+    return true;
+}
+
+void HttpPipeline::Complete(size_t seq, std::string&& response)
+{
+    MINET_ASSERT((seq >= _base) && (seq < _next), "Request not started");
+
+    Entry& entry = _entries[seq - _base];
+    MINET_ASSERT(!entry.Completed, "Request already completed");
+
+    entry.Completed = true;
+    entry.Response = std::move(response);
+    if (!entry.Concurrent)
+    {
+        _barrier = false;
+    }
+    _running--;
+}
+
+std::string HttpPipeline::Take()
+{
+    std::string output;
+    while (!_entries.empty() && _entries.front().Completed)
+    {
+        if (output.empty())
+        {
+            output = std::move(_entries.front().Response);
+        }
+        else
+        {
+            output.append(_entries.front().Response);
+        }
+        _entries.pop_front();
+        _base++;
+    }
+    return output;
+}
+
+} // namespace http
+
+MINET_END
@@ -0,0 +1,90 @@
+/**
+ * @author Tony S.
+ * @details Ordering of pipelined HTTP requests.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <deque>
+#include <string>
+
+MINET_BEGIN
+
+namespace http
+{
+
+/**
+ * @brief Schedules pipelined requests on one connection, and keeps their
+ * responses in request order.
+ * @note
+ * Concurrent requests may run together. A non-concurrent request waits
+ * for all requests before it, and blocks all requests after it.
+ * @warning Not thread-safe, guard it with the connection.
+ */
+class HttpPipeline final
+{
+public:
+    HttpPipeline();
+
+    /**
+     * @brief Queue a new request.
+     * @param concurrent Whether it may run alongside other requests.
+     * @return The sequence number of the request.
+     */
+    size_t Push(bool concurrent);
+
+    /**
+     * @brief Get the next request that can start now.
+     * @param seq Output its sequence number.
+     * @return Whether there is one.
+     */
+    bool Poll(size_t* seq);
+
+    /**
+     * @brief Record the response of a finished request.
+     */
+    void Complete(size_t seq, std::string&& response);
+
+    /**
+     * @brief Take all responses that are ready to be sent.
+     * @return Responses joined in request order, empty if the first pending
+     * request is not finished yet.
+     */
+    std::string Take();
+
+    /**
+     * @brief Whether all queued requests are finished and taken.
+     */
+    bool IsDone() const
+    {
+        return _entries.empty();
+    }
+
+private:
+    struct Entry
+    {
+        bool Concurrent;
+        bool Completed;
+        std::string Response;
+    };
+
+    /**
+     * @brief Entries not taken yet, the first one has sequence _base.
+     */
+    std::deque<Entry> _entries;
+    size_t _base;
+
+    /**
+     * @brief Sequence of the next request to start.
+     */
+    size_t _next;
+
+    unsigned _running;
+    bool _barrier;
+};
+
+} // namespace http
+
+MINET_END
@@ -0,0 +1,60 @@
+#include "utils/TimerWheel.h"
+
+#include "minet/common/Assert.h"
+
+MINET_BEGIN
+
+TimerWheel::TimerWheel(unsigned tick, size_t slots, int64_t now)
+    : _slots(slots), _tick(tick), _current(now / tick), _size(0)
+{
+    MINET_ASSERT((tick > 0) && (slots > 0));
+}
+
+void TimerWheel::Schedule(int64_t deadline, uint64_t key)
+{
+    // Round up, so that a timer never expires early. A deadline already
+    // passed goes to the next tick not processed yet.
+    int64_t tick = std::max((deadline + _tick - 1) / _tick, _current);
+    _slots[tick % _slots.size()].push_back({ deadline, key });
+    _size++;
+}
+
+void TimerWheel::Advance(int64_t now, std::vector<uint64_t>* expired)
+{
+    int64_t target = now / _tick;
+
+    // No need to go around more than once.
+    int64_t last = std::min(target, _current + static_cast<int64_t>(_slots.size()) - 1);
+    for (int64_t tick = _current; tick <= last; tick++)
+    {
+        std::vector<Timer>& slot = _slots[tick % _slots.size()];
+        for (size_t i = 0; i < slot.size();)
+        {
+            if (slot[i].Deadline <= now)
+            {
+                expired->push_back(slot[i].Key);
+                slot[i] = slot.back();
+                slot.pop_back();
+                _size--;
+            }
+            else
+            {
+                i++; // for a later round
+            }
+        }
+    }
+
+    _current = target + 1;
+}
+
+int TimerWheel::NextTimeout(int64_t now) const
+{
+    if (_size == 0)
+    {
+        return -1;
+    }
+    int64_t next = _current * _tick;
+    return (next > now) ? static_cast<int>(next - now) : 0;
+}
+
+MINET_END
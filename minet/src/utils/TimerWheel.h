@@ -0,0 +1,74 @@
+/**
+ * @author Tony S.
+ * @details Hashed timer wheel for connection deadlines.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <cstdint>
+#include <vector>
+
+MINET_BEGIN
+
+/**
+ * @brief Hashed timer wheel, scheduling and expiring timers in O(1).
+ * @note
+ * A timer never expires early, but may expire up to one tick late.
+ * Timers can not be cancelled. Instead, the owner should check whether an
+ * expired key is still valid, and schedule a new timer if its deadline has
+ * been moved. Stale timers are dropped when their slot comes around.
+ * @warning Not thread-safe, it belongs to the reactor.
+ */
+class TimerWheel final
+{
+public:
+    /**
+     * @param tick Resolution of the wheel, in milliseconds.
+     * @param slots Number of slots, deadlines further than one round are
+     * kept in the slot until the right round.
+     * @param now Current time, in milliseconds.
+     */
+    TimerWheel(unsigned tick, size_t slots, int64_t now);
+
+    /**
+     * @brief Schedule a timer.
+     * @param deadline Absolute time to expire, in milliseconds.
+     * @param key Opaque key reported on expiration.
+     */
+    void Schedule(int64_t deadline, uint64_t key);
+
+    /**
+     * @brief Advance the wheel to now, and collect keys of all expired timers.
+     */
+    void Advance(int64_t now, std::vector<uint64_t>* expired);
+
+    /**
+     * @brief Milliseconds to wait before the next tick, -1 if no timer at all.
+     */
+    int NextTimeout(int64_t now) const;
+
+    size_t Size() const
+    {
+        return _size;
+    }
+
+private:
+    struct Timer
+    {
+        int64_t Deadline;
+        uint64_t Key;
+    };
+
+    std::vector<std::vector<Timer>> _slots;
+    unsigned _tick;
+
+    /**
+     * @brief Tick that has not been processed yet.
+     */
+    int64_t _current;
+    size_t _size;
+};
+
+MINET_END
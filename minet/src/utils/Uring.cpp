@@ -0,0 +1,709 @@
+#include "utils/Uring.h"
+
+#include "minet/common/Assert.h"
+
+#if defined(MINET_HAS_LIBURING)
+#include <liburing.h>
+#elif defined(MINET_HAS_IO_URING)
+#include <linux/io_uring.h>
+#endif
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+MINET_BEGIN
+
+namespace uring
+{
+
+#ifdef MINET_HAS_IO_URING
+
+/*
+ * ===================================================================
+ * ------------------------ Kernel Interface -------------------------
+ * ===================================================================
+ */
+
+static int _Register(int fd, unsigned opcode, void* arg, unsigned count)
+{
+    int r = static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    return r < 0 ? -errno : r;
+}
+
+#ifndef MINET_HAS_LIBURING
+static int _Setup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int _Enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0));
+}
+#endif
+
+struct Ring::Impl
+{
+#ifdef MINET_HAS_LIBURING
+    io_uring Uring = {};
+#else
+    // Submission queue, shared with the kernel.
+    void* SqRing = MAP_FAILED;
+    size_t SqRingSize = 0;
+    unsigned* SqHead = nullptr;
+    unsigned* SqTail = nullptr;
+    unsigned* SqArray = nullptr;
+    unsigned SqMask = 0;
+    unsigned SqEntries = 0;
+    io_uring_sqe* Sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t SqesSize = 0;
+
+    // Queued but not yet published, and published submissions.
+    unsigned SqeTail = 0;
+    unsigned SqeHead = 0;
+
+    // Completion queue, shared with the kernel.
+    void* CqRing = MAP_FAILED;
+    size_t CqRingSize = 0;
+    unsigned* CqHead = nullptr;
+    unsigned* CqTail = nullptr;
+    unsigned CqMask = 0;
+    io_uring_cqe* Cqes = nullptr;
+#endif
+
+    int Fd = -1;
+
+    // Provided buffer ring.
+    io_uring_buf_ring* BufRing = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+    size_t BufRingSize = 0;
+    std::vector<char> Buffers;
+    unsigned BufSize = 0;
+    unsigned BufMask = 0;
+    uint16_t BufTail = 0;
+
+    int Open(unsigned entries);
+    void Close();
+
+    bool Reserve(unsigned count);
+    io_uring_sqe* GetSqe();
+    int Submit(unsigned wait);
+    unsigned Reap(Completion* completions, unsigned max);
+
+    void AddBuffer(int id);
+    void PublishBuffers();
+};
+
+#ifdef MINET_HAS_LIBURING
+
+int Ring::Impl::Open(unsigned entries)
+{
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    int r = io_uring_queue_init_params(entries, &Uring, &params);
+    if (r == -EINVAL)
+    {
+        // Older kernel, try again without optional flags.
+        params = {};
+        r = io_uring_queue_init_params(entries, &Uring, &params);
+    }
+    if (r < 0)
+    {
+        return r;
+    }
+    Fd = Uring.ring_fd;
+    return 0;
+}
+
+void Ring::Impl::Close()
+{
+    if (Fd >= 0)
+    {
+        io_uring_queue_exit(&Uring);
+        Fd = -1;
+    }
+}
+
+bool Ring::Impl::Reserve(unsigned count)
+{
+    if (io_uring_sq_space_left(&Uring) < count)
+    {
+        io_uring_submit(&Uring);
+    }
+    return io_uring_sq_space_left(&Uring) >= count;
+}
+
+io_uring_sqe* Ring::Impl::GetSqe()
+{
+    io_uring_sqe* sqe = io_uring_get_sqe(&Uring);
+    if (!sqe)
+    {
+        io_uring_submit(&Uring);
+        sqe = io_uring_get_sqe(&Uring);
+    }
+    if (sqe)
+    {
+        std::memset(sqe, 0, sizeof(io_uring_sqe));
+    }
+    return sqe;
+}
+
+int Ring::Impl::Submit(unsigned wait)
+{
+    return wait ? io_uring_submit_and_wait(&Uring, wait) : io_uring_submit(&Uring);
+}
+
+unsigned Ring::Impl::Reap(Completion* completions, unsigned max)
+{
+    unsigned head;
+    unsigned count = 0;
+    io_uring_cqe* cqe;
+    io_uring_for_each_cqe(&Uring, head, cqe)
+    {
+        if (count == max)
+        {
+            break;
+        }
+        completions[count++] = { cqe->user_data, cqe->res, cqe->flags };
+    }
+    io_uring_cq_advance(&Uring, count);
+    return count;
+}
+
+#else
+
+int Ring::Impl::Open(unsigned entries)
+{
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_COOP_TASKRUN;
+    Fd = _Setup(entries, &params);
+    if (Fd < 0 && errno == EINVAL)
+    {
+        // Older kernel, try again without optional flags.
+        params = {};
+        Fd = _Setup(entries, &params);
+    }
+    if (Fd < 0)
+    {
+        return -errno;
+    }
+
+    SqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    CqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+    {
+        SqRingSize = CqRingSize = std::max(SqRingSize, CqRingSize);
+    }
+
+    SqRing = mmap(nullptr, SqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+    if (SqRing == MAP_FAILED)
+    {
+        int error = -errno;
+        Close();
+        return error;
+    }
+    if (single)
+    {
+        CqRing = SqRing;
+    }
+    else
+    {
+        CqRing = mmap(nullptr, CqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+        if (CqRing == MAP_FAILED)
+        {
+            int error = -errno;
+            Close();
+            return error;
+        }
+    }
+
+    SqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    Sqes = static_cast<io_uring_sqe*>(
+        mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES));
+    if (Sqes == MAP_FAILED)
+    {
+        int error = -errno;
+        Close();
+        return error;
+    }
+
+    char* sq = static_cast<char*>(SqRing);
+    SqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    SqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    SqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    SqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    SqEntries = params.sq_entries;
+    SqeHead = SqeTail = *SqTail;
+
+    char* cq = static_cast<char*>(CqRing);
+    CqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    CqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    CqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    Cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+void Ring::Impl::Close()
+{
+    if (Sqes != MAP_FAILED)
+    {
+        munmap(Sqes, SqesSize);
+        Sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    }
+    if (CqRing != MAP_FAILED && CqRing != SqRing)
+    {
+        munmap(CqRing, CqRingSize);
+    }
+    CqRing = MAP_FAILED;
+    if (SqRing != MAP_FAILED)
+    {
+        munmap(SqRing, SqRingSize);
+        SqRing = MAP_FAILED;
+    }
+    if (Fd >= 0)
+    {
+        close(Fd);
+        Fd = -1;
+    }
+}
+
+bool Ring::Impl::Reserve(unsigned count)
+{
+    unsigned head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+    if (SqEntries - (SqeTail - head) < count)
+    {
+        Submit(0);
+        head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+    }
+    return SqEntries - (SqeTail - head) >= count;
+}
+
+io_uring_sqe* Ring::Impl::GetSqe()
+{
+    unsigned head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+    if (SqeTail - head >= SqEntries)
+    {
+        // Full, hand what we have to the kernel and try again.
+        Submit(0);
+        head = __atomic_load_n(SqHead, __ATOMIC_ACQUIRE);
+        if (SqeTail - head >= SqEntries)
+        {
+            return nullptr;
+        }
+    }
+
+    io_uring_sqe* sqe = &Sqes[SqeTail & SqMask];
+    SqeTail++;
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+int Ring::Impl::Submit(unsigned wait)
+{
+    unsigned count = SqeTail - SqeHead;
+    unsigned tail = *SqTail;
+    for (; SqeHead != SqeTail; SqeHead++, tail++)
+    {
+        SqArray[tail & SqMask] = SqeHead & SqMask;
+    }
+    // Make the entries visible before the kernel sees the new tail.
+    __atomic_store_n(SqTail, tail, __ATOMIC_RELEASE);
+
+    if (count == 0 && wait == 0)
+    {
+        return 0;
+    }
+
+    int r = _Enter(Fd, count, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+    return r < 0 ? -errno : r;
+}
+
+unsigned Ring::Impl::Reap(Completion* completions, unsigned max)
+{
+    unsigned head = *CqHead;
+    unsigned tail = __atomic_load_n(CqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    while (head != tail && count < max)
+    {
+        const io_uring_cqe* cqe = &Cqes[head & CqMask];
+        completions[count++] = { cqe->user_data, cqe->res, cqe->flags };
+        head++;
+    }
+    // Release the slots back to the kernel.
+    __atomic_store_n(CqHead, head, __ATOMIC_RELEASE);
+    return count;
+}
+
+#endif
+
+void Ring::Impl::AddBuffer(int id)
+{
+    // Don't use BufRing->bufs, the flexible array is shifted in C++.
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(BufRing) + (BufTail & BufMask);
+    buf->addr = reinterpret_cast<uint64_t>(Buffers.data() + static_cast<size_t>(id) * BufSize);
+    buf->len = BufSize;
+    buf->bid = static_cast<uint16_t>(id);
+    BufTail++;
+}
+
+void Ring::Impl::PublishBuffers()
+{
+    __atomic_store_n(&BufRing->tail, BufTail, __ATOMIC_RELEASE);
+}
+
+/*
+ * ===================================================================
+ * ----------------------------- Ring --------------------------------
+ * ===================================================================
+ */
+
+bool IsSupported()
+{
+    // Multishot recv comes with Linux 6.0.
+    utsname name;
+    int major = 0;
+    int minor = 0;
+    if ((uname(&name) != 0) || (sscanf(name.release, "%d.%d", &major, &minor) != 2) || (major < 6))
+    {
+        return false;
+    }
+
+    Ring ring;
+    if (ring.Open(8) != 0)
+    {
+        return false;
+    }
+
+    // Probe the operations we need.
+    static constexpr unsigned MAX_OPS = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + MAX_OPS * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (_Register(ring._impl->Fd, IORING_REGISTER_PROBE, probe, MAX_OPS) < 0)
+    {
+        return false;
+    }
+    for (int op : { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_READ, IORING_OP_CLOSE,
+                    IORING_OP_ASYNC_CANCEL })
+    {
+        if ((op > probe->last_op) || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+        {
+            return false;
+        }
+    }
+
+    return ring.RegisterBuffers(0, 8, 64) == 0;
+}
+
+bool HasMore(const Completion& completion)
+{
+    return completion.Flags & IORING_CQE_F_MORE;
+}
+
+int BufferId(const Completion& completion)
+{
+    if (completion.Flags & IORING_CQE_F_BUFFER)
+    {
+        return static_cast<int>(completion.Flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+    return -1;
+}
+
+Ring::Ring() : _impl(std::make_unique<Impl>())
+{
+}
+
+Ring::~Ring()
+{
+    Close();
+}
+
+int Ring::Open(unsigned entries)
+{
+    return _impl->Open(entries);
+}
+
+void Ring::Close()
+{
+    // The kernel unpins the buffer ring once the ring is gone.
+    _impl->Close();
+    if (_impl->BufRing != MAP_FAILED)
+    {
+        munmap(_impl->BufRing, _impl->BufRingSize);
+        _impl->BufRing = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+    }
+    _impl->Buffers.clear();
+}
+
+int Ring::RegisterBuffers(uint16_t group, unsigned count, unsigned size)
+{
+    MINET_ASSERT(count > 0 && (count & (count - 1)) == 0, "Buffer count must be power of 2");
+    MINET_ASSERT(_impl->BufRing == MAP_FAILED, "Only one buffer ring is supported");
+
+    size_t ringSize = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        return -errno;
+    }
+
+    io_uring_buf_reg reg = {};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    int r = _Register(_impl->Fd, IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (r < 0)
+    {
+        munmap(ring, ringSize);
+        return r;
+    }
+
+    _impl->BufRing = static_cast<io_uring_buf_ring*>(ring);
+    _impl->BufRingSize = ringSize;
+    _impl->Buffers.resize(static_cast<size_t>(count) * size);
+    _impl->BufSize = size;
+    _impl->BufMask = count - 1;
+    _impl->BufTail = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        _impl->AddBuffer(static_cast<int>(i));
+    }
+    _impl->PublishBuffers();
+
+    return 0;
+}
+
+const char* Ring::GetBuffer(int id) const
+{
+    return _impl->Buffers.data() + static_cast<size_t>(id) * _impl->BufSize;
+}
+
+void Ring::RecycleBuffer(int id)
+{
+    _impl->AddBuffer(id);
+    _impl->PublishBuffers();
+}
+
+bool Ring::Reserve(unsigned count)
+{
+    return _impl->Reserve(count);
+}
+
+bool Ring::PrepareMultishotAccept(int fd, uint64_t userData)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool Ring::PrepareMultishotRecv(int fd, uint16_t group, uint64_t userData)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool Ring::PrepareSend(int fd, const char* buffer, size_t length, uint64_t userData, bool link)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    // Retry short sends in the kernel, so that a short send breaks the link.
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool Ring::PrepareRead(int fd, void* buffer, size_t length, uint64_t userData)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = static_cast<uint32_t>(length);
+    sqe->off = static_cast<uint64_t>(-1); // not seekable
+    sqe->user_data = userData;
+    return true;
+}
+
+bool Ring::PrepareClose(int fd, uint64_t userData)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool Ring::PrepareCancel(uint64_t target, uint64_t userData, bool link)
+{
+    io_uring_sqe* sqe = _impl->GetSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    // Nothing to cancel is not an error for us, so always continue the link.
+    sqe->flags = link ? IOSQE_IO_HARDLINK : 0;
+    sqe->user_data = userData;
+    return true;
+}
+
+int Ring::Submit(unsigned wait)
+{
+    return _impl->Submit(wait);
+}
+
+unsigned Ring::Reap(Completion* completions, unsigned max)
+{
+    return _impl->Reap(completions, max);
+}
+
+#else
+
+/*
+ * No io_uring at all, every operation fails.
+ */
+
+struct Ring::Impl
+{
+};
+
+bool IsSupported()
+{
+    return false;
+}
+
+bool HasMore(const Completion& /* completion */)
+{
+    return false;
+}
+
+int BufferId(const Completion& /* completion */)
+{
+    return -1;
+}
+
+Ring::Ring() : _impl(std::make_unique<Impl>())
+{
+}
+
+Ring::~Ring() = default;
+
+int Ring::Open(unsigned /* entries */)
+{
+    return -ENOSYS;
+}
+
+void Ring::Close()
+{
+}
+
+int Ring::RegisterBuffers(uint16_t /* group */, unsigned /* count */, unsigned /* size */)
+{
+    return -ENOSYS;
+}
+
+const char* Ring::GetBuffer(int /* id */) const
+{
+    return nullptr;
+}
+
+void Ring::RecycleBuffer(int /* id */)
+{
+}
+
+bool Ring::Reserve(unsigned /* count */)
+{
+    return false;
+}
+
+bool Ring::PrepareMultishotAccept(int /* fd */, uint64_t /* userData */)
+{
+    return false;
+}
+
+bool Ring::PrepareMultishotRecv(int /* fd */, uint16_t /* group */, uint64_t /* userData */)
+{
+    return false;
+}
+
+bool Ring::PrepareSend(int /* fd */, const char* /* buffer */, size_t /* length */, uint64_t /* userData */,
+                       bool /* link */)
+{
+    return false;
+}
+
+bool Ring::PrepareRead(int /* fd */, void* /* buffer */, size_t /* length */, uint64_t /* userData */)
+{
+    return false;
+}
+
+bool Ring::PrepareClose(int /* fd */, uint64_t /* userData */)
+{
+    return false;
+}
+
+bool Ring::PrepareCancel(uint64_t /* target */, uint64_t /* userData */, bool /* link */)
+{
+    return false;
+}
+
+int Ring::Submit(unsigned /* wait */)
+{
+    return -ENOSYS;
+}
+
+unsigned Ring::Reap(Completion* /* completions */, unsigned /* max */)
+{
+    return 0;
+}
+
+#endif
+
+} // namespace uring
+
+MINET_END
@@ -0,0 +1,141 @@
+/**
+ * @author Tony S.
+ * @details Thin wrapper around io_uring.
+ * @note
+ * Uses liburing if it is found at configure time, otherwise talks to the
+ * kernel with raw syscalls. If neither is available, nothing is supported.
+ */
+
+#pragma once
+
+#include "minet/common/Base.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+MINET_BEGIN
+
+namespace uring
+{
+
+/**
+ * @brief Check whether io_uring can be used on this host.
+ * @note
+ * Requires multishot accept and recv, and provided buffer rings, which
+ * means Linux 6.0 or newer.
+ */
+bool IsSupported();
+
+/**
+ * @brief One completion entry.
+ */
+struct Completion
+{
+    uint64_t UserData;
+    int Result;
+    uint32_t Flags;
+};
+
+/**
+ * @brief Whether the request of this completion will post more completions.
+ */
+bool HasMore(const Completion& completion);
+
+/**
+ * @brief Get the provided buffer used by this completion.
+ * @return The buffer id, -1 if no buffer is used.
+ */
+int BufferId(const Completion& completion);
+
+/**
+ * @brief An io_uring instance with one provided buffer ring.
+ * @note All methods must be called from the same thread.
+ */
+class Ring final
+{
+public:
+    Ring();
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    /**
+     * @brief Set up the ring.
+     * @param entries Submission queue size.
+     * @return 0 on success, -errno on failure.
+     */
+    int Open(unsigned entries);
+    void Close();
+
+    /**
+     * @brief Register the provided buffer ring for buffer selection.
+     * @param group Buffer group id.
+     * @param count Number of buffers, should be power of 2.
+     * @param size Size of each buffer.
+     * @return 0 on success, -errno on failure.
+     */
+    int RegisterBuffers(uint16_t group, unsigned count, unsigned size);
+
+    /**
+     * @brief Get the provided buffer by its id.
+     */
+    const char* GetBuffer(int id) const;
+
+    /**
+     * @brief Give the buffer back to the kernel after it is consumed.
+     */
+    void RecycleBuffer(int id);
+
+    /*
+     * Each Prepare* queues one submission, and returns false if the
+     * submission queue is still full after flushing it to the kernel.
+     */
+
+    /**
+     * @brief Make room for the next submissions, flushing queued ones to the
+     * kernel if needed, so that linked submissions are never split.
+     * @return false if there is still no room for all of them.
+     */
+    bool Reserve(unsigned count);
+
+    bool PrepareMultishotAccept(int fd, uint64_t userData);
+    bool PrepareMultishotRecv(int fd, uint16_t group, uint64_t userData);
+
+    /**
+     * @param link Whether the next submission only runs if this one succeeds.
+     */
+    bool PrepareSend(int fd, const char* buffer, size_t length, uint64_t userData, bool link);
+    bool PrepareRead(int fd, void* buffer, size_t length, uint64_t userData);
+    bool PrepareClose(int fd, uint64_t userData);
+
+    /**
+     * @brief Cancel all requests with the given user data.
+     * @param link Whether to always run the next submission after this one.
+     */
+    bool PrepareCancel(uint64_t target, uint64_t userData, bool link);
+
+    /**
+     * @brief Submit queued requests, and optionally wait for completions.
+     * @param wait Minimum number of completions to wait for.
+     * @return Number of submitted requests, -errno on failure.
+     */
+    int Submit(unsigned wait = 0);
+
+    /**
+     * @brief Take available completions without waiting.
+     * @return Number of completions taken.
+     */
+    unsigned Reap(Completion* completions, unsigned max);
+
+private:
+    friend bool IsSupported();
+
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+} // namespace uring
+
+MINET_END
@@ -0,0 +1,75 @@
+#!/bin/bash
+
+# This script measures idle CPU usage and request latency of the minet demo.
+# Set SPIN to run with spinTime, to see what busy polling buys.
+# To compare before and after a change, run it with binaries of both builds.
+
+SERVER=${1:-threaded}
+BIN=${2:-./build-release/demo/minet-demo}
+IDLE=${IDLE:-5}       # seconds to measure idle CPU usage
+ROUND=${ROUND:-200}   # requests to measure accept latency
+SPIN=${SPIN:-}        # spinTime in microseconds, to compare busy polling
+# Not registered, so no handler time is counted.
+URL="localhost:5000/bench"
+
+if [ ! -f "$BIN" ]; then
+    echo "Binary file not found: $BIN"
+    echo "Usage: $0 [basic|threaded|mayhem|sharded|uring] [binary]"
+    exit 1
+fi
+
+ARGS="demo/appsettings.jsonc"
+if [ "$SERVER" != "basic" ]; then
+    ARGS="demo/appsettings.$SERVER.json"
+fi
+
+if [ -n "$SPIN" ]; then
+    CONFIG=$(mktemp --suffix=.json)
+    sed "s/\"port\": 5000/\"spinTime\": $SPIN, \"port\": 5000/" $ARGS >$CONFIG
+    ARGS=$CONFIG
+fi
+
+echo -e "\033[0;36m$BIN $ARGS\033[0m"
+$BIN $ARGS >/dev/null 2>&1 &
+PID=$!
+trap "kill -INT $PID 2>/dev/null; rm -f $CONFIG" EXIT
+
+# Wait for the server to be ready.
+for (( i = 0; i < 50; i++ )); do
+    curl -s -o /dev/null $URL && break
+    sleep 0.1
+done
+
+# utime + stime of the whole process, in clock ticks
+function cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$PID/stat
+}
+
+sleep 1
+start=$(cpu_ticks)
+sleep $IDLE
+end=$(cpu_ticks)
+hz=$(getconf CLK_TCK)
+echo "Idle CPU usage: $(awk -v t=$((end - start)) -v hz=$hz -v s=$IDLE 'BEGIN { printf "%.1f%%", t * 100 / hz / s }')"
+
+function percentiles() {
+    sort -n | awk -v name="$1" '
+        { t[NR] = $1 * 1000; sum += t[NR] }
+        END {
+            p99 = int(NR * 0.99) + 1
+            if (p99 > NR) p99 = NR
+            printf "%s latency: avg %.3f ms, p50 %.3f ms, p99 %.3f ms (%d requests)\n",
+                   name, sum / NR, t[int(NR * 0.5) + 1], t[p99], NR
+        }'
+}
+
+# Each request opens a new connection, so time to first byte includes
+# the time for the server to accept it.
+for (( i = 0; i < $ROUND; i++ )); do
+    curl -s -o /dev/null -H "Connection: close" -w "%{time_starttransfer}\n" $URL
+done | percentiles "Accept"
+
+# All requests go over one kept-alive connection, so only the time to
+# wake up and serve is counted.
+curl -s -w "%{time_starttransfer}\n" $(for (( i = 0; i < $ROUND; i++ )); do echo "-o /dev/null $URL"; done) |
+    percentiles "Keep-alive"
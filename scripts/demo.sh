@@ -25,6 +25,12 @@ function run_server() {
     elif [ "$1" == "threaded" ]; then
         echo -e "\033[0;36mRun with Threaded server...\033[0m"
         ARGS="demo/appsettings.threaded.json"
+    elif [ "$1" == "sharded" ]; then
+        echo -e "\033[0;36mRun with Sharded server...\033[0m"
+        ARGS="demo/appsettings.sharded.json"
+    elif [ "$1" == "uring" ]; then
+        echo -e "\033[0;36mRun with Uring server...\033[0m"
+        ARGS="demo/appsettings.uring.json"
     fi
     
     echo -e "\033[0;36m$BIN $ARGS\033[0m"
@@ -93,5 +99,7 @@ else
     echo "  server          - run with Basic server"
     echo "  server threaded - run with Threaded server"
     echo "  server mayhem   - run with Mayhem server"
+    echo "  server sharded  - run with Sharded server"
+    echo "  server uring    - run with Uring server"
     echo "  client N        - 4 processes, each sends N requests"
 fi
@@ -2,6 +2,7 @@
 
 #include "minet/utils/Parser.h"
 
+#include "core/IServer.h"
 #include "io/StreamReader.h"
 
 #include "doctest.h"
@@ -66,6 +67,20 @@ TEST_CASE("GET request async")
     CHECK_EQ(request.Headers["Accept"], "*/*");
 }
 
+TEST_CASE("Percent-encoded path async")
+{
+    const char GET_REQUEST[] = "GET /static/my%20file.txt HTTP/1.1\r\n"
+                               "Host: localhost:8080\r\n"
+                               "\r\n";
+    auto stream = minet::CreateRef<minet::io::BufferInputStream>(GET_REQUEST, sizeof(GET_REQUEST) - 1);
+    auto reader = minet::CreateRef<minet::io::BufferedStreamReader>(stream);
+    minet::HttpRequest request;
+    minet::http::AsyncHttpRequestParser parser(&request);
+
+    CHECK_EQ(Parse(reader, parser), 1);
+    CHECK_EQ(request.Path, "/static/my%20file.txt");
+}
+
 TEST_CASE("POST request async")
 {
     const char POST_REQUEST[] = "POST /some/resource HTTP/1.1\r\n"
@@ -103,3 +118,39 @@ TEST_CASE("POST request async")
     CHECK_EQ(request.Headers["Accept"], "*/*");
     CHECK_EQ(request.Body, "{\"key\": \"value\"}");
 }
+
+TEST_CASE("Keep-alive requests async")
+{
+    const char FIRST_REQUEST[] = "GET /first HTTP/1.1\r\n"
+                                 "Host: localhost:8080\r\n"
+                                 "\r\n";
+    const char SECOND_REQUEST[] = "GET /second HTTP/1.1\r\n"
+                                  "Host: localhost:8080\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n";
+
+    auto stream = minet::CreateRef<minet::io::MemoryStream>();
+    minet::AsyncHttpContextBuilder builder(stream, "unknown");
+
+    stream->Feed(FIRST_REQUEST, sizeof(FIRST_REQUEST) - 1);
+    REQUIRE_EQ(builder.Parse(), 1);
+    CHECK_EQ(builder.GetContext()->Request.Path, "/first");
+    CHECK(builder.GetContext()->Request.IsKeepAlive());
+
+    // The second request is parsed into a fresh context on the same stream.
+    builder.Reset();
+    CHECK_EQ(builder.Parse(), 0);
+    stream->Feed(SECOND_REQUEST, sizeof(SECOND_REQUEST) - 1);
+    REQUIRE_EQ(builder.Parse(), 1);
+    CHECK_EQ(builder.GetContext()->Request.Path, "/second");
+    CHECK_FALSE(builder.GetContext()->Request.IsKeepAlive());
+    CHECK_EQ(builder.GetContext()->Response.BodyStream, stream);
+}
+
+TEST_CASE("Keep-alive is off by default for Threaded server")
+{
+    using minet::LoadServerConfig;
+    CHECK(LoadServerConfig(nlohmann::json::parse(R"({ "name": "Mayhem" })"))->KeepAlive);
+    CHECK_FALSE(LoadServerConfig(nlohmann::json::parse(R"({ "name": "Threaded" })"))->KeepAlive);
+    CHECK(LoadServerConfig(nlohmann::json::parse(R"({ "name": "Threaded", "keepAlive": true })"))->KeepAlive);
+}
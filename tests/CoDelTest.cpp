@@ -0,0 +1,54 @@
+#include <minet/minet.h>
+
+#include "utils/CoDel.h"
+
+#include "doctest.h"
+
+using minet::CoDel;
+
+TEST_CASE("CoDel keeps requests below the target")
+{
+    CoDel codel(5, 100);
+    for (int64_t now = 0; now < 1000; now += 10)
+    {
+        CHECK_FALSE(codel.ShouldDrop(4, now));
+    }
+    CHECK_FALSE(codel.IsDropping());
+}
+
+TEST_CASE("CoDel absorbs a short burst")
+{
+    CoDel codel(5, 100);
+    CHECK_FALSE(codel.ShouldDrop(50, 0));
+    CHECK_FALSE(codel.ShouldDrop(50, 99));
+
+    // The delay goes down within the interval.
+    CHECK_FALSE(codel.ShouldDrop(1, 99));
+    CHECK_FALSE(codel.ShouldDrop(50, 150));
+    CHECK_FALSE(codel.IsDropping());
+}
+
+TEST_CASE("CoDel drops faster while the delay stays high")
+{
+    CoDel codel(5, 100);
+    CHECK_FALSE(codel.ShouldDrop(10, 0));
+    CHECK_FALSE(codel.ShouldDrop(10, 50));
+
+    // Above the target for a whole interval.
+    CHECK(codel.ShouldDrop(10, 100));
+    CHECK(codel.IsDropping());
+    CHECK_FALSE(codel.ShouldDrop(10, 150));
+
+    // Next drops come after interval / sqrt(count).
+    CHECK_FALSE(codel.ShouldDrop(10, 199));
+    CHECK(codel.ShouldDrop(10, 200));
+    CHECK_FALSE(codel.ShouldDrop(10, 269));
+    CHECK(codel.ShouldDrop(10, 270));
+    CHECK_FALSE(codel.ShouldDrop(10, 326));
+    CHECK(codel.ShouldDrop(10, 327));
+
+    // Back below the target.
+    CHECK_FALSE(codel.ShouldDrop(1, 400));
+    CHECK_FALSE(codel.IsDropping());
+    CHECK_FALSE(codel.ShouldDrop(10, 410));
+}
@@ -0,0 +1,42 @@
+#include <minet/minet.h>
+
+#include "utils/ConnectionTable.h"
+
+#include "doctest.h"
+
+using minet::network::ConnectionTable;
+
+TEST_CASE("Connection table grows on demand")
+{
+    ConnectionTable<int> table(5000);
+
+    CHECK_NE(table.Insert(3, minet::CreateRef<int>(3)), 0);
+    CHECK_NE(table.Insert(4000, minet::CreateRef<int>(4000)), 0);
+    CHECK_EQ(table.Size(), 2);
+    CHECK_GT(table.End(), 4000);
+    CHECK_EQ(*table.Get(4000), 4000);
+    CHECK_FALSE(table.Get(4001));
+
+    // Beyond the limit.
+    CHECK_EQ(table.Insert(5000, minet::CreateRef<int>(5000)), 0);
+    CHECK_EQ(table.Size(), 2);
+}
+
+TEST_CASE("Connection table tells stale connections")
+{
+    ConnectionTable<int> table(16);
+
+    uint32_t first = table.Insert(7, minet::CreateRef<int>(1));
+    CHECK(table.IsCurrent(7, first));
+
+    table.Remove(7);
+    CHECK_FALSE(table.Get(7));
+    CHECK_FALSE(table.IsCurrent(7, first));
+
+    // The same fd reused by a new connection.
+    uint32_t second = table.Insert(7, minet::CreateRef<int>(2));
+    CHECK_NE(first, second);
+    CHECK_FALSE(table.IsCurrent(7, first));
+    CHECK(table.IsCurrent(7, second));
+    CHECK_EQ(table.Size(), 1);
+}
@@ -0,0 +1,64 @@
+#include <minet/minet.h>
+
+#include "core/IServer.h"
+#include "threading/ThreadPool.h"
+#include "utils/Native.h"
+
+#include "doctest.h"
+
+#include <future>
+#include <sched.h>
+
+using namespace minet;
+
+TEST_CASE("CPUs are loaded from config")
+{
+    Ref<ServerConfig> config = LoadServerConfig(nlohmann::json::object());
+    CHECK(config->Cpus.empty());
+
+    config = LoadServerConfig(nlohmann::json::parse(R"({ "cpus": "auto" })"));
+    CHECK_EQ(config->Cpus, native::GetAllowedCpus());
+    CHECK_FALSE(config->Cpus.empty());
+
+    config = LoadServerConfig(nlohmann::json::parse(R"({ "cpus": [3, 1, 2] })"));
+    CHECK_EQ(config->Cpus, std::vector<int>{ 3, 1, 2 });
+
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "cpus": "all" })")));
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "cpus": [-1] })")));
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "cpus": ["0"] })")));
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "cpus": 4 })")));
+}
+
+TEST_CASE("CPUs are split between event loops and workers")
+{
+    ServerConfig config;
+    CHECK_EQ(GetReactorCpu(config), -1);
+    CHECK(GetWorkerCpus(config).empty());
+
+    config.Cpus = { 4, 5, 6, 7 };
+    CHECK_EQ(GetReactorCpu(config), 4);
+    CHECK_EQ(GetReactorCpu(config, 1), 5);
+    CHECK_EQ(GetReactorCpu(config, 5), 5);
+    CHECK_EQ(GetWorkerCpus(config), std::vector<int>{ 5, 6, 7 });
+    CHECK_EQ(GetWorkerCpus(config, 3), std::vector<int>{ 7 });
+    CHECK_EQ(GetWorkerCpus(config, 4), config.Cpus);
+}
+
+TEST_CASE("Threads are pinned to CPUs")
+{
+    std::vector<int> cpus = native::GetAllowedCpus();
+    REQUIRE_FALSE(cpus.empty());
+
+    CHECK_EQ(native::PinThread(-1), 0);
+    CHECK_NE(native::PinThread(CPU_SETSIZE), 0);
+
+    // Pin workers to the last allowed CPU, and see where they run.
+    threading::ThreadPool pool(2, 16, 0, { cpus.back() });
+    for (int i = 0; i < 4; i++)
+    {
+        std::promise<int> promise;
+        std::future<int> result = promise.get_future();
+        REQUIRE(pool.Submit([&promise] { promise.set_value(sched_getcpu()); }));
+        CHECK_EQ(result.get(), cpus.back());
+    }
+}
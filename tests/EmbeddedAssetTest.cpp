@@ -0,0 +1,120 @@
+#include <minet/minet.h>
+
+#include "components/EmbeddedAssetHandler.h"
+#include "components/RequestDispatcher.h"
+#include "io/Stream.h"
+
+#include "doctest.h"
+
+#include "test_assets.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace minet;
+
+static const EmbeddedAsset* _Find(const std::string& path)
+{
+    for (size_t i = 0; i < test_assets.Count; i++)
+    {
+        if (test_assets.Assets[i].Path == path)
+        {
+            return &test_assets.Assets[i];
+        }
+    }
+    return nullptr;
+}
+
+TEST_CASE("Assets are embedded with their responses")
+{
+    REQUIRE_EQ(test_assets.Count, 2);
+
+    const EmbeddedAsset* index = _Find("/static/index.html");
+    REQUIRE(index);
+    CHECK_EQ(index->Body, "<!DOCTYPE html>\n<html><body>Hello</body></html>\n");
+    CHECK_EQ(index->Head[0], "HTTP/1.1 200 OK\r\n"
+                             "Server: minet\r\n"
+                             "Content-Type: text/html; charset=utf-8\r\n"
+                             "Content-Length: 48\r\n"
+                             "Connection: close\r\n\r\n");
+    CHECK_EQ(index->Head[1].substr(index->Head[1].size() - 26), "Connection: keep-alive\r\n\r\n");
+
+    // Too small to be worth compressing.
+    CHECK(index->GzipBody.empty());
+
+    const EmbeddedAsset* css = _Find("/static/css/site.css");
+    REQUIRE(css);
+    CHECK_EQ(css->Body.size(), 1270);
+    CHECK_EQ(css->Body.substr(0, 10), ".item-0 {\n");
+    CHECK_NE(css->Head[1].find("Vary: Accept-Encoding\r\n"), std::string_view::npos);
+    if (!css->GzipBody.empty())
+    {
+        CHECK_LT(css->GzipBody.size(), css->Body.size());
+        CHECK_NE(css->GzipHead[1].find("Content-Encoding: gzip\r\n"), std::string_view::npos);
+        CHECK_NE(css->GzipHead[1].find("Server: minet\r\n"), std::string_view::npos);
+        CHECK_NE(css->GzipHead[1].find("Content-Length: " + std::to_string(css->GzipBody.size()) + "\r\n"),
+                 std::string_view::npos);
+    }
+}
+
+TEST_CASE("Embedded assets are sent as built")
+{
+    const EmbeddedAsset* css = _Find("/static/css/site.css");
+    REQUIRE(css);
+
+    RequestDispatcher dispatcher;
+    dispatcher.RegisterHandler("/static/css/site.css", http::HttpMethod::GET,
+                               CreateRef<EmbeddedAssetHandler>(*css), true);
+
+    auto send = [&dispatcher](const std::string& name, const std::string& encodings) {
+        auto stream = CreateRef<io::MemoryStream>();
+        auto context = CreateRef<HttpContext>();
+        context->Request.Method = http::HttpMethod::GET;
+        context->Request.Path = "/static/css/site.css";
+        if (!name.empty())
+        {
+            context->Request.Headers[name] = encodings;
+        }
+        context->Request.BodyStream = stream;
+        context->Response.BodyStream = stream;
+        context->KeepAlive = true;
+        dispatcher.Dispatch(context);
+        return stream->Output();
+    };
+
+    std::string plain = std::string(css->Head[1]) + std::string(css->Body);
+    CHECK_EQ(send("", ""), plain);
+    if (!css->GzipBody.empty())
+    {
+        std::string gzip = std::string(css->GzipHead[1]) + std::string(css->GzipBody);
+        CHECK_EQ(send("Accept-Encoding", "gzip, deflate"), gzip);
+        CHECK_EQ(send("accept-encoding", "deflate, GZIP;q=0.8"), gzip);
+        CHECK_EQ(send("Accept-Encoding", "*"), gzip);
+
+        // Refused on purpose, or not listed at all.
+        CHECK_EQ(send("Accept-Encoding", "gzip;q=0, deflate"), plain);
+        CHECK_EQ(send("Accept-Encoding", "gzip ; q=0.000"), plain);
+        CHECK_EQ(send("Accept-Encoding", "*;q=1, gzip;q=0"), plain);
+        CHECK_EQ(send("Accept-Encoding", "deflate, br"), plain);
+        CHECK_EQ(send("Accept-Encoding", "identity, xgzip"), plain);
+    }
+}
+
+TEST_CASE("Buffers are sent in one go")
+{
+    int fds[2];
+    REQUIRE_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    std::string head = "HTTP/1.1 200 OK\r\n\r\n";
+    std::string body = "Hello";
+    iovec parts[] = { { head.data(), head.size() }, { body.data(), body.size() } };
+    io::SocketStream stream(fds[0]);
+    CHECK_EQ(stream.WriteVector(parts, 2), head.size() + body.size());
+
+    char buffer[64] = {};
+    CHECK_EQ(read(fds[1], buffer, sizeof(buffer)), head.size() + body.size());
+    CHECK_EQ(std::string(buffer), head + body);
+
+    stream.Close();
+    close(fds[1]);
+}
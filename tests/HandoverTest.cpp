@@ -0,0 +1,79 @@
+#include <minet/minet.h>
+
+#include "utils/Network.h"
+
+#include "doctest.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace minet;
+
+static uint16_t _GetPort(int fd)
+{
+    sockaddr_in address = {};
+    socklen_t size = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &size);
+    return ntohs(address.sin_port);
+}
+
+TEST_CASE("Listen sockets are passed between processes")
+{
+    int listenFd = network::OpenSocket(0);
+    REQUIRE_GT(listenFd, 0);
+    uint16_t port = _GetPort(listenFd);
+
+    int channels[2];
+    REQUIRE_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, channels), 0);
+
+    std::vector<int> fds;
+    CHECK_EQ(network::SendSockets(channels[0], { listenFd }), 0);
+    CHECK_EQ(network::ReceiveSockets(channels[1], &fds), 0);
+    REQUIRE_EQ(fds.size(), 1);
+    CHECK_NE(fds[0], listenFd);
+    CHECK_EQ(_GetPort(fds[0]), port);
+
+    close(channels[0]);
+    close(channels[1]);
+    network::CloseSocket(listenFd);
+
+    // The passed socket is still listening after the original is closed.
+    network::InheritSockets(fds);
+    int adopted = network::OpenSocket(port);
+    CHECK_EQ(adopted, fds[0]);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    CHECK_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    CHECK_EQ(network::WaitSocket(adopted, -1, 1000), 1);
+
+    network::AcceptData data;
+    CHECK(network::AcceptSocket(adopted, &data));
+
+    close(data.SocketFd);
+    close(client);
+    network::CloseSocket(adopted);
+}
+
+TEST_CASE("Inherited sockets are adopted only once")
+{
+    int listenFd = network::OpenSocket(0, false, true);
+    REQUIRE_GT(listenFd, 0);
+    uint16_t port = _GetPort(listenFd);
+
+    network::InheritSockets({ listenFd });
+    CHECK_EQ(network::OpenSocket(port, false, true), listenFd);
+
+    // Another one is opened, as the only inherited socket is taken.
+    int another = network::OpenSocket(port, false, true);
+    CHECK_GT(another, 0);
+    CHECK_NE(another, listenFd);
+
+    network::CloseInheritedSockets();
+    network::CloseSocket(another);
+    network::CloseSocket(listenFd);
+}
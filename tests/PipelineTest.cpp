@@ -0,0 +1,65 @@
+#include <minet/minet.h>
+
+#include "utils/Pipeline.h"
+
+#include "doctest.h"
+
+#include <vector>
+
+using minet::http::HttpPipeline;
+
+static std::vector<size_t> PollAll(HttpPipeline& pipeline)
+{
+    std::vector<size_t> started;
+    size_t seq;
+    while (pipeline.Poll(&seq))
+    {
+        started.push_back(seq);
+    }
+    return started;
+}
+
+TEST_CASE("Pipeline keeps response order")
+{
+    HttpPipeline pipeline;
+    for (int i = 0; i < 3; i++)
+    {
+        pipeline.Push(true);
+    }
+
+    // All concurrent requests start at once.
+    CHECK_EQ(PollAll(pipeline), std::vector<size_t>{ 0, 1, 2 });
+
+    pipeline.Complete(2, "C");
+    pipeline.Complete(1, "B");
+    CHECK_EQ(pipeline.Take(), "");
+
+    pipeline.Complete(0, "A");
+    CHECK_EQ(pipeline.Take(), "ABC");
+    CHECK(pipeline.IsDone());
+}
+
+TEST_CASE("Pipeline waits for non-concurrent request")
+{
+    HttpPipeline pipeline;
+    pipeline.Push(true);
+    pipeline.Push(false);
+    pipeline.Push(true);
+
+    CHECK_EQ(PollAll(pipeline), std::vector<size_t>{ 0 });
+
+    pipeline.Complete(0, "A");
+    CHECK_EQ(pipeline.Take(), "A");
+    CHECK_EQ(PollAll(pipeline), std::vector<size_t>{ 1 });
+
+    pipeline.Complete(1, "B");
+    CHECK_EQ(PollAll(pipeline), std::vector<size_t>{ 2 });
+    CHECK_FALSE(pipeline.IsDone());
+
+    pipeline.Complete(2, "C");
+    CHECK_EQ(pipeline.Take(), "BC");
+    CHECK(pipeline.IsDone());
+
+    // Sequence keeps growing for the next batch.
+    CHECK_EQ(pipeline.Push(true), 3);
+}
@@ -0,0 +1,89 @@
+#include <minet/minet.h>
+
+#include "core/IServer.h"
+#include "utils/Network.h"
+
+#include "doctest.h"
+
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace minet;
+
+static int _GetOption(int fd, int level, int name)
+{
+    int value = -1;
+    socklen_t size = sizeof(value);
+    getsockopt(fd, level, name, &value, &size);
+    return value;
+}
+
+TEST_CASE("Socket profile is loaded from config")
+{
+    Ref<ServerConfig> config = LoadServerConfig(nlohmann::json::object());
+    CHECK(config->Socket.NoDelay);
+    CHECK_EQ(config->Socket.Backlog, 2048);
+    CHECK_FALSE(config->Socket.KeepAlive);
+    CHECK_EQ(config->Socket.ZeroCopy, 0);
+
+    config = LoadServerConfig(nlohmann::json::parse(R"({
+        "socket": {
+            "noDelay": false,
+            "deferAccept": 1500,
+            "fastOpen": 16,
+            "backlog": 128,
+            "receiveBuffer": 65536,
+            "quickAck": true,
+            "keepAlive": true,
+            "zeroCopy": 65536
+        }
+    })"));
+    CHECK_FALSE(config->Socket.NoDelay);
+    CHECK_EQ(config->Socket.DeferAccept, 1500);
+    CHECK_EQ(config->Socket.FastOpen, 16);
+    CHECK_EQ(config->Socket.Backlog, 128);
+    CHECK_EQ(config->Socket.ReceiveBuffer, 65536);
+    CHECK_EQ(config->Socket.SendBuffer, 0);
+    CHECK(config->Socket.QuickAck);
+    CHECK(config->Socket.KeepAlive);
+    CHECK_EQ(config->Socket.ZeroCopy, 65536);
+
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "socket": { "backlog": 0 } })")));
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "socket": 1 })")));
+}
+
+TEST_CASE("Socket profile is applied to listen and accepted sockets")
+{
+    network::SocketProfile profile;
+    profile.DeferAccept = 1500;
+    profile.KeepAlive = true;
+
+    int listenFd = network::OpenSocket(0, false, false, profile);
+    REQUIRE_GT(listenFd, 0);
+    CHECK_EQ(_GetOption(listenFd, IPPROTO_TCP, TCP_NODELAY), 1);
+    CHECK_EQ(_GetOption(listenFd, SOL_SOCKET, SO_KEEPALIVE), 1);
+    CHECK_GT(_GetOption(listenFd, IPPROTO_TCP, TCP_DEFER_ACCEPT), 0);
+
+    sockaddr_in address = {};
+    socklen_t size = sizeof(address);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &size);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // Deferred accept waits for data, so send something first.
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    CHECK_EQ(send(client, "GET", 3, 0), 3);
+    REQUIRE_EQ(network::WaitSocket(listenFd, -1, 1000), 1);
+
+    network::AcceptData data;
+    REQUIRE(network::AcceptSocket(listenFd, &data));
+    CHECK_EQ(network::TuneSocket(data.SocketFd, profile), 0);
+    CHECK_EQ(_GetOption(data.SocketFd, IPPROTO_TCP, TCP_NODELAY), 1);
+    CHECK_EQ(_GetOption(data.SocketFd, SOL_SOCKET, SO_KEEPALIVE), 1);
+
+    close(data.SocketFd);
+    close(client);
+    network::CloseSocket(listenFd);
+}
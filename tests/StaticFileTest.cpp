@@ -0,0 +1,126 @@
+#include <minet/minet.h>
+
+#include "components/StaticFileHandler.h"
+#include "utils/FileCache.h"
+
+#include "doctest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace minet;
+
+static std::string _MakeRoot()
+{
+    char root[] = "/tmp/minet-static-XXXXXX";
+    REQUIRE(mkdtemp(root));
+    return root;
+}
+
+static void _WriteFile(const std::string& path, const std::string& content)
+{
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+TEST_CASE("Request paths are mapped under the root")
+{
+    StaticFileHandler handler("/assets", "www/", 4);
+    CHECK_EQ(handler.MapPath("/assets/app.js"), "www/app.js");
+    CHECK_EQ(handler.MapPath("/assets/css/site.css?v=2"), "www/css/site.css");
+    CHECK_EQ(handler.MapPath("/assets/my%20file.txt"), "www/my file.txt");
+    CHECK_EQ(handler.MapPath("/assets"), "www");
+
+    // Not under the prefix.
+    CHECK(handler.MapPath("/assetsx/app.js").empty());
+    CHECK(handler.MapPath("/other").empty());
+
+    // Escaping the root, or hidden files.
+    CHECK(handler.MapPath("/assets/../secret").empty());
+    CHECK(handler.MapPath("/assets/css/../../secret").empty());
+    CHECK(handler.MapPath("/assets/%2e%2e/secret").empty());
+    CHECK(handler.MapPath("/assets/%2E%2E%2fsecret").empty());
+    CHECK(handler.MapPath("/assets/.git/config").empty());
+    CHECK(handler.MapPath("/assets/app.js%00.png").empty());
+    CHECK(handler.MapPath("/assets/%zz").empty());
+}
+
+TEST_CASE("Content type is told by the extension")
+{
+    CHECK_EQ(std::string(StaticFileHandler::GetContentType("www/index.html")), "text/html; charset=utf-8");
+    CHECK_EQ(std::string(StaticFileHandler::GetContentType("www/LOGO.PNG")), "image/png");
+    CHECK_EQ(std::string(StaticFileHandler::GetContentType("www/v1.2/README")), "application/octet-stream");
+}
+
+TEST_CASE("Static files are served from the root")
+{
+    std::string root = _MakeRoot();
+    mkdir((root + "/docs").c_str(), 0755);
+    _WriteFile(root + "/app.js", "let a = 1;");
+    _WriteFile(root + "/docs/index.html", "<html></html>");
+
+    StaticFileHandler handler("/", root, 4);
+    auto context = CreateRef<HttpContext>();
+
+    context->Request.Path = "/app.js";
+    REQUIRE_EQ(handler.Handle(context), http::status::OK);
+    REQUIRE(context->Response.File);
+    CHECK_EQ(context->Response.File->Length, 10);
+    CHECK_EQ(context->Response.ContentType, "text/javascript; charset=utf-8");
+
+    context = CreateRef<HttpContext>();
+    context->Request.Path = "/docs";
+    REQUIRE_EQ(handler.Handle(context), http::status::OK);
+    CHECK_EQ(context->Response.File->Length, 13);
+    CHECK_EQ(context->Response.ContentType, "text/html; charset=utf-8");
+
+    context = CreateRef<HttpContext>();
+    context->Request.Path = "/missing.js";
+    CHECK_EQ(handler.Handle(context), http::status::NOT_FOUND);
+    CHECK_FALSE(context->Response.File);
+
+    unlink((root + "/docs/index.html").c_str());
+    rmdir((root + "/docs").c_str());
+    unlink((root + "/app.js").c_str());
+    rmdir(root.c_str());
+}
+
+TEST_CASE("File cache keeps the most recently used files open")
+{
+    std::string root = _MakeRoot();
+    _WriteFile(root + "/a", "a");
+    _WriteFile(root + "/b", "bb");
+    _WriteFile(root + "/c", "ccc");
+
+    FileCache cache(2, 60000);
+    Ref<FileBody> a = cache.Open(root + "/a");
+    REQUIRE(a);
+    CHECK_EQ(a->Length, 1);
+    CHECK_EQ(cache.Open(root + "/a"), a);
+    CHECK_FALSE(cache.Open(root + "/missing"));
+    CHECK_FALSE(cache.Open(root));
+
+    // b is evicted, as a is used again after it.
+    Ref<FileBody> b = cache.Open(root + "/b");
+    CHECK_EQ(cache.Open(root + "/a"), a);
+    cache.Open(root + "/c");
+    CHECK_EQ(cache.Size(), 2);
+    CHECK_EQ(cache.Open(root + "/a"), a);
+    CHECK_NE(cache.Open(root + "/b"), b);
+
+    // Evicted files stay open for whoever is sending them.
+    char ch = 0;
+    CHECK_EQ(pread(b->Fd, &ch, 1, 0), 1);
+    CHECK_EQ(ch, 'b');
+
+    // Without a max age, the file is opened every time.
+    FileCache uncached(2, 0);
+    CHECK_NE(uncached.Open(root + "/a"), uncached.Open(root + "/a"));
+    CHECK_EQ(uncached.Size(), 0);
+
+    unlink((root + "/a").c_str());
+    unlink((root + "/b").c_str());
+    unlink((root + "/c").c_str());
+    rmdir(root.c_str());
+}
@@ -0,0 +1,181 @@
+#include <minet/minet.h>
+
+#include "io/Stream.h"
+#include "io/StreamWriter.h"
+#include "utils/Network.h"
+
+#include "doctest.h"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace minet;
+
+namespace
+{
+
+// Records each write to see how the writer sends them.
+class RecordStream final : public io::Stream
+{
+public:
+    bool IsReadable() const override
+    {
+        return false;
+    }
+    bool IsWritable() const override
+    {
+        return true;
+    }
+
+    ssize_t Read(char* buffer, size_t length) override
+    {
+        return io::StreamStatus::Error;
+    }
+
+    ssize_t Write(const char* buffer, size_t length) override
+    {
+        Writes.emplace_back(buffer, length);
+        More.push_back(false);
+        return static_cast<ssize_t>(length);
+    }
+
+    ssize_t WriteMore(const char* buffer, size_t length) override
+    {
+        Writes.emplace_back(buffer, length);
+        More.push_back(true);
+        return static_cast<ssize_t>(length);
+    }
+
+    int Close() override
+    {
+        return 0;
+    }
+
+    std::vector<std::string> Writes;
+    std::vector<bool> More;
+};
+
+} // namespace
+
+TEST_CASE("Small writes are gathered into one")
+{
+    auto stream = CreateRef<RecordStream>();
+    {
+        io::BufferedStreamWriter writer(stream);
+        writer.Write("HTTP/1.1 200 OK\r\n");
+        writer.Write("Content-Length: 2\r\n\r\n");
+        writer.Write("OK");
+    }
+    REQUIRE_EQ(stream->Writes.size(), 1);
+    CHECK_EQ(stream->Writes[0], "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK");
+    CHECK_FALSE(stream->More[0]);
+}
+
+TEST_CASE("Large writes skip the buffer")
+{
+    auto stream = CreateRef<RecordStream>();
+    std::string body(1 << 20, 'x');
+    {
+        io::BufferedStreamWriter writer(stream);
+        writer.Write("HTTP/1.1 200 OK\r\n\r\n");
+        CHECK_EQ(writer.Write(body), body.size());
+    }
+
+    // The headers are held back for the body.
+    REQUIRE_EQ(stream->Writes.size(), 2);
+    CHECK_EQ(stream->Writes[0], "HTTP/1.1 200 OK\r\n\r\n");
+    CHECK(stream->More[0]);
+    CHECK_EQ(stream->Writes[1], body);
+    CHECK_FALSE(stream->More[1]);
+}
+
+TEST_CASE("Zero copy writes arrive intact")
+{
+    int listenFd = network::OpenSocket(0, true, false);
+    REQUIRE_GT(listenFd, 0);
+
+    sockaddr_in address = {};
+    socklen_t size = sizeof(address);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &size);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    network::AcceptData data;
+    REQUIRE(network::AcceptSocket(listenFd, &data));
+
+    std::string body(1 << 20, '\0');
+    for (size_t i = 0; i < body.size(); i++)
+    {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+
+    std::string received;
+    std::thread reader([client, &received, &body] {
+        char buffer[65536];
+        while (received.size() < body.size() * 2)
+        {
+            ssize_t r = recv(client, buffer, sizeof(buffer), 0);
+            if (r <= 0)
+            {
+                break;
+            }
+            received.append(buffer, r);
+        }
+    });
+
+    // The stream keeps the bodies, so the caller may drop them at once.
+    // The kernel copies on loopback, after which the stream stops trying.
+    io::SocketStream stream(data.SocketFd);
+    CHECK_EQ(stream.EnableZeroCopy(4096), 0);
+    CHECK_EQ(stream.WriteBody(std::string(body)), body.size());
+    CHECK_EQ(stream.WriteBody(std::string(body)), body.size());
+    reader.join();
+
+    CHECK_EQ(received, body + body);
+
+    // The socket is closed by the stream, once the kernel is done.
+    CHECK_EQ(stream.Close(), 0);
+    close(client);
+    network::CloseSocket(listenFd);
+}
+
+TEST_CASE("Short zero copy bodies arrive intact")
+{
+    int listenFd = network::OpenSocket(0, true, false);
+    REQUIRE_GT(listenFd, 0);
+
+    sockaddr_in address = {};
+    socklen_t size = sizeof(address);
+    getsockname(listenFd, reinterpret_cast<sockaddr*>(&address), &size);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE_EQ(connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+    network::AcceptData data;
+    REQUIRE(network::AcceptSocket(listenFd, &data));
+
+    // Bodies held inline by the string must not move while being sent.
+    io::SocketStream stream(data.SocketFd);
+    CHECK_EQ(stream.EnableZeroCopy(1), 0);
+    for (int i = 0; i < 8; i++)
+    {
+        CHECK_EQ(stream.WriteBody(std::string("hello")), 5);
+    }
+    CHECK_EQ(stream.Close(), 0);
+    io::SocketStream::ReapLingering();
+
+    std::string received;
+    char buffer[64];
+    for (ssize_t r; (r = recv(client, buffer, sizeof(buffer), 0)) > 0;)
+    {
+        received.append(buffer, r);
+    }
+    CHECK_EQ(received.size(), 40);
+    CHECK_EQ(received.find_first_not_of("hello"), std::string::npos);
+
+    close(client);
+    network::CloseSocket(listenFd);
+}
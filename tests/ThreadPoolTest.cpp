@@ -6,6 +6,8 @@
 
 #include <array>
 #include <future>
+#include <mutex>
+#include <vector>
 
 struct task_t
 {
@@ -43,3 +45,193 @@ TEST_CASE("ThreadPool")
         CHECK(tasks[i].result.get() == i);
     }
 }
+
+TEST_CASE("ThreadPool wakes up parked workers")
+{
+    using namespace minet::threading;
+    static constexpr int ROUND = 32;
+
+    for (unsigned spin : { 0u, 200u })
+    {
+        ThreadPool pool(2, 16, spin);
+        for (int i = 0; i < ROUND; i++)
+        {
+            // Let the workers run out of spin and park.
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+            std::promise<int> promise;
+            std::future<int> result = promise.get_future();
+            REQUIRE(pool.Submit([&promise, i] { promise.set_value(i); }));
+            CHECK_EQ(result.get(), i);
+        }
+    }
+}
+
+TEST_CASE("ThreadPool keeps tasks of one key on its home worker")
+{
+    using namespace minet::threading;
+    static constexpr int ROUND = 64;
+
+    ThreadPool pool(4, 256, 0, {}, 256);
+    for (size_t key = 0; key < 8; key++)
+    {
+        std::array<std::promise<std::thread::id>, ROUND> promises;
+        for (int i = 0; i < ROUND; i++)
+        {
+            auto* promise = &promises[i];
+            REQUIRE(pool.Submit(key, [promise] { promise->set_value(std::this_thread::get_id()); }));
+        }
+
+        std::thread::id home = promises[0].get_future().get();
+        for (int i = 1; i < ROUND; i++)
+        {
+            CHECK_EQ(promises[i].get_future().get(), home);
+        }
+    }
+}
+
+TEST_CASE("ThreadPool lets tasks be stolen once the home worker is overloaded")
+{
+    using namespace minet::threading;
+
+    ThreadPool pool(2, 16, 0, {}, 2);
+
+    // Hold the home worker, as nothing is stolen before it is overloaded.
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<std::thread::id> blocked;
+    REQUIRE(pool.Submit(0, [&blocked, released] {
+        blocked.set_value(std::this_thread::get_id());
+        released.wait();
+    }));
+    std::thread::id home = blocked.get_future().get();
+
+    std::promise<std::thread::id> first;
+    std::promise<std::thread::id> second;
+    REQUIRE(pool.Submit(0, [&first] { first.set_value(std::this_thread::get_id()); }));
+    REQUIRE(pool.Submit(0, [&second] { second.set_value(std::this_thread::get_id()); }));
+
+    // The first one is stolen, while the second waits for the home worker.
+    CHECK_NE(first.get_future().get(), home);
+    release.set_value();
+    second.get_future().get();
+}
+
+TEST_CASE("ThreadPool tries other workers when one is full")
+{
+    using namespace minet::threading;
+
+    // A high overload threshold keeps workers from stealing from each other.
+    ThreadPool pool(2, 2, 0, {}, 1024);
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> releaseSecond;
+    std::shared_future<void> releasedSecond = releaseSecond.get_future().share();
+
+    // Hold both workers, then fill both queues.
+    std::promise<void> first;
+    std::promise<std::thread::id> second;
+    REQUIRE(pool.Submit([&first, released] {
+        first.set_value();
+        released.wait();
+    }));
+    first.get_future().get();
+    REQUIRE(pool.Submit([&second, releasedSecond] {
+        second.set_value(std::this_thread::get_id());
+        releasedSecond.wait();
+    }));
+    std::thread::id id = second.get_future().get();
+    REQUIRE(pool.Submit([] {}));
+    REQUIRE(pool.Submit([] {}));
+    REQUIRE(pool.Submit([] {}));
+    std::promise<void> drained;
+    REQUIRE(pool.Submit([&drained] { drained.set_value(); }));
+    // Whichever is selected, both are full.
+    CHECK_FALSE(pool.Submit([] {}));
+    CHECK_FALSE(pool.Submit([] {}));
+    CHECK_EQ(pool.Pending(), 4);
+
+    // Only the second worker has room now, and it is found even if the
+    // first one is selected.
+    releaseSecond.set_value();
+    drained.get_future().get();
+    std::promise<std::thread::id> last;
+    REQUIRE(pool.Submit([&last] { last.set_value(std::this_thread::get_id()); }));
+    CHECK_EQ(last.get_future().get(), id);
+
+    release.set_value();
+}
+
+TEST_CASE("ThreadPool serves fresh tasks first under overload")
+{
+    using namespace minet::threading;
+
+    for (unsigned lifo : { 0u, 50u })
+    {
+        CAPTURE(lifo);
+        ThreadPool pool(1, 16, 0, {}, 0, lifo);
+
+        // Hold the only worker, so that tasks pile up behind it.
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        std::promise<void> blocked;
+        REQUIRE(pool.Submit([&blocked, released] {
+            blocked.set_value();
+            released.wait();
+        }));
+        blocked.get_future().get();
+
+        std::mutex mutex;
+        std::vector<int> order;
+        std::promise<void> done;
+        auto record = [&mutex, &order, &done](int i) {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+            if (order.size() == 4)
+            {
+                done.set_value();
+            }
+        };
+        REQUIRE(pool.Submit([&record] { record(0); }));
+        REQUIRE(pool.Submit([&record] { record(1); }));
+
+        // The stale ones have waited past the target when fresh ones come.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(pool.Submit([&record] { record(2); }));
+        REQUIRE(pool.Submit([&record] { record(3); }));
+        release.set_value();
+        done.get_future().get();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (lifo > 0)
+        {
+            CHECK_EQ(order, std::vector<int>{ 3, 2, 1, 0 });
+        }
+        else
+        {
+            CHECK_EQ(order, std::vector<int>{ 0, 1, 2, 3 });
+        }
+    }
+}
+
+TEST_CASE("AdaptiveQueue keeps order while data is on time")
+{
+    using namespace minet::threading;
+
+    AdaptiveQueue<int> queue(4, 1000);
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(queue.Push(i));
+    }
+    CHECK_FALSE(queue.Push(4));
+    CHECK_EQ(queue.Size(), 4);
+
+    int data;
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(queue.Pop(&data));
+        CHECK_EQ(data, i);
+    }
+    CHECK_FALSE(queue.Pop(&data));
+}
@@ -0,0 +1,61 @@
+#include <minet/minet.h>
+
+#include "utils/TimerWheel.h"
+
+#include "doctest.h"
+
+#include <algorithm>
+#include <vector>
+
+using minet::TimerWheel;
+
+static std::vector<uint64_t> Advance(TimerWheel& wheel, int64_t now)
+{
+    std::vector<uint64_t> expired;
+    wheel.Advance(now, &expired);
+    std::sort(expired.begin(), expired.end());
+    return expired;
+}
+
+TEST_CASE("Timer wheel expires in time")
+{
+    TimerWheel wheel(100, 8, 1000);
+    CHECK_EQ(wheel.NextTimeout(1000), -1);
+
+    wheel.Schedule(1250, 1);
+    wheel.Schedule(1300, 2);
+    wheel.Schedule(1050, 3);
+    CHECK_EQ(wheel.Size(), 3);
+    CHECK_EQ(wheel.NextTimeout(1000), 0);
+
+    // Never expire early.
+    CHECK_EQ(Advance(wheel, 1049), std::vector<uint64_t>{});
+    CHECK_EQ(Advance(wheel, 1100), std::vector<uint64_t>{ 3 });
+    CHECK_EQ(wheel.NextTimeout(1150), 50);
+    // Up to one tick late.
+    CHECK_EQ(Advance(wheel, 1299), std::vector<uint64_t>{});
+    CHECK_EQ(Advance(wheel, 1300), std::vector<uint64_t>{ 1, 2 });
+    CHECK_EQ(wheel.Size(), 0);
+}
+
+TEST_CASE("Timer wheel goes around")
+{
+    TimerWheel wheel(100, 4, 0);
+
+    // Both in the same slot, but different rounds.
+    wheel.Schedule(200, 1);
+    wheel.Schedule(600, 2);
+    wheel.Schedule(50, 3);
+
+    CHECK_EQ(Advance(wheel, 250), std::vector<uint64_t>{ 1, 3 });
+    CHECK_EQ(Advance(wheel, 550), std::vector<uint64_t>{});
+    CHECK_EQ(wheel.Size(), 1);
+
+    // Jump over several rounds at once.
+    wheel.Schedule(900, 4);
+    CHECK_EQ(Advance(wheel, 5000), std::vector<uint64_t>{ 2, 4 });
+
+    // Deadline already passed.
+    wheel.Schedule(10, 5);
+    CHECK_EQ(Advance(wheel, 5100), std::vector<uint64_t>{ 5 });
+}
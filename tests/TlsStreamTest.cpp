@@ -0,0 +1,253 @@
+#include <minet/minet.h>
+
+#include "core/IServer.h"
+#include "io/TlsStream.h"
+
+#include "doctest.h"
+
+#ifdef MINET_HAS_TLS
+
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace minet;
+
+/**
+ * @brief Make a self-signed certificate for localhost, with its key in the
+ * same file.
+ */
+static std::string _MakeCertificate()
+{
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    REQUIRE(EVP_PKEY_keygen_init(keyContext) == 1);
+    REQUIRE(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) == 1);
+    REQUIRE(EVP_PKEY_keygen(keyContext, &key) == 1);
+    EVP_PKEY_CTX_free(keyContext);
+
+    X509* certificate = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), 0);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 3600);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1,
+                               -1, 0);
+    X509_set_issuer_name(certificate, name);
+    REQUIRE(X509_sign(certificate, key, EVP_sha256()) > 0);
+
+    char path[] = "/tmp/minet-tls-XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    FILE* file = fdopen(fd, "w");
+    PEM_write_X509(file, certificate);
+    PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    fclose(file);
+
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return path;
+}
+
+/**
+ * @brief Send the request from the client, and receive it on the server,
+ * handshake included. Both sockets never block, so they take turns.
+ */
+static std::string _SendRequest(io::TlsStream& server, SSL* client, const std::string& request)
+{
+    std::string received;
+    bool sent = false;
+    char buffer[256];
+    for (int i = 0; (i < 100) && (received.size() < request.size()); i++)
+    {
+        if (!sent)
+        {
+            sent = SSL_write(client, request.data(), static_cast<int>(request.size())) > 0;
+        }
+        ssize_t r = server.Read(buffer, sizeof(buffer));
+        if (r > 0)
+        {
+            received.append(buffer, r);
+        }
+        else
+        {
+            REQUIRE_EQ(r, io::StreamStatus::Again);
+        }
+    }
+    return received;
+}
+
+static std::string _ReceiveResponse(SSL* client, size_t length)
+{
+    std::string received;
+    char buffer[256];
+    for (int i = 0; (i < 100) && (received.size() < length); i++)
+    {
+        int r = SSL_read(client, buffer, sizeof(buffer));
+        if (r > 0)
+        {
+            received.append(buffer, r);
+        }
+    }
+    return received;
+}
+
+TEST_CASE("TLS stream handshakes on reads, and resumes sessions")
+{
+    std::string certificate = _MakeCertificate();
+
+    for (bool tickets : { true, false })
+    {
+        CAPTURE(tickets);
+
+        io::TlsProfile profile;
+        profile.Certificate = certificate;
+        profile.SessionTickets = tickets;
+        std::string error;
+        Ref<io::TlsContext> context = io::TlsContext::Create(profile, &error);
+        REQUIRE_MESSAGE(context, error);
+
+        SSL_CTX* clientContext = SSL_CTX_new(TLS_client_method());
+        SSL_SESSION* session = nullptr;
+        for (int round = 0; round < 2; round++)
+        {
+            CAPTURE(round);
+
+            int fds[2];
+            REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+            io::TlsStream server(fds[0], context);
+            SSL* client = SSL_new(clientContext);
+            SSL_set_fd(client, fds[1]);
+            SSL_set_connect_state(client);
+            // Only HTTP/1.1 is taken.
+            static const unsigned char PROTOCOLS[] = "\x02h2\x08http/1.1";
+            SSL_set_alpn_protos(client, PROTOCOLS, sizeof(PROTOCOLS) - 1);
+            if (session)
+            {
+                SSL_set_session(client, session);
+            }
+
+            CHECK_EQ(_SendRequest(server, client, "GET / HTTP/1.1\r\n\r\n"), "GET / HTTP/1.1\r\n\r\n");
+            CHECK_EQ(server.GetProtocol(), "http/1.1");
+            CHECK_EQ(server.IsResumed(), round == 1);
+
+            CHECK_EQ(server.Write("HTTP/1.1 200 OK\r\n\r\n", 19), 19);
+            CHECK_EQ(_ReceiveResponse(client, 19), "HTTP/1.1 200 OK\r\n\r\n");
+            if (!session)
+            {
+                session = SSL_get1_session(client);
+                CHECK(SSL_SESSION_is_resumable(session));
+            }
+
+            // The client learns that the server closed on purpose.
+            CHECK_EQ(server.Close(), 0);
+            CHECK_EQ(server.Write("x", 1), io::StreamStatus::Error);
+            char buffer[16];
+            CHECK_EQ(SSL_read(client, buffer, sizeof(buffer)), 0);
+            CHECK_EQ(SSL_get_error(client, 0), SSL_ERROR_ZERO_RETURN);
+
+            // The server is gone, so just mark it closed to keep the
+            // session resumable.
+            SSL_set_shutdown(client, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+            SSL_free(client);
+            close(fds[1]);
+        }
+        SSL_SESSION_free(session);
+        SSL_CTX_free(clientContext);
+    }
+
+    remove(certificate.c_str());
+}
+
+TEST_CASE("TLS stream reports EOF and garbage")
+{
+    std::string certificate = _MakeCertificate();
+    io::TlsProfile profile;
+    profile.Certificate = certificate;
+    std::string error;
+    Ref<io::TlsContext> context = io::TlsContext::Create(profile, &error);
+    REQUIRE_MESSAGE(context, error);
+
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    io::TlsStream server(fds[0], context);
+    char buffer[64];
+    CHECK_EQ(server.Read(buffer, sizeof(buffer)), io::StreamStatus::Again);
+
+    // Plain HTTP to a TLS port.
+    const char request[] = "GET / HTTP/1.1\r\n\r\n";
+    REQUIRE(write(fds[1], request, sizeof(request) - 1) == sizeof(request) - 1);
+    CHECK_EQ(server.Read(buffer, sizeof(buffer)), io::StreamStatus::Error);
+    CHECK_FALSE(server.IsReadable());
+    CHECK_EQ(server.Close(), 0);
+    close(fds[1]);
+
+    // Closing before the handshake is simply EOF.
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+    io::TlsStream other(fds[0], context);
+    close(fds[1]);
+    CHECK_EQ(other.Read(buffer, sizeof(buffer)), 0);
+    CHECK_EQ(other.Close(), 0);
+
+    remove(certificate.c_str());
+}
+
+TEST_CASE("TLS profile is loaded from config")
+{
+    Ref<ServerConfig> config = LoadServerConfig(nlohmann::json::object());
+    CHECK_FALSE(config->Tls.IsEnabled());
+
+    config = LoadServerConfig(nlohmann::json::parse(R"({
+        "name": "Mayhem",
+        "tls": {
+            "certificate": "cert.pem",
+            "privateKey": "key.pem",
+            "sessionCache": 1024,
+            "sessionTickets": false
+        }
+    })"));
+    CHECK(config->Tls.IsEnabled());
+    CHECK_EQ(config->Tls.Certificate, "cert.pem");
+    CHECK_EQ(config->Tls.PrivateKey, "key.pem");
+    CHECK_EQ(config->Tls.SessionCache, 1024);
+    CHECK_FALSE(config->Tls.SessionTickets);
+    CHECK(config->Tls.TicketKey.empty());
+
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "name": "Basic", "tls": { "certificate": "a" } })")));
+    CHECK_THROWS(LoadServerConfig(nlohmann::json::parse(R"({ "tls": true })")));
+}
+
+TEST_CASE("TLS context rejects bad files")
+{
+    io::TlsProfile profile;
+    std::string error;
+    profile.Certificate = "/nonexistent/cert.pem";
+    CHECK_FALSE(io::TlsContext::Create(profile, &error));
+    CHECK_FALSE(error.empty());
+
+    profile.Certificate = _MakeCertificate();
+    char path[] = "/tmp/minet-ticket-XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    profile.TicketKey = path;
+    REQUIRE(write(fd, std::string(48, 'k').data(), 48) == 48);
+    error.clear();
+    CHECK_FALSE(io::TlsContext::Create(profile, &error));
+    CHECK_FALSE(error.empty());
+
+    REQUIRE(write(fd, std::string(32, 'k').data(), 32) == 32);
+    error.clear();
+    CHECK_MESSAGE(io::TlsContext::Create(profile, &error), error);
+    close(fd);
+
+    remove(path);
+    remove(profile.Certificate.c_str());
+}
+
+#endif
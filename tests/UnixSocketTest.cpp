@@ -0,0 +1,97 @@
+#include <minet/minet.h>
+
+#include "utils/Network.h"
+
+#include "doctest.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace minet;
+
+static int _Connect(const std::string& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.data(), path.size());
+    socklen_t length = offsetof(sockaddr_un, sun_path) + path.size();
+    if (path[0] == '@')
+    {
+        address.sun_path[0] = '\0';
+    }
+    else
+    {
+        length++;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), length) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void _CheckAccept(int listenFd, const std::string& path)
+{
+    int client = _Connect(path);
+    REQUIRE_GE(client, 0);
+    REQUIRE_EQ(network::WaitSocket(listenFd, -1, 1000), 1);
+
+    network::AcceptData data;
+    REQUIRE(network::AcceptSocket(listenFd, &data));
+    CHECK_EQ(network::AddressToHost(reinterpret_cast<sockaddr*>(&data.Address), data.AddressLength), "unix");
+
+    close(data.SocketFd);
+    close(client);
+}
+
+TEST_CASE("Unix domain socket listens on a path")
+{
+    std::string path = "/tmp/minet-test-" + std::to_string(getpid()) + ".sock";
+
+    int listenFd = network::OpenUnixSocket(path);
+    REQUIRE_GT(listenFd, 0);
+    _CheckAccept(listenFd, path);
+
+    // Someone is still listening on it.
+    CHECK_LT(network::OpenUnixSocket(path), 0);
+
+    // The file is left behind on close, and removed on the next open.
+    network::CloseSocket(listenFd);
+    struct stat st;
+    CHECK_EQ(stat(path.c_str(), &st), 0);
+    listenFd = network::OpenUnixSocket(path);
+    REQUIRE_GT(listenFd, 0);
+    _CheckAccept(listenFd, path);
+
+    // Handed over sockets are matched by path.
+    network::InheritSockets({ listenFd });
+    int tcpFd = network::OpenSocket(0);
+    CHECK_NE(tcpFd, listenFd);
+    network::CloseSocket(tcpFd);
+    int adopted = network::OpenUnixSocket(path);
+    CHECK_EQ(adopted, listenFd);
+
+    network::CloseSocket(adopted);
+    unlink(path.c_str());
+}
+
+TEST_CASE("Unix domain socket listens on an abstract name")
+{
+    std::string name = "@minet-test-" + std::to_string(getpid());
+
+    int listenFd = network::OpenUnixSocket(name);
+    REQUIRE_GT(listenFd, 0);
+    _CheckAccept(listenFd, name);
+
+    CHECK_LT(network::OpenUnixSocket(name), 0);
+    network::CloseSocket(listenFd);
+
+    CHECK_LT(network::OpenUnixSocket(""), 0);
+    CHECK_LT(network::OpenUnixSocket(std::string(sizeof(sockaddr_un::sun_path), 'a')), 0);
+}
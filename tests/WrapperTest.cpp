@@ -49,3 +49,18 @@ TEST_CASE("JsonRequest Wrapper")
     // Since header use unordered map, the order of headers may be different
     // CHECK_EQ(wrapper.ToString(), REQUEST);
 }
+
+TEST_CASE("HttpRequest copies keep the aborted state")
+{
+    static_assert(std::is_copy_constructible_v<minet::HttpRequest>);
+    static_assert(std::is_copy_assignable_v<minet::HttpRequest>);
+
+    minet::HttpRequest request{ .Path = "/" };
+    request.Aborted.Cancel();
+    minet::HttpRequest copy = request;
+    CHECK(copy.Aborted.IsCancellationRequested());
+    CHECK_EQ(copy.Path, "/");
+
+    copy = minet::HttpRequest{};
+    CHECK_FALSE(copy.Aborted.IsCancellationRequested());
+}